@@ -0,0 +1,192 @@
+//  gtb: Graphics Test Bench
+//  Copyright 2018 Joshua Buckman
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#pragma once
+
+namespace gtb {
+    namespace animation {
+        enum class target_path : uint8_t {
+            translation,
+            rotation,
+            scale
+        };
+
+        enum class interpolation : uint8_t {
+            step,
+            linear,
+            cubic_spline
+        };
+
+        // Keyframes of one animated node property, packed contiguously. Values are four wide whatever
+        // the property so every interpolation is a handful of 128 bit operations; cubic spline
+        // channels keep three values per key: in tangent, value, out tangent.
+        struct channel {
+            channel()
+                : transform_index(0)
+                , path(target_path::translation)
+                , mode(interpolation::linear)
+                , cursor(0)
+            {}
+
+            uint32_t transform_index;
+            target_path path;
+            interpolation mode;
+            std::vector<float> times; // seconds, ascending
+            std::vector<glm::vec4> values; // xyz for translation and scale, xyzw for rotation
+            uint32_t cursor; // key at or before the last sampled time
+        };
+
+        // One glTF animation; its channels play together and loop.
+        class clip {
+        public:
+            clip()
+                : m_duration(0.0f)
+            {}
+
+            void add_channel(channel&& c)
+            {
+                if (c.times.empty()) {
+                    return;
+                }
+
+                m_duration = std::max(m_duration, c.times.back());
+                m_channels.emplace_back(std::move(c));
+                m_samples.emplace_back(0.0f);
+            }
+
+            bool empty() const
+            {
+                return (m_channels.empty());
+            }
+
+            const std::vector<channel>& channels() const
+            {
+                return (m_channels);
+            }
+
+            // Samples every channel at time, wrapped to the clip. Touches nothing outside the clip, so
+            // clips can be sampled on different threads.
+            void sample(float time)
+            {
+                if (m_duration > 0.0f) {
+                    time = std::fmod(time, m_duration);
+                }
+
+                for (size_t i = 0; i < m_channels.size(); ++i) {
+                    m_samples[i] = sample_channel(m_channels[i], time);
+                }
+            }
+
+            // Writes the last sampled values to the animated nodes.
+            void apply(transform_hierarchy& transforms) const
+            {
+                for (size_t i = 0; i < m_channels.size(); ++i) {
+                    const channel& c(m_channels[i]);
+                    const glm::vec4& v(m_samples[i]);
+                    switch (c.path) {
+                    case target_path::translation:
+                        transforms.set_translation(c.transform_index, glm::vec3(v));
+                        break;
+                    case target_path::rotation:
+                        transforms.set_rotation(c.transform_index, glm::quat(v.w, v.x, v.y, v.z));
+                        break;
+                    case target_path::scale:
+                        transforms.set_scale(c.transform_index, glm::vec3(v));
+                        break;
+                    }
+                }
+            }
+
+        private:
+            static glm::vec4 sample_channel(channel& c, float time)
+            {
+                size_t key_count = c.times.size();
+                size_t stride = (c.mode == interpolation::cubic_spline) ? 3 : 1;
+                size_t value_offset = (c.mode == interpolation::cubic_spline) ? 1 : 0;
+
+                // Playback moves forward, so the cursor usually stays put or advances by one. Wrapping
+                // back to the start restarts the search.
+                uint32_t key = c.cursor;
+                if (time < c.times[key]) {
+                    key = 0;
+                }
+                while (((key + 1) < key_count) && (c.times[key + 1] <= time)) {
+                    ++key;
+                }
+                c.cursor = key;
+
+                // Before the first key or after the last, the nearest key holds.
+                if ((time <= c.times[key]) || ((key + 1) == key_count) || (c.mode == interpolation::step)) {
+                    return (c.values[(key * stride) + value_offset]);
+                }
+
+                float key_time = c.times[key + 1] - c.times[key];
+                float t = (time - c.times[key]) / key_time;
+
+                __m128 v0 = _mm_loadu_ps(&c.values[(key * stride) + value_offset][0]);
+                __m128 v1 = _mm_loadu_ps(&c.values[((key + 1) * stride) + value_offset][0]);
+                __m128 result;
+
+                if (c.mode == interpolation::cubic_spline) {
+                    // Hermite basis; tangents are scaled by the key interval.
+                    __m128 out0 = _mm_loadu_ps(&c.values[(key * stride) + 2][0]);
+                    __m128 in1 = _mm_loadu_ps(&c.values[((key + 1) * stride) + 0][0]);
+                    float t2 = t * t;
+                    float t3 = t2 * t;
+                    __m128 h00 = _mm_set1_ps((2.0f * t3) - (3.0f * t2) + 1.0f);
+                    __m128 h10 = _mm_set1_ps((t3 - (2.0f * t2) + t) * key_time);
+                    __m128 h01 = _mm_set1_ps((-2.0f * t3) + (3.0f * t2));
+                    __m128 h11 = _mm_set1_ps((t3 - t2) * key_time);
+                    result = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(h00, v0), _mm_mul_ps(h10, out0)),
+                        _mm_add_ps(_mm_mul_ps(h01, v1), _mm_mul_ps(h11, in1)));
+                }
+                else if (c.path == target_path::rotation) {
+                    // Slerp along the shorter arc; nearly parallel quaternions fall back to a lerp.
+                    float cos_angle = _mm_cvtss_f32(_mm_dp_ps(v0, v1, 0xf1));
+                    if (cos_angle < 0.0f) {
+                        v1 = _mm_sub_ps(_mm_setzero_ps(), v1);
+                        cos_angle = -cos_angle;
+                    }
+
+                    float w0 = 1.0f - t;
+                    float w1 = t;
+                    if (cos_angle < 0.9995f) {
+                        float angle = std::acos(cos_angle);
+                        float sin_angle = std::sin(angle);
+                        w0 = std::sin(w0 * angle) / sin_angle;
+                        w1 = std::sin(w1 * angle) / sin_angle;
+                    }
+                    result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w0), v0), _mm_mul_ps(_mm_set1_ps(w1), v1));
+                }
+                else {
+                    result = _mm_add_ps(v0, _mm_mul_ps(_mm_set1_ps(t), _mm_sub_ps(v1, v0)));
+                }
+
+                if (c.path == target_path::rotation) {
+                    __m128 length_squared = _mm_dp_ps(result, result, 0xff);
+                    result = _mm_div_ps(result, _mm_sqrt_ps(length_squared));
+                }
+
+                glm::vec4 value;
+                _mm_storeu_ps(&value[0], result);
+                return (value);
+            }
+
+            std::vector<channel> m_channels;
+            std::vector<glm::vec4> m_samples; // per channel, from the last sample
+            float m_duration; // seconds
+        };
+    }
+}
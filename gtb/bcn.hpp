@@ -0,0 +1,851 @@
+//  gtb: Graphics Test Bench
+//  Copyright 2018 Joshua Buckman
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#pragma once
+
+namespace gtb {
+    namespace bcn {
+        enum class format : uint8_t {
+            bc1_rgb, // 1 bit alpha ignored
+            bc1_rgba,
+            bc3,
+            bc5, // red and green; blue 0, alpha 255
+            bc7
+        };
+
+        inline uint32_t block_size(format f)
+        {
+            return (((f == format::bc1_rgb) || (f == format::bc1_rgba)) ? 8 : 16);
+        }
+
+        inline const char* name(format f)
+        {
+            const char* names[] = { "BC1", "BC1", "BC3", "BC5", "BC7" };
+            return (names[static_cast<uint32_t>(f)]);
+        }
+
+        namespace detail {
+            // Shuffles picking four RGBA8 palette entries for one row of 2 bit indices, by index byte.
+            inline const __m128i* row_shuffles()
+            {
+                struct table {
+                    table()
+                    {
+                        for (uint32_t b = 0; b < 256; ++b) {
+                            uint8_t* mask = reinterpret_cast<uint8_t*>(&masks[b]);
+                            for (uint32_t x = 0; x < 4; ++x) {
+                                uint32_t i = (b >> (x * 2)) & 3;
+                                for (uint32_t c = 0; c < 4; ++c) {
+                                    mask[(x * 4) + c] = static_cast<uint8_t>((i * 4) + c);
+                                }
+                            }
+                        }
+                    }
+
+                    __m128i masks[256];
+                };
+                static const table t;
+                return (t.masks);
+            }
+
+            // BC1 colors as RGBA8, 2 bit indices per texel. Three color blocks end in black, transparent
+            // when the format has alpha; the color half of BC3 blocks always has four colors.
+            inline void decode_color(const uint8_t* block, bool three_color_alpha, bool four_colors, __m128i rows[4])
+            {
+                uint32_t c0 = block[0] | (block[1] << 8);
+                uint32_t c1 = block[2] | (block[3] << 8);
+
+                // Endpoints widened to 16 bits per channel, c0 in the low half and c1 in the high half.
+                __m128i endpoints = _mm_setr_epi16(
+                    static_cast<int16_t>(((c0 >> 11) << 3) | (c0 >> 13)),
+                    static_cast<int16_t>((((c0 >> 5) & 0x3f) << 2) | ((c0 >> 9) & 0x3)),
+                    static_cast<int16_t>(((c0 & 0x1f) << 3) | ((c0 >> 2) & 0x7)),
+                    255,
+                    static_cast<int16_t>(((c1 >> 11) << 3) | (c1 >> 13)),
+                    static_cast<int16_t>((((c1 >> 5) & 0x3f) << 2) | ((c1 >> 9) & 0x3)),
+                    static_cast<int16_t>(((c1 & 0x1f) << 3) | ((c1 >> 2) & 0x7)),
+                    255);
+                __m128i e0 = _mm_unpacklo_epi64(endpoints, endpoints);
+                __m128i e1 = _mm_unpackhi_epi64(endpoints, endpoints);
+
+                __m128i blends;
+                if (four_colors || (c0 > c1)) {
+                    // (2 * c0 + c1) / 3 and (c0 + 2 * c1) / 3, rounded; 0x5556 / 65536 divides by three.
+                    __m128i sums = _mm_add_epi16(_mm_add_epi16(e0, e1), _mm_unpacklo_epi64(e0, e1));
+                    sums = _mm_add_epi16(sums, _mm_set1_epi16(1));
+                    blends = _mm_mulhi_epu16(sums, _mm_set1_epi16(0x5556));
+                }
+                else {
+                    // (c0 + c1) / 2, rounded, then black.
+                    __m128i half = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(e0, e1), _mm_set1_epi16(1)), 1);
+                    __m128i black = three_color_alpha ? _mm_setzero_si128() : _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+                    blends = _mm_unpacklo_epi64(half, black);
+                }
+                __m128i palette = _mm_packus_epi16(endpoints, blends);
+
+                const __m128i* shuffles = row_shuffles();
+                for (uint32_t y = 0; y < 4; ++y) {
+                    rows[y] = _mm_shuffle_epi8(palette, shuffles[block[4 + y]]);
+                }
+            }
+
+            // BC4 channel, one byte per texel in texel order.
+            inline __m128i decode_channel(const uint8_t* block)
+            {
+                uint32_t a0 = block[0];
+                uint32_t a1 = block[1];
+
+                uint8_t palette[16] = {};
+                palette[0] = static_cast<uint8_t>(a0);
+                palette[1] = static_cast<uint8_t>(a1);
+                if (a0 > a1) {
+                    for (uint32_t i = 1; i < 7; ++i) {
+                        palette[1 + i] = static_cast<uint8_t>((((7 - i) * a0) + (i * a1) + 3) / 7);
+                    }
+                }
+                else {
+                    for (uint32_t i = 1; i < 5; ++i) {
+                        palette[1 + i] = static_cast<uint8_t>((((5 - i) * a0) + (i * a1) + 2) / 5);
+                    }
+                    palette[6] = 0;
+                    palette[7] = 255;
+                }
+
+                uint64_t bits = 0;
+                for (uint32_t i = 0; i < 6; ++i) {
+                    bits |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+                }
+
+                alignas(16) uint8_t indices[16];
+                for (uint32_t i = 0; i < 16; ++i) {
+                    indices[i] = static_cast<uint8_t>((bits >> (i * 3)) & 7);
+                }
+
+                return (_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(palette)), _mm_load_si128(reinterpret_cast<const __m128i*>(indices))));
+            }
+
+            // Partition of each texel for the BC7 two subset shapes, one bit per texel.
+            const uint16_t partitions2[64] = {
+                0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+                0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+                0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+                0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+                0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+                0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+                0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+                0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+            };
+
+            // Partition of each texel for the BC7 three subset shapes.
+            const uint8_t partitions3[64][16] = {
+                { 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+                { 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+                { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+                { 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 }, { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+                { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 }, { 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+                { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+                { 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 }, { 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+                { 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+                { 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 }, { 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+                { 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+                { 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+                { 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 }, { 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+                { 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 }, { 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+                { 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 }, { 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+                { 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 }, { 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+                { 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 }, { 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+                { 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+                { 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 }, { 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+                { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 }, { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+                { 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 }, { 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+                { 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 }, { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+                { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 }, { 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+                { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 }, { 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+                { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 }, { 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+                { 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 }, { 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+                { 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 }, { 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+                { 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 }, { 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+                { 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+                { 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+                { 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+                { 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 }, { 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+                { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 }
+            };
+
+            // Texels whose index drops its top bit: the second subset's in two subset shapes, and the
+            // second and third subsets' in three subset shapes. The first subset's is always texel 0.
+            const uint8_t anchors2[64] = {
+                15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+                15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+                15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+                6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+            };
+            const uint8_t anchors3_second[64] = {
+                3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+                3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+                8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+                3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+            };
+            const uint8_t anchors3_third[64] = {
+                15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+                15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+                15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+                15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+            };
+
+            const uint16_t weights2[4] = { 0, 21, 43, 64 };
+            const uint16_t weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+            const uint16_t weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+            struct bc7_mode {
+                uint8_t subsets;
+                uint8_t partition_bits;
+                uint8_t rotation_bits;
+                uint8_t index_selection_bits;
+                uint8_t color_bits;
+                uint8_t alpha_bits;
+                uint8_t endpoint_p_bits; // one per endpoint
+                uint8_t shared_p_bits; // one per subset
+                uint8_t index_bits;
+                uint8_t secondary_index_bits; // separate alpha indices
+            };
+            const bc7_mode bc7_modes[8] = {
+                { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+                { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+                { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+                { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+                { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+                { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+                { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+                { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+            };
+
+            // Least significant bit first.
+            struct bit_reader {
+                explicit bit_reader(const uint8_t* block)
+                    : position(0)
+                {
+                    memcpy(&low, block, sizeof(low));
+                    memcpy(&high, block + 8, sizeof(high));
+                }
+
+                uint32_t read(uint32_t count)
+                {
+                    uint64_t value;
+                    if (position >= 64) {
+                        value = high >> (position - 64);
+                    }
+                    else if (position == 0) {
+                        value = low;
+                    }
+                    else {
+                        value = (low >> position) | (high << (64 - position));
+                    }
+                    position += count;
+                    return (static_cast<uint32_t>(value & ((uint64_t(1) << count) - 1)));
+                }
+
+                uint64_t low;
+                uint64_t high;
+                uint32_t position;
+            };
+
+            // Widens a quantized endpoint by replicating its top bits.
+            inline uint32_t unquantize(uint32_t value, uint32_t bits)
+            {
+                value <<= (8 - bits);
+                return (value | (value >> bits));
+            }
+
+            // RGBA8 palette between two endpoints, two entries per 16 bit multiply.
+            inline void interpolate(uint32_t e0, uint32_t e1, const uint16_t* weights, uint32_t count, uint32_t* palette)
+            {
+                __m128i low = _mm_cvtepu8_epi16(_mm_set1_epi32(static_cast<int>(e0)));
+                __m128i high = _mm_cvtepu8_epi16(_mm_set1_epi32(static_cast<int>(e1)));
+                for (uint32_t i = 0; i < count; i += 2) {
+                    __m128i w = _mm_unpacklo_epi64(_mm_set1_epi16(static_cast<int16_t>(weights[i])), _mm_set1_epi16(static_cast<int16_t>(weights[i + 1])));
+                    __m128i blend = _mm_add_epi16(
+                        _mm_add_epi16(_mm_mullo_epi16(low, _mm_sub_epi16(_mm_set1_epi16(64), w)), _mm_mullo_epi16(high, w)),
+                        _mm_set1_epi16(32));
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(palette + i), _mm_packus_epi16(_mm_srli_epi16(blend, 6), _mm_setzero_si128()));
+                }
+            }
+
+            inline void decode_bc7(const uint8_t* block, uint32_t texels[16])
+            {
+                // Reserved modes decode to transparent black.
+                if (block[0] == 0) {
+                    memset(texels, 0, 16 * sizeof(uint32_t));
+                    return;
+                }
+
+                uint32_t m = 0;
+                while (((block[0] >> m) & 1) == 0) {
+                    ++m;
+                }
+                const bc7_mode& mode(bc7_modes[m]);
+
+                bit_reader bits(block);
+                bits.read(m + 1);
+                uint32_t partition = bits.read(mode.partition_bits);
+                uint32_t rotation = bits.read(mode.rotation_bits);
+                uint32_t index_selection = bits.read(mode.index_selection_bits);
+
+                // Endpoints come channel by channel, then p-bits, then indices.
+                uint32_t endpoints[3][2][4] = {};
+                uint32_t endpoint_count = mode.subsets * 2;
+                for (uint32_t c = 0; c < 3; ++c) {
+                    for (uint32_t e = 0; e < endpoint_count; ++e) {
+                        endpoints[e / 2][e % 2][c] = bits.read(mode.color_bits);
+                    }
+                }
+                for (uint32_t e = 0; e < endpoint_count; ++e) {
+                    endpoints[e / 2][e % 2][3] = (mode.alpha_bits > 0) ? bits.read(mode.alpha_bits) : 255;
+                }
+
+                uint32_t color_bits = mode.color_bits;
+                uint32_t alpha_bits = mode.alpha_bits;
+                if (mode.endpoint_p_bits || mode.shared_p_bits) {
+                    uint32_t p_bits[6];
+                    if (mode.endpoint_p_bits) {
+                        for (uint32_t e = 0; e < endpoint_count; ++e) {
+                            p_bits[e] = bits.read(1);
+                        }
+                    }
+                    else {
+                        for (uint32_t s = 0; s < mode.subsets; ++s) {
+                            p_bits[s * 2] = p_bits[(s * 2) + 1] = bits.read(1);
+                        }
+                    }
+
+                    for (uint32_t e = 0; e < endpoint_count; ++e) {
+                        uint32_t* endpoint = endpoints[e / 2][e % 2];
+                        for (uint32_t c = 0; c < 3; ++c) {
+                            endpoint[c] = (endpoint[c] << 1) | p_bits[e];
+                        }
+                        if (mode.alpha_bits > 0) {
+                            endpoint[3] = (endpoint[3] << 1) | p_bits[e];
+                        }
+                    }
+                    ++color_bits;
+                    alpha_bits += (mode.alpha_bits > 0) ? 1 : 0;
+                }
+
+                uint32_t packed[3][2];
+                for (uint32_t e = 0; e < endpoint_count; ++e) {
+                    uint32_t* endpoint = endpoints[e / 2][e % 2];
+                    uint32_t alpha = (mode.alpha_bits > 0) ? unquantize(endpoint[3], alpha_bits) : 255;
+                    packed[e / 2][e % 2] =
+                        unquantize(endpoint[0], color_bits) |
+                        (unquantize(endpoint[1], color_bits) << 8) |
+                        (unquantize(endpoint[2], color_bits) << 16) |
+                        (alpha << 24);
+                }
+
+                uint8_t subset_of[16] = {};
+                uint32_t anchors[3] = { 0, 16, 16 };
+                if (mode.subsets == 2) {
+                    for (uint32_t i = 0; i < 16; ++i) {
+                        subset_of[i] = (partitions2[partition] >> i) & 1;
+                    }
+                    anchors[1] = anchors2[partition];
+                }
+                else if (mode.subsets == 3) {
+                    memcpy(subset_of, partitions3[partition], sizeof(subset_of));
+                    anchors[1] = anchors3_second[partition];
+                    anchors[2] = anchors3_third[partition];
+                }
+
+                uint8_t indices[16];
+                for (uint32_t i = 0; i < 16; ++i) {
+                    bool anchor = (i == anchors[0]) || (i == anchors[1]) || (i == anchors[2]);
+                    indices[i] = static_cast<uint8_t>(bits.read(mode.index_bits - (anchor ? 1 : 0)));
+                }
+                uint8_t secondary_indices[16] = {};
+                if (mode.secondary_index_bits > 0) {
+                    for (uint32_t i = 0; i < 16; ++i) {
+                        secondary_indices[i] = static_cast<uint8_t>(bits.read(mode.secondary_index_bits - ((i == 0) ? 1 : 0)));
+                    }
+                }
+
+                // Mode 4 can swap which index set drives color and which drives alpha.
+                const uint8_t* color_indices = indices;
+                const uint8_t* alpha_indices = indices;
+                uint32_t color_index_bits = mode.index_bits;
+                uint32_t alpha_index_bits = mode.index_bits;
+                if (mode.secondary_index_bits > 0) {
+                    alpha_indices = secondary_indices;
+                    alpha_index_bits = mode.secondary_index_bits;
+                    if (index_selection) {
+                        std::swap(color_indices, alpha_indices);
+                        std::swap(color_index_bits, alpha_index_bits);
+                    }
+                }
+
+                const uint16_t* weights_by_bits[5] = { nullptr, nullptr, weights2, weights3, weights4 };
+                alignas(16) uint32_t palettes[3][16];
+                for (uint32_t s = 0; s < mode.subsets; ++s) {
+                    interpolate(packed[s][0], packed[s][1], weights_by_bits[color_index_bits], 1u << color_index_bits, palettes[s]);
+                }
+                alignas(16) uint32_t alpha_palette[16];
+                if (mode.secondary_index_bits > 0) {
+                    interpolate(packed[0][0], packed[0][1], weights_by_bits[alpha_index_bits], 1u << alpha_index_bits, alpha_palette);
+                }
+
+                for (uint32_t i = 0; i < 16; ++i) {
+                    uint32_t texel = palettes[subset_of[i]][color_indices[i]];
+                    if (mode.secondary_index_bits > 0) {
+                        texel = (texel & 0x00ffffff) | (alpha_palette[alpha_indices[i]] & 0xff000000);
+                    }
+
+                    // Rotation swaps alpha with one of the color channels.
+                    if (rotation > 0) {
+                        uint32_t shift = (rotation - 1) * 8;
+                        uint32_t channel = (texel >> shift) & 0xff;
+                        uint32_t alpha = texel >> 24;
+                        texel = (texel & ~((0xffu << shift) | 0xff000000u)) | (alpha << shift) | (channel << 24);
+                    }
+                    texels[i] = texel;
+                }
+            }
+        }
+
+        // Decodes one 4x4 block to RGBA8 rows row_pitch bytes apart. Texels past width and height are
+        // dropped, for the edge blocks of images that are not a multiple of four.
+        inline void decode_block(format f, const uint8_t* block, uint8_t* rgba, size_t row_pitch, uint32_t width, uint32_t height)
+        {
+            alignas(16) __m128i rows[4];
+            switch (f) {
+            case format::bc1_rgb:
+            case format::bc1_rgba:
+                detail::decode_color(block, f == format::bc1_rgba, false, rows);
+                break;
+
+            case format::bc3: {
+                detail::decode_color(block + 8, false, true, rows);
+                __m128i alpha = detail::decode_channel(block);
+                const __m128i color_mask = _mm_set1_epi32(0x00ffffff);
+                for (int y = 0; y < 4; ++y) {
+                    // Row y's four alpha bytes into the top byte of each texel.
+                    __m128i shuffle = _mm_setr_epi8(
+                        -1, -1, -1, static_cast<char>((y * 4) + 0), -1, -1, -1, static_cast<char>((y * 4) + 1),
+                        -1, -1, -1, static_cast<char>((y * 4) + 2), -1, -1, -1, static_cast<char>((y * 4) + 3));
+                    rows[y] = _mm_or_si128(_mm_and_si128(rows[y], color_mask), _mm_shuffle_epi8(alpha, shuffle));
+                }
+                break;
+            }
+
+            case format::bc5: {
+                __m128i red = detail::decode_channel(block);
+                __m128i green = detail::decode_channel(block + 8);
+                const __m128i blue_alpha = _mm_set1_epi16(static_cast<int16_t>(0xff00));
+                __m128i low = _mm_unpacklo_epi8(red, green);
+                __m128i high = _mm_unpackhi_epi8(red, green);
+                rows[0] = _mm_unpacklo_epi16(low, blue_alpha);
+                rows[1] = _mm_unpackhi_epi16(low, blue_alpha);
+                rows[2] = _mm_unpacklo_epi16(high, blue_alpha);
+                rows[3] = _mm_unpackhi_epi16(high, blue_alpha);
+                break;
+            }
+
+            case format::bc7:
+                detail::decode_bc7(block, reinterpret_cast<uint32_t*>(rows));
+                break;
+            }
+
+            uint32_t row_count = std::min(height, 4u);
+            if (width >= 4) {
+                for (uint32_t y = 0; y < row_count; ++y) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + (y * row_pitch)), rows[y]);
+                }
+            }
+            else {
+                for (uint32_t y = 0; y < row_count; ++y) {
+                    memcpy(rgba + (y * row_pitch), &rows[y], width * 4);
+                }
+            }
+        }
+
+        // Decodes block rows [first_row, end_row) of a width x height image, blocks packed row by row,
+        // into tightly packed RGBA8.
+        inline void decode_rows(format f, const uint8_t* blocks, uint32_t width, uint32_t height, uint32_t first_row, uint32_t end_row, uint8_t* rgba)
+        {
+            uint32_t blocks_wide = (width + 3) / 4;
+            uint32_t size = block_size(f);
+            size_t row_pitch = static_cast<size_t>(width) * 4;
+            for (uint32_t by = first_row; by < end_row; ++by) {
+                const uint8_t* block = blocks + (static_cast<size_t>(by) * blocks_wide * size);
+                uint8_t* block_rgba = rgba + (static_cast<size_t>(by) * 4 * row_pitch);
+                uint32_t rows_left = height - (by * 4);
+                for (uint32_t bx = 0; bx < blocks_wide; ++bx) {
+                    decode_block(f, block, block_rgba + (bx * 16), row_pitch, std::min(width - (bx * 4), 4u), rows_left);
+                    block += size;
+                }
+            }
+        }
+
+        namespace detail {
+            // Nearest palette entry for every texel, by squared RGB or RGBA distance; palette_size is a
+            // multiple of four. Returns the summed error.
+            inline uint32_t nearest_indices(const uint32_t texels[16], const uint32_t* palette, uint32_t palette_size, bool alpha, uint8_t indices[16])
+            {
+                const __m128i mask = _mm_set1_epi32(alpha ? -1 : 0x00ffffff);
+                uint32_t total_error = 0;
+                for (uint32_t i = 0; i < 16; ++i) {
+                    __m128i texel = _mm_cvtepu8_epi16(_mm_and_si128(_mm_set1_epi32(static_cast<int>(texels[i])), mask));
+                    uint32_t best_error = std::numeric_limits<uint32_t>::max();
+                    for (uint32_t k = 0; k < palette_size; k += 4) {
+                        __m128i entries = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(palette + k)), mask);
+                        __m128i d01 = _mm_sub_epi16(texel, _mm_cvtepu8_epi16(entries));
+                        __m128i d23 = _mm_sub_epi16(texel, _mm_cvtepu8_epi16(_mm_srli_si128(entries, 8)));
+                        alignas(16) uint32_t errors[4];
+                        _mm_store_si128(reinterpret_cast<__m128i*>(errors), _mm_hadd_epi32(_mm_madd_epi16(d01, d01), _mm_madd_epi16(d23, d23)));
+                        for (uint32_t e = 0; e < 4; ++e) {
+                            if (errors[e] < best_error) {
+                                best_error = errors[e];
+                                indices[i] = static_cast<uint8_t>(k + e);
+                            }
+                        }
+                    }
+                    total_error += best_error;
+                }
+                return (total_error);
+            }
+
+            // Endpoints spanning the texels along their principal axis.
+            inline void principal_fit(const uint32_t texels[16], uint32_t channels, float low[4], float high[4])
+            {
+                float values[16][4];
+                float mean[4] = {};
+                for (uint32_t i = 0; i < 16; ++i) {
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        values[i][c] = static_cast<float>((texels[i] >> (c * 8)) & 0xff);
+                        mean[c] += values[i][c] / 16.0f;
+                    }
+                }
+
+                float covariance[4][4] = {};
+                for (uint32_t i = 0; i < 16; ++i) {
+                    for (uint32_t a = 0; a < channels; ++a) {
+                        for (uint32_t b = 0; b < channels; ++b) {
+                            covariance[a][b] += (values[i][a] - mean[a]) * (values[i][b] - mean[b]);
+                        }
+                    }
+                }
+
+                // Power iteration converges quickly enough for a 4x4 block. It starts from the covariance
+                // row of the channel that varies most; a fixed start such as all ones is orthogonal to axes
+                // like red against green and would collapse those blocks to their mean. If an iteration
+                // reaches zero, the previous axis is kept.
+                uint32_t seed = 0;
+                for (uint32_t c = 1; c < channels; ++c) {
+                    if (covariance[c][c] > covariance[seed][seed]) {
+                        seed = c;
+                    }
+                }
+
+                float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+                if (covariance[seed][seed] > 0.0f) {
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        axis[c] = covariance[seed][c];
+                    }
+                }
+                for (uint32_t iteration = 0; iteration < 8; ++iteration) {
+                    float next[4] = {};
+                    float largest = 0.0f;
+                    for (uint32_t a = 0; a < channels; ++a) {
+                        for (uint32_t b = 0; b < channels; ++b) {
+                            next[a] += covariance[a][b] * axis[b];
+                        }
+                        largest = std::max(largest, std::abs(next[a]));
+                    }
+                    if (largest <= 0.0f) {
+                        break;
+                    }
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        axis[c] = next[c] / largest;
+                    }
+                }
+
+                float length_squared = 0.0f;
+                for (uint32_t c = 0; c < channels; ++c) {
+                    length_squared += axis[c] * axis[c];
+                }
+                float t_min = 0.0f;
+                float t_max = 0.0f;
+                for (uint32_t i = 0; i < 16; ++i) {
+                    float t = 0.0f;
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        t += (values[i][c] - mean[c]) * axis[c];
+                    }
+                    t /= length_squared;
+                    t_min = std::min(t_min, t);
+                    t_max = std::max(t_max, t);
+                }
+
+                for (uint32_t c = 0; c < 4; ++c) {
+                    low[c] = (c < channels) ? (mean[c] + (axis[c] * t_min)) : 255.0f;
+                    high[c] = (c < channels) ? (mean[c] + (axis[c] * t_max)) : 255.0f;
+                }
+            }
+
+            // Endpoints minimizing the squared error of texel i = e0 * (1 - weights[i]) + e1 * weights[i].
+            // Returns false when every weight is the same.
+            inline bool least_squares_fit(const uint32_t texels[16], uint32_t channels, const float weights[16], float e0[4], float e1[4])
+            {
+                float aa = 0.0f;
+                float ab = 0.0f;
+                float bb = 0.0f;
+                float ax[4] = {};
+                float bx[4] = {};
+                for (uint32_t i = 0; i < 16; ++i) {
+                    float a = 1.0f - weights[i];
+                    float b = weights[i];
+                    aa += a * a;
+                    ab += a * b;
+                    bb += b * b;
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        float x = static_cast<float>((texels[i] >> (c * 8)) & 0xff);
+                        ax[c] += a * x;
+                        bx[c] += b * x;
+                    }
+                }
+
+                float determinant = (aa * bb) - (ab * ab);
+                if (std::abs(determinant) < 1e-6f) {
+                    return (false);
+                }
+
+                for (uint32_t c = 0; c < 4; ++c) {
+                    e0[c] = (c < channels) ? (((bb * ax[c]) - (ab * bx[c])) / determinant) : 255.0f;
+                    e1[c] = (c < channels) ? (((aa * bx[c]) - (ab * ax[c])) / determinant) : 255.0f;
+                }
+                return (true);
+            }
+
+            inline uint32_t quantize(float value, uint32_t max)
+            {
+                float scaled = (std::min(std::max(value, 0.0f), 255.0f) * static_cast<float>(max) / 255.0f) + 0.5f;
+                return (static_cast<uint32_t>(scaled));
+            }
+
+            inline uint32_t expand_565(uint32_t c)
+            {
+                uint32_t r = ((c >> 11) << 3) | (c >> 13);
+                uint32_t g = (((c >> 5) & 0x3f) << 2) | ((c >> 9) & 0x3);
+                uint32_t b = ((c & 0x1f) << 3) | ((c >> 2) & 0x7);
+                return (r | (g << 8) | (b << 16) | 0xff000000u);
+            }
+
+            struct bc1_block {
+                uint32_t c0;
+                uint32_t c1;
+                uint8_t indices[16];
+                uint32_t error;
+            };
+
+            // Quantizes two endpoints to a four color block, or a single color one when they meet.
+            inline void bc1_try(const uint32_t texels[16], const float e0[4], const float e1[4], bc1_block& result)
+            {
+                result.c0 = (quantize(e0[0], 31) << 11) | (quantize(e0[1], 63) << 5) | quantize(e0[2], 31);
+                result.c1 = (quantize(e1[0], 31) << 11) | (quantize(e1[1], 63) << 5) | quantize(e1[2], 31);
+                if (result.c0 < result.c1) {
+                    std::swap(result.c0, result.c1);
+                }
+
+                // Matches decode_color; equal endpoints decode as three colors, but only index 0 is used.
+                uint32_t p0 = expand_565(result.c0);
+                uint32_t p1 = expand_565(result.c1);
+                alignas(16) uint32_t palette[4] = { p0, p1, 0xff000000u, 0xff000000u };
+                for (uint32_t c = 0; c < 24; c += 8) {
+                    uint32_t a = (p0 >> c) & 0xff;
+                    uint32_t b = (p1 >> c) & 0xff;
+                    palette[2] |= ((((2 * a) + b + 1) / 3) << c);
+                    palette[3] |= (((a + (2 * b) + 1) / 3) << c);
+                }
+                if (result.c0 == result.c1) {
+                    palette[1] = palette[2] = palette[3] = p0;
+                }
+
+                result.error = nearest_indices(texels, palette, 4, false, result.indices);
+            }
+
+            inline void encode_bc1(const uint32_t texels[16], uint8_t* block)
+            {
+                float low[4];
+                float high[4];
+                principal_fit(texels, 3, low, high);
+
+                bc1_block best;
+                bc1_try(texels, high, low, best);
+
+                // One refinement against the chosen indices.
+                const float index_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+                float weights[16];
+                for (uint32_t i = 0; i < 16; ++i) {
+                    weights[i] = index_weights[best.indices[i]];
+                }
+                float e0[4];
+                float e1[4];
+                if ((best.c0 != best.c1) && least_squares_fit(texels, 3, weights, e0, e1)) {
+                    bc1_block refined;
+                    bc1_try(texels, e0, e1, refined);
+                    if (refined.error < best.error) {
+                        best = refined;
+                    }
+                }
+
+                block[0] = static_cast<uint8_t>(best.c0);
+                block[1] = static_cast<uint8_t>(best.c0 >> 8);
+                block[2] = static_cast<uint8_t>(best.c1);
+                block[3] = static_cast<uint8_t>(best.c1 >> 8);
+                for (uint32_t y = 0; y < 4; ++y) {
+                    const uint8_t* row = best.indices + (y * 4);
+                    block[4 + y] = static_cast<uint8_t>(row[0] | (row[1] << 2) | (row[2] << 4) | (row[3] << 6));
+                }
+            }
+
+            // Least significant bit first.
+            struct bit_writer {
+                explicit bit_writer(uint8_t* block)
+                    : bytes(block)
+                    , position(0)
+                {
+                    memset(bytes, 0, 16);
+                }
+
+                void write(uint32_t value, uint32_t count)
+                {
+                    for (uint32_t i = 0; i < count; ++i, ++position) {
+                        bytes[position / 8] |= static_cast<uint8_t>(((value >> i) & 1) << (position % 8));
+                    }
+                }
+
+                uint8_t* bytes;
+                uint32_t position;
+            };
+
+            struct bc7_mode6_block {
+                uint32_t endpoints[2]; // RGBA8 with the p-bit as every channel's lowest bit
+                uint8_t indices[16];
+                uint32_t error;
+            };
+
+            // Quantizes two endpoints to 7 bits per channel plus the p-bit that fits each best.
+            inline void bc7_mode6_try(const uint32_t texels[16], const float e0[4], const float e1[4], bc7_mode6_block& result)
+            {
+                const float* endpoints[2] = { e0, e1 };
+                for (uint32_t e = 0; e < 2; ++e) {
+                    uint32_t best_error = std::numeric_limits<uint32_t>::max();
+                    for (uint32_t p = 0; p < 2; ++p) {
+                        uint32_t packed = 0;
+                        uint32_t error = 0;
+                        for (uint32_t c = 0; c < 4; ++c) {
+                            float value = std::min(std::max(endpoints[e][c], 0.0f), 255.0f);
+                            uint32_t q = std::min(static_cast<uint32_t>(std::max((value - static_cast<float>(p)) * 0.5f + 0.5f, 0.0f)), 127u);
+                            uint32_t widened = (q << 1) | p;
+                            int32_t difference = static_cast<int32_t>(widened) - static_cast<int32_t>(value + 0.5f);
+                            error += static_cast<uint32_t>(difference * difference);
+                            packed |= widened << (c * 8);
+                        }
+                        if (error < best_error) {
+                            best_error = error;
+                            result.endpoints[e] = packed;
+                        }
+                    }
+                }
+
+                alignas(16) uint32_t palette[16];
+                interpolate(result.endpoints[0], result.endpoints[1], weights4, 16, palette);
+                result.error = nearest_indices(texels, palette, 16, true, result.indices);
+            }
+
+            // Mode 6 only: one subset, RGBA endpoints and 4 bit indices. It suits most smooth content
+            // and keeps the encoder to one fit per block.
+            inline void encode_bc7(const uint32_t texels[16], uint8_t* block)
+            {
+                float low[4];
+                float high[4];
+                principal_fit(texels, 4, low, high);
+
+                bc7_mode6_block best;
+                bc7_mode6_try(texels, low, high, best);
+
+                float weights[16];
+                for (uint32_t i = 0; i < 16; ++i) {
+                    weights[i] = static_cast<float>(weights4[best.indices[i]]) / 64.0f;
+                }
+                float e0[4];
+                float e1[4];
+                if (least_squares_fit(texels, 4, weights, e0, e1)) {
+                    bc7_mode6_block refined;
+                    bc7_mode6_try(texels, e0, e1, refined);
+                    if (refined.error < best.error) {
+                        best = refined;
+                    }
+                }
+
+                // Texel 0's index drops its top bit; swapping the endpoints mirrors the weights.
+                if (best.indices[0] >= 8) {
+                    std::swap(best.endpoints[0], best.endpoints[1]);
+                    for (uint32_t i = 0; i < 16; ++i) {
+                        best.indices[i] = static_cast<uint8_t>(15 - best.indices[i]);
+                    }
+                }
+
+                bit_writer bits(block);
+                bits.write(1 << 6, 7);
+                for (uint32_t c = 0; c < 4; ++c) {
+                    bits.write((best.endpoints[0] >> ((c * 8) + 1)) & 0x7f, 7);
+                    bits.write((best.endpoints[1] >> ((c * 8) + 1)) & 0x7f, 7);
+                }
+                bits.write(best.endpoints[0] & 1, 1);
+                bits.write(best.endpoints[1] & 1, 1);
+                for (uint32_t i = 0; i < 16; ++i) {
+                    bits.write(best.indices[i], (i == 0) ? 3 : 4);
+                }
+            }
+        }
+
+        // Encodes block rows [first_row, end_row) of a tightly packed RGBA8 width x height image to
+        // BC1 (opaque, alpha ignored) or BC7 blocks, packed row by row. Edge blocks repeat the last
+        // row and column.
+        inline void encode_rows(format f, const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t first_row, uint32_t end_row, uint8_t* blocks)
+        {
+            uint32_t blocks_wide = (width + 3) / 4;
+            uint32_t size = block_size(f);
+            for (uint32_t by = first_row; by < end_row; ++by) {
+                uint8_t* block = blocks + (static_cast<size_t>(by) * blocks_wide * size);
+                for (uint32_t bx = 0; bx < blocks_wide; ++bx) {
+                    uint32_t texels[16];
+                    for (uint32_t y = 0; y < 4; ++y) {
+                        uint32_t texel_y = std::min((by * 4) + y, height - 1);
+                        for (uint32_t x = 0; x < 4; ++x) {
+                            uint32_t texel_x = std::min((bx * 4) + x, width - 1);
+                            memcpy(&texels[(y * 4) + x], rgba + ((static_cast<size_t>(texel_y) * width) + texel_x) * 4, 4);
+                        }
+                    }
+
+                    if (f == format::bc7) {
+                        detail::encode_bc7(texels, block);
+                    }
+                    else {
+                        detail::encode_bc1(texels, block);
+                    }
+                    block += size;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#version 450 core
+#extension GL_ARB_separate_shader_objects : require
+
+layout(location = 0) in vec3 vertex_position; // model space, or quantized to the mesh bounds
+
+// The depth pre-pass and the color pass must produce bit identical depth.
+invariant gl_Position;
+
+layout(set = 0, binding = 0) uniform vert_shader_block {
+    mat4 world_to_clip_transform; // projection transform * view transform
+};
+
+struct draw_data {
+    mat4 model_transform;
+    vec4 position_scale; // dequantization; identity for full vertices
+    vec4 position_bias;
+};
+
+layout(set = 2, binding = 0) readonly buffer draw_data_block {
+    draw_data draws[]; // indexed by instance; each draw is submitted with firstInstance = draw index
+};
+
+void main()
+{
+    draw_data d = draws[gl_InstanceIndex];
+    vec3 model_position = (vertex_position * d.position_scale.xyz) + d.position_bias.xyz;
+
+    gl_Position = world_to_clip_transform * (d.model_transform * vec4(model_position, 1.0f));
+}
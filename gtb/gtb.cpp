@@ -34,13 +34,28 @@
 #include <cstdlib>
 #include <cmath>
 #include <cfenv>
+#include <cstring>
+#include <ctime>
 #include <exception>
 #include <algorithm>
+#include <numeric>
 #include <string>
 #include <vector>
+#include <deque>
+#include <memory>
 #include <unordered_map>
+#include <map>
+#include <set>
+#include <tuple>
 #include <fstream>
+#include <sstream>
 #include <limits>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // Boost
 #include <boost/exception/all.hpp>
@@ -70,12 +85,21 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/type_precision.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
 // GLI
 #include <gli/gli.hpp>
 
+// stb_image, for PNG and JPEG images in glTF files.
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#include <stb_image.h>
+
 #if defined(_MSC_VER)
 #pragma warning (pop)
 #endif
@@ -89,6 +113,12 @@
 // Local helper classes
 #include "gtb/glfw_dispatch_loader.hpp"
 #include "gtb/dbg_out.hpp"
+#include "gtb/simplify.hpp"
+#include "gtb/transforms.hpp"
+#include "gtb/animation.hpp"
+#include "gtb/thread_pool.hpp"
+#include "gtb/bcn.hpp"
+#include "gtb/virtual_texture.hpp"
 
 /*
 ~~ Math Conventions ~~
@@ -125,6 +155,16 @@ namespace gtb {
         return ((value + align - 1) & ~(align - 1));
     }
 
+    template<typename T>
+    int32_t append_stream(std::vector<uint8_t>& stream, const std::vector<T>& data)
+    {
+        // Streams only ever hold a single element type, so the element offset is exact.
+        int32_t offset = static_cast<int32_t>(stream.size() / sizeof(T));
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+        stream.insert(stream.end(), bytes, bytes + (data.size() * sizeof(T)));
+        return (offset);
+    }
+
     void open_log_stream(std::ofstream& log_stream, const std::string& file_name)
     {
         boost::filesystem::path log_file_path(std::getenv("LOCALAPPDATA"));
@@ -135,6 +175,24 @@ namespace gtb {
         log_stream.open(log_file_path.string(), std::ios_base::out | std::ios_base::trunc);
     }
 
+    // Bumped when encoded textures change, so older cache files are no longer found.
+    constexpr uint32_t texture_cache_version = 2;
+
+    // Where the encoded copy of a texture file is kept; a new modification time gets a new file.
+    boost::filesystem::path texture_cache_file(const std::string& file_name, std::time_t write_time)
+    {
+        std::string key(boost::filesystem::absolute(file_name).string() + "|" + std::to_string(write_time) + "|" +
+            std::to_string(texture_cache_version));
+        std::ostringstream cache_name;
+        cache_name << std::hex << std::hash<std::string>()(key) << ".dds";
+
+        boost::filesystem::path cache_file_path(std::getenv("LOCALAPPDATA"));
+        cache_file_path /= "gtb";
+        cache_file_path /= "texture_cache";
+        cache_file_path /= cache_name.str();
+        return (cache_file_path);
+    }
+
     namespace error {
         // Base class for gtb internal error handling.
         class exception : public virtual std::exception, public virtual boost::exception {};
@@ -238,87 +296,546 @@ namespace gtb {
         }
     }
 
-    union value_2_10_10_10_snorm {
-        struct {
-            uint32_t a : 2;
-            uint32_t b : 10;
-            uint32_t g : 10;
-            uint32_t r : 10;
-        } fields;
-        uint32_t value;
-
-        value_2_10_10_10_snorm() = default;
+    // Orthonormal tangent frames are stored as a quaternion (QTangent.) The quaternion is kept with w
+    // positive unless the bitangent is reflected, and w is biased away from zero so that the sign still
+    // survives snorm quantization.
+    glm::vec4 qtangent_bias(glm::vec4 q, float w_bias)
+    {
+        float reflection = (q.w < 0.0f) ? -1.0f : 1.0f;
+        q *= reflection;
 
-        value_2_10_10_10_snorm(float fr, float fg, float fb)
-        {
-            fields.a = 0;
-            fields.b = convert_float(fb);
-            fields.g = convert_float(fg);
-            fields.r = convert_float(fr);
+        if (q.w < w_bias) {
+            float xyz_length = glm::length(glm::vec3(q));
+            float xyz_scale = (xyz_length > 0.0f) ? (std::sqrt(1.0f - (w_bias * w_bias)) / xyz_length) : 0.0f;
+            q = glm::vec4(glm::vec3(q) * xyz_scale, w_bias);
         }
 
-        explicit value_2_10_10_10_snorm(uint32_t v)
-            : value(v)
-        {}
+        return (q * reflection);
+    }
 
-        explicit value_2_10_10_10_snorm(const glm::vec3& vector)
-        {
-            fields.a = 0;
-            fields.b = convert_float(vector.z);
-            fields.g = convert_float(vector.y);
-            fields.r = convert_float(vector.x);
+    glm::vec4 qtangent_encode(const glm::vec3& normal, const glm::vec4& tangent, float w_bias)
+    {
+        // Build an orthonormal basis from the normal and the tangent (Gram-Schmidt.)
+        glm::vec3 n(glm::normalize(normal));
+        glm::vec3 t(glm::vec3(tangent) - (n * glm::dot(n, glm::vec3(tangent))));
+        if (glm::dot(t, t) < 1e-12f) {
+            // Tangent is missing or parallel to the normal; any perpendicular vector will do.
+            t = (std::abs(n.x) < 0.9f) ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+        t = glm::normalize(t);
+
+        // glTF defines bitangent = cross(normal, tangent.xyz) * tangent.w; the rotation uses the
+        // right handed bitangent and the handedness is carried separately.
+        glm::quat q(glm::quat_cast(glm::mat3(t, glm::cross(n, t), n)));
+        glm::vec4 v(q.x, q.y, q.z, q.w);
+        if (v.w < 0.0f) {
+            v = -v;
         }
 
-        value_2_10_10_10_snorm& operator =(uint32_t v)
-        {
-            value = v;
-            return (*this);
+        v = qtangent_bias(v, w_bias);
+        return ((tangent.w < 0.0f) ? -v : v);
+    }
+
+    // Inverse of qtangent_encode; the tangent's w is the bitangent sign as in glTF.
+    void qtangent_decode(const glm::vec4& q, glm::vec3& normal, glm::vec4& tangent)
+    {
+        glm::mat3 frame(glm::mat3_cast(glm::normalize(glm::quat(q.w, q.x, q.y, q.z))));
+        normal = frame[2];
+        tangent = glm::vec4(frame[0], (q.w < 0.0f) ? -1.0f : 1.0f);
+    }
+
+    constexpr float qtangent_snorm16_bias = 1.0f / 32767.0f;
+    constexpr float qtangent_snorm8_bias = 1.0f / 127.0f;
+
+    enum class vertex_format : uint8_t {
+        full,
+        compact
+    };
+    constexpr size_t vertex_format_count = 2;
+
+    // 28 bytes
+    struct vertex {
+        glm::vec3 position;
+        glm::i16vec4 tangent_frame; // snorm16 qtangent
+        glm::vec2 tex_coord;
+    };
+
+    // 16 bytes; used when a mesh is small enough to quantize without visible error.
+    struct compact_vertex {
+        glm::u16vec4 position; // unorm, relative to the mesh bounds; w unused
+        uint32_t tangent_frame; // snorm8 qtangent
+        glm::u16vec2 tex_coord; // half float
+    };
+
+    // Split vertex streams keep positions alone in binding 0 so depth-only passes fetch nothing else.
+    struct vertex_attributes {
+        glm::i16vec4 tangent_frame; // snorm16 qtangent
+        glm::vec2 tex_coord;
+    };
+
+    struct compact_vertex_attributes {
+        uint32_t tangent_frame; // snorm8 qtangent
+        glm::u16vec2 tex_coord; // half float
+    };
+
+    // Largest rounding error in model space units allowed when quantizing compact vertex positions.
+    constexpr float compact_vertex_position_tolerance = 0.0005f;
+
+    // Half float texture coordinates keep at least 10 bits of fraction inside (-2, 2).
+    constexpr float compact_vertex_tex_coord_range = 2.0f;
+
+    // Static batches are split on a grid of this many cells per axis over the scene bounds, and never
+    // grow past what 16 bit indices can address.
+    constexpr uint32_t static_batch_grid_cells = 8;
+    constexpr size_t static_batch_max_vertices = 65536;
+
+    // Clusters are small enough that a partly visible mesh only draws the parts in view.
+    constexpr uint32_t cluster_max_triangles = 124;
+    constexpr uint32_t cluster_max_vertices = 64;
+
+    // Clusters whose triangle normals spread further than this from the cone axis are never backface culled.
+    constexpr float cluster_cone_min_dot = 0.1f;
+
+    // Each level of detail halves the triangles of the one before it, until the mesh is small or stops
+    // simplifying. A draw uses the coarsest level whose error stays under a pixel on screen.
+    constexpr uint32_t lod_max_levels = 6; // including full detail
+    constexpr uint32_t lod_min_triangles = 32;
+    constexpr float lod_max_screen_error = 1.0f;
+
+    // Streamed textures always keep the levels this size and smaller, so every texture can be drawn.
+    // Textures no draw needed for this many frames give up their finer levels first.
+    constexpr uint32_t texture_tail_size = 128;
+    constexpr uint64_t texture_cold_frames = 300;
+
+    // Textures no larger than the tail are never streamed, so with texture arrays those of one format
+    // and size share an array image.
+    inline bool texture_packable(uint32_t width, uint32_t height)
+    {
+        return (std::max(width, height) <= texture_tail_size);
+    }
+
+    // Textures larger than the tail are paged when virtual textures are on, as long as their page
+    // coordinates fit the feedback words.
+    inline bool texture_pageable(uint32_t width, uint32_t height)
+    {
+        return ((std::max(width, height) > texture_tail_size) && (std::max(width, height) <= (vt::max_pages_per_side * vt::page_size)));
+    }
+
+    // Block rows per job when decoding or encoding block compressed textures on the CPU.
+    constexpr uint32_t bcn_decode_band_rows = 16;
+    constexpr uint32_t bcn_encode_band_rows = 4;
+
+    // Virtual texture pages read from tile files and uploaded to the atlas. Reads queue coarsest level
+    // first, a limited number per frame and in flight, so a sudden view change never floods the pool.
+    constexpr uint32_t virtual_page_reads_per_frame = 32;
+    constexpr uint32_t virtual_page_reads_in_flight = 64;
+    constexpr uint32_t virtual_page_uploads_per_frame = 16;
+    constexpr uint32_t virtual_page_table_initial_entries = 64 * 1024;
+
+    // One pixel of every cell this size reports the virtual texture page it wanted, a different one
+    // each frame.
+    constexpr uint32_t feedback_cell_size = 8;
+
+    // Uniform buffer contents written once per frame (std140.)
+    struct per_frame_uniforms {
+        glm::mat4 world_to_clip_transform; // projection transform * view transform
+        glm::vec4 camera_position; // world space; w unused
+        glm::vec4 frustum_planes[6]; // world space; inside when dot(plane.xyz, p) + plane.w >= 0
+        glm::uvec4 feedback_cell; // xy = pixel of each cell reporting this frame; z = cells per row
+    };
+
+    // Storage buffer contents written per draw at load, and again when its transform changes (std430.)
+    struct draw_data {
+        glm::mat4 model_transform;
+        glm::vec4 position_scale; // model space position = (vertex position * scale) + bias; w = virtual texture id + 1
+        glm::vec4 position_bias; // w = texture array layer
+    };
+
+    // Storage buffer contents per virtual texture id, followed by every texture's page table entries,
+    // rewritten where they changed when a frame is recorded (std430.)
+    struct virtual_texture_info {
+        uint32_t page_table_offset; // in entries
+        uint32_t width; // of level 0
+        uint32_t height;
+        uint32_t levels; // bit 8 set for sRGB texels
+    };
+
+    // Storage buffer contents written once per cluster at load (std430.)
+    struct cluster_data {
+        glm::vec4 bounds; // model space sphere; xyz = center, w = radius
+        glm::vec4 cone; // model space; xyz = axis, w = cutoff (1 = never backfacing)
+        uint32_t first_index;
+        uint32_t index_count;
+        uint32_t draw_index;
+        uint32_t lod; // level of detail the cluster belongs to
+    };
+
+    // Storage buffer contents written once per skinned vertex at load (std430.)
+    struct skin_vertex {
+        glm::vec4 position; // bind pose; w unused
+        glm::vec4 tangent_frame; // qtangent
+        glm::vec4 weights;
+        glm::uvec4 joints; // into the skin's joints
+        glm::vec2 tex_coord;
+        glm::vec2 unused;
+    };
+
+    // Push constants of one skinning dispatch; one per skinned draw.
+    struct skin_job {
+        uint32_t first_input_vertex;
+        uint32_t first_output_vertex;
+        uint32_t vertex_count;
+        uint32_t first_joint; // of the draw's skin in the joint matrices
+        uint32_t split; // positions and attributes go to separate streams
+    };
+
+    // Splits an indexed triangle list into clusters that can be culled on their own. Triangles are taken
+    // in index order, which exporters already keep spatially coherent. Each cluster's first index is
+    // relative to the start of indices.
+    void build_clusters(const std::vector<vertex>& vertices, const std::vector<uint32_t>& indices, std::vector<cluster_data>& clusters)
+    {
+        std::vector<glm::vec3> normals(vertices.size());
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            glm::vec4 tangent;
+            qtangent_decode(glm::vec4(vertices[v].tangent_frame) / 32767.0f, normals[v], tangent);
         }
 
-        value_2_10_10_10_snorm& operator =(const glm::vec3& vector)
-        {
-            fields.a = 0;
-            fields.b = convert_float(vector.z);
-            fields.g = convert_float(vector.y);
-            fields.r = convert_float(vector.x);
-            return (*this);
+        std::vector<uint32_t> vertex_cluster(vertices.size(), std::numeric_limits<uint32_t>::max());
+        std::vector<glm::vec3> face_normals;
+
+        size_t triangle_count = indices.size() / 3;
+        size_t first_triangle = 0;
+        while (first_triangle < triangle_count) {
+            // Grow the cluster until it runs out of triangles or vertices.
+            uint32_t cluster_id = static_cast<uint32_t>(clusters.size());
+            uint32_t cluster_vertices = 0;
+            size_t end_triangle = first_triangle;
+            while ((end_triangle < triangle_count) && ((end_triangle - first_triangle) < cluster_max_triangles)) {
+                const uint32_t* triangle = &indices[end_triangle * 3];
+
+                uint32_t new_vertices = 0;
+                for (size_t k = 0; k < 3; ++k) {
+                    new_vertices += (vertex_cluster[triangle[k]] != cluster_id) ? 1 : 0;
+                }
+                if ((cluster_vertices + new_vertices) > cluster_max_vertices) {
+                    break;
+                }
+
+                for (size_t k = 0; k < 3; ++k) {
+                    vertex_cluster[triangle[k]] = cluster_id;
+                }
+                cluster_vertices += new_vertices;
+                ++end_triangle;
+            }
+
+            // Bounding sphere around the center of the cluster's bounding box.
+            glm::vec3 position_min(std::numeric_limits<float>::max());
+            glm::vec3 position_max(-std::numeric_limits<float>::max());
+            for (size_t i = first_triangle * 3; i < end_triangle * 3; ++i) {
+                position_min = glm::min(position_min, vertices[indices[i]].position);
+                position_max = glm::max(position_max, vertices[indices[i]].position);
+            }
+
+            glm::vec3 center((position_min + position_max) * 0.5f);
+            float radius = 0.0f;
+            for (size_t i = first_triangle * 3; i < end_triangle * 3; ++i) {
+                radius = std::max(radius, glm::length(vertices[indices[i]].position - center));
+            }
+
+            // Normal cone from the face normals. Faces are oriented by their shading normals so the cone
+            // does not depend on the winding convention.
+            face_normals.clear();
+            glm::vec3 normal_sum(0.0f);
+            for (size_t t = first_triangle; t < end_triangle; ++t) {
+                const uint32_t* triangle = &indices[t * 3];
+                const glm::vec3& a(vertices[triangle[0]].position);
+                const glm::vec3& b(vertices[triangle[1]].position);
+                const glm::vec3& c(vertices[triangle[2]].position);
+
+                glm::vec3 face_normal(glm::cross(b - a, c - a));
+                float face_normal_length = glm::length(face_normal);
+                if (face_normal_length <= 0.0f) {
+                    continue; // Degenerate triangles are never rasterized.
+                }
+                face_normal /= face_normal_length;
+
+                if (glm::dot(face_normal, normals[triangle[0]] + normals[triangle[1]] + normals[triangle[2]]) < 0.0f) {
+                    face_normal = -face_normal;
+                }
+
+                face_normals.push_back(face_normal);
+                normal_sum += face_normal;
+            }
+
+            float axis_length = glm::length(normal_sum);
+            glm::vec3 axis((axis_length > 0.0f) ? (normal_sum / axis_length) : glm::vec3(0.0f, 0.0f, 1.0f));
+
+            float min_dot = 1.0f;
+            for (const glm::vec3& face_normal : face_normals) {
+                min_dot = std::min(min_dot, glm::dot(face_normal, axis));
+            }
+
+            float cutoff = 1.0f;
+            if (!face_normals.empty() && (axis_length > 0.0f) && (min_dot > cluster_cone_min_dot)) {
+                cutoff = std::sqrt(1.0f - (min_dot * min_dot));
+            }
+
+            cluster_data cluster;
+            cluster.bounds = glm::vec4(center, radius);
+            cluster.cone = glm::vec4(axis, cutoff);
+            cluster.first_index = static_cast<uint32_t>(first_triangle * 3);
+            cluster.index_count = static_cast<uint32_t>((end_triangle - first_triangle) * 3);
+            cluster.draw_index = 0;
+            cluster.lod = 0;
+            clusters.push_back(cluster);
+
+            first_triangle = end_triangle;
         }
+    }
 
-    private:
-        static uint32_t convert_float(float v)
-        {
-            if (v >= 1.0f) {
-                return (0x1FF);
+    // Merges vertices that are bit identical, or that have identical attributes and positions in the same
+    // tolerance sized cell when tolerance is not zero. Cells are not compared with their neighbors, so a
+    // tolerance welds most close pairs rather than all of them. Triangles left degenerate are removed.
+    // Returns the number of vertices removed.
+    size_t weld_vertices(std::vector<vertex>& vertices, std::vector<uint32_t>& indices, float tolerance)
+    {
+        struct weld_key {
+            uint32_t words[7]; // position or cell, tangent frame, texture coordinate
+
+            bool operator==(const weld_key& other) const
+            {
+                return (std::memcmp(words, other.words, sizeof(words)) == 0);
+            }
+        };
+
+        struct weld_key_hash {
+            size_t operator()(const weld_key& key) const
+            {
+                // FNV-1a
+                uint32_t hash = 2166136261u;
+                for (uint32_t word : key.words) {
+                    hash = (hash ^ word) * 16777619u;
+                }
+                return (hash);
             }
-            else if (v <= -1.0f) {
-                return (0x3FF);
+        };
+
+        static_assert(sizeof(vertex) == sizeof(weld_key), "weld_key must cover every vertex attribute");
+
+        std::unordered_map<weld_key, uint32_t, weld_key_hash> unique_vertices;
+        unique_vertices.reserve(vertices.size());
+
+        std::vector<uint32_t> remap(vertices.size());
+        std::vector<vertex> welded;
+        welded.reserve(vertices.size());
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            const vertex& vert(vertices[v]);
+
+            weld_key key;
+            if (tolerance > 0.0f) {
+                glm::ivec3 cell(glm::floor(vert.position / tolerance));
+                std::memcpy(&key.words[0], &cell, sizeof(cell));
             }
             else {
-                v *= 511.0f; // 511 = (2 ^ (10 - 1)) - 1
-                if (v >= 0.0f) {
-                    v += 0.5f;
+                std::memcpy(&key.words[0], &vert.position, sizeof(vert.position));
+            }
+            std::memcpy(&key.words[3], &vert.tangent_frame, sizeof(vert.tangent_frame));
+            std::memcpy(&key.words[5], &vert.tex_coord, sizeof(vert.tex_coord));
+
+            // The first vertex of each key survives, which keeps the original vertex order.
+            std::pair<std::unordered_map<weld_key, uint32_t, weld_key_hash>::iterator, bool> inserted(
+                unique_vertices.emplace(key, static_cast<uint32_t>(welded.size())));
+            if (inserted.second) {
+                welded.push_back(vert);
+            }
+            remap[v] = inserted.first->second;
+        }
+
+        size_t kept_indices = 0;
+        for (size_t i = 0; (i + 2) < indices.size(); i += 3) {
+            uint32_t a = remap[indices[i]];
+            uint32_t b = remap[indices[i + 1]];
+            uint32_t c = remap[indices[i + 2]];
+            if ((a != b) && (b != c) && (a != c)) {
+                indices[kept_indices++] = a;
+                indices[kept_indices++] = b;
+                indices[kept_indices++] = c;
+            }
+        }
+        indices.resize(kept_indices);
+
+        size_t removed = vertices.size() - welded.size();
+        vertices.swap(welded);
+        return (removed);
+    }
+
+    // Block compressed formats the CPU decoder handles, and the format they decode to.
+    bool bcn_decoder_format(gli::format format, bcn::format& decoder, gli::format& decoded)
+    {
+        switch (format) {
+        case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8:
+            decoder = bcn::format::bc1_rgb;
+            decoded = gli::FORMAT_RGBA8_UNORM_PACK8;
+            return (true);
+        case gli::FORMAT_RGB_DXT1_SRGB_BLOCK8:
+            decoder = bcn::format::bc1_rgb;
+            decoded = gli::FORMAT_RGBA8_SRGB_PACK8;
+            return (true);
+        case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+            decoder = bcn::format::bc1_rgba;
+            decoded = gli::FORMAT_RGBA8_UNORM_PACK8;
+            return (true);
+        case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+            decoder = bcn::format::bc1_rgba;
+            decoded = gli::FORMAT_RGBA8_SRGB_PACK8;
+            return (true);
+        case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+            decoder = bcn::format::bc3;
+            decoded = gli::FORMAT_RGBA8_UNORM_PACK8;
+            return (true);
+        case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+            decoder = bcn::format::bc3;
+            decoded = gli::FORMAT_RGBA8_SRGB_PACK8;
+            return (true);
+        case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+            decoder = bcn::format::bc5;
+            decoded = gli::FORMAT_RGBA8_UNORM_PACK8;
+            return (true);
+        case gli::FORMAT_RGBA_BP_UNORM_BLOCK16:
+            decoder = bcn::format::bc7;
+            decoded = gli::FORMAT_RGBA8_UNORM_PACK8;
+            return (true);
+        case gli::FORMAT_RGBA_BP_SRGB_BLOCK16:
+            decoder = bcn::format::bc7;
+            decoded = gli::FORMAT_RGBA8_SRGB_PACK8;
+            return (true);
+        default:
+            return (false);
+        }
+    }
+
+    // Uncompressed formats the CPU encoders and tile builder read, and how their texels are laid out.
+    bool rgba8_source_format(gli::format format, uint32_t& texel_size, bool& bgra, bool& srgb)
+    {
+        texel_size = 4;
+        bgra = false;
+        srgb = false;
+        switch (format) {
+        case gli::FORMAT_RGBA8_UNORM_PACK8:
+            return (true);
+        case gli::FORMAT_RGBA8_SRGB_PACK8:
+            srgb = true;
+            return (true);
+        case gli::FORMAT_BGRA8_UNORM_PACK8:
+            bgra = true;
+            return (true);
+        case gli::FORMAT_BGRA8_SRGB_PACK8:
+            bgra = srgb = true;
+            return (true);
+        case gli::FORMAT_RGB8_UNORM_PACK8:
+            texel_size = 3;
+            return (true);
+        case gli::FORMAT_RGB8_SRGB_PACK8:
+            texel_size = 3;
+            srgb = true;
+            return (true);
+        default:
+            return (false);
+        }
+    }
+
+    // Linear values of the 256 sRGB encoded values.
+    const float* srgb_to_linear()
+    {
+        struct table {
+            table()
+            {
+                for (uint32_t v = 0; v < 256; ++v) {
+                    float encoded = static_cast<float>(v) / 255.0f;
+                    values[v] = (encoded <= 0.04045f) ? (encoded / 12.92f) : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
                 }
-                else {
-                    v -= 0.5f;
+            }
+
+            float values[256];
+        };
+        static const table t;
+        return (t.values);
+    }
+
+    uint8_t linear_to_srgb(float linear)
+    {
+        float encoded = (linear <= 0.0031308f) ? (linear * 12.92f) : ((1.055f * std::pow(linear, 1.0f / 2.4f)) - 0.055f);
+        return (static_cast<uint8_t>((std::min(std::max(encoded, 0.0f), 1.0f) * 255.0f) + 0.5f));
+    }
+
+    // RGBA8 copies of the first level_count levels of a 2D texture. Levels the file does not have are
+    // box filtered from the one above; sRGB color is averaged in linear space, and the last row and
+    // column of odd sized levels fold into the last texel. Returns whether every texel is opaque.
+    bool rgba8_levels(const gli::texture& gli_texture, uint32_t texel_size, bool bgra, bool srgb, uint32_t level_count, std::vector<std::vector<uint8_t>>& levels)
+    {
+        gli::extent3d extent(gli_texture.extent());
+        uint32_t stored_levels = std::min(static_cast<uint32_t>(gli_texture.levels()), level_count);
+
+        levels.resize(level_count);
+        bool opaque = true;
+        for (uint32_t level = 0; level < stored_levels; ++level) {
+            gli::extent3d level_extent(gli_texture.extent(level));
+            size_t texel_count = static_cast<size_t>(level_extent.x) * level_extent.y;
+            const uint8_t* source = static_cast<const uint8_t*>(gli_texture.data(0, 0, level));
+            std::vector<uint8_t>& rgba(levels[level]);
+            rgba.resize(texel_count * 4);
+            for (size_t t = 0; t < texel_count; ++t) {
+                const uint8_t* texel = source + (t * texel_size);
+                rgba[(t * 4) + 0] = texel[bgra ? 2 : 0];
+                rgba[(t * 4) + 1] = texel[1];
+                rgba[(t * 4) + 2] = texel[bgra ? 0 : 2];
+                rgba[(t * 4) + 3] = (texel_size == 4) ? texel[3] : 255;
+                opaque = opaque && (rgba[(t * 4) + 3] == 255);
+            }
+        }
+        for (uint32_t level = stored_levels; level < level_count; ++level) {
+            uint32_t source_width = std::max(static_cast<uint32_t>(extent.x) >> (level - 1), 1u);
+            uint32_t source_height = std::max(static_cast<uint32_t>(extent.y) >> (level - 1), 1u);
+            uint32_t width = std::max(source_width >> 1, 1u);
+            uint32_t height = std::max(source_height >> 1, 1u);
+            const std::vector<uint8_t>& source(levels[level - 1]);
+            std::vector<uint8_t>& rgba(levels[level]);
+            rgba.resize(static_cast<size_t>(width) * height * 4);
+            const float* linear = srgb_to_linear();
+            for (uint32_t y = 0; y < height; ++y) {
+                // Source rows [y_begin, y_end); the last texel also takes the odd row left over.
+                uint32_t y_begin = std::min(y * 2, source_height - 1);
+                uint32_t y_end = (y == height - 1) ? source_height : ((y * 2) + 2);
+                for (uint32_t x = 0; x < width; ++x) {
+                    uint32_t x_begin = std::min(x * 2, source_width - 1);
+                    uint32_t x_end = (x == width - 1) ? source_width : ((x * 2) + 2);
+                    float texel_count = static_cast<float>((y_end - y_begin) * (x_end - x_begin));
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        bool encoded = srgb && (c < 3); // alpha is always linear
+                        float sum = 0.0f;
+                        for (uint32_t source_y = y_begin; source_y < y_end; ++source_y) {
+                            for (uint32_t source_x = x_begin; source_x < x_end; ++source_x) {
+                                uint8_t value = source[(((source_y * source_width) + source_x) * 4) + c];
+                                sum += encoded ? linear[value] : static_cast<float>(value);
+                            }
+                        }
+                        float average = sum / texel_count;
+                        rgba[(((y * width) + x) * 4) + c] = encoded ? linear_to_srgb(average) : static_cast<uint8_t>(average + 0.5f);
+                    }
                 }
-                std::fesetround(FE_TOWARDZERO);
-                return (std::lrintf(v) & 0x3FF);
             }
         }
-    };
 
-    struct vertex {
-        glm::vec3 position;
-        glm::tvec3<value_2_10_10_10_snorm> tangent_space_basis; // x = normal, y = tangent, z = bitangent
-        glm::vec2 tex_coord;
-    };
+        return (opaque);
+    }
 
     class application {
-        static constexpr uint32_t per_frame_ubo_size = 65535;
+        static constexpr uint32_t statistics_report_frames = 256;
 
         static const vk::MemoryPropertyFlags ubo_memory_properties;
         static const vk::MemoryPropertyFlags staging_memory_properties;
         static const vk::MemoryPropertyFlags optimized_memory_properties;
+        static const vk::MemoryPropertyFlags direct_memory_properties;
 
         struct device_buffer {
             vk::Buffer buffer;
@@ -333,38 +850,442 @@ namespace gtb {
         };
         typedef std::vector<device_image> device_image_vector;
 
-        struct draw_record {
-            glm::mat4 transform;
+        // One level of detail; a range of the same index buffer over the same vertices.
+        struct lod_record {
+            uint32_t first_index;
+            uint32_t index_count;
+            float error; // model space distance from the full detail surface
+        };
+
+        // Where a draw's geometry lives in the merged buffers and how to decode it.
+        struct geometry_record {
+            vertex_format format;
+            vk::IndexType index_type;
+
+            glm::vec3 position_scale;
+            glm::vec3 position_bias;
+
+            glm::vec3 bounds_center; // model space bounding sphere
+            float bounds_radius;
 
             uint32_t index_count;
             uint32_t first_index;
             int32_t vertex_offset;
 
-            vk::DescriptorSet immutable_state;
+            uint32_t first_cluster; // into the load time cluster list, every level of detail
+            uint32_t cluster_count;
+
+            uint32_t lod_count;
+            lod_record lods[lod_max_levels]; // lods[0] is full detail, the same range as above
+
+            // Skinned vertices are read from this frame's skinning output rather than the merged
+            // streams; until draws are assigned their output, vertex_offset is into the skinning input.
+            bool skinned;
+        };
+
+        struct draw_record {
+            uint32_t transform_index; // into the scene's transform hierarchy
+            int skin; // glTF skin of the drawing node, -1 for none
+            uint32_t texture_index; // into the scene's textures
+            geometry_record geometry;
 
-            uint8_t vbo;
-            uint8_t ibo;
+            vk::DescriptorSet immutable_state;
         };
         typedef std::vector<draw_record> draw_vector;
 
-        typedef std::unordered_map<uint32_t, uint8_t> loaded_buffer_map;
+        // Joint influences of one vertex, as loaded.
+        struct skin_influence {
+            glm::u16vec4 joints;
+            glm::vec4 weights;
+        };
+
+        // CPU side geometry of a single glTF primitive, kept until the merged buffers are built.
+        struct primitive_data {
+            std::vector<vertex> vertices;
+            std::vector<skin_influence> skin; // parallel to vertices when skinned, otherwise empty
+            std::vector<uint32_t> indices;
+            int material;
+        };
+        typedef std::vector<primitive_data> primitive_vector;
+
+        // (mesh, primitive) -> index into the loaded primitives
+        typedef std::map<std::pair<int, int>, uint32_t> loaded_primitive_map;
+
+        // (material, grid cell) -> draws merged into one static batch
+        typedef std::map<std::pair<int, uint32_t>, std::vector<uint32_t>> static_batch_map;
+
+        // All geometry is appended to one set of vertex streams per vertex format and one index
+        // buffer per index type.
+        struct merged_geometry {
+            std::vector<uint8_t> vertices[vertex_format_count]; // interleaved, or positions only when split
+            std::vector<uint8_t> attributes[vertex_format_count]; // everything but positions when split
+            std::vector<uint16_t> indices16;
+            std::vector<uint32_t> indices32;
+            std::vector<cluster_data> clusters; // per primitive; first index relative to the primitive
+            std::vector<skin_vertex> skin_vertices; // skinned primitives only
+        };
+
+        // One glTF skin; joint matrices of every skin are packed into one buffer per frame.
+        struct skin_record {
+            std::vector<uint32_t> joints; // transform indices
+            std::vector<glm::mat4> inverse_bind_matrices; // parallel to joints
+            uint32_t first_joint; // in the joint matrices
+        };
+
+        // A file a scene was loaded from; a newer write time on disk triggers a reload.
+        struct watched_file {
+            std::string file_name;
+            std::time_t write_time;
+            bool texture; // only material sets need rebuilding
+        };
+
+        // A texture paged into the atlas from its tile file as draws ask for pages. The id selects its
+        // entry in the page table buffer; the main thread keeps the rest of its state.
+        struct virtual_texture {
+            uint32_t id;
+            std::string tile_file;
+            vt::layout layout;
+            bool srgb;
+        };
+        typedef std::shared_ptr<virtual_texture> virtual_texture_pointer;
+
+        // Everything one loaded glTF file adds to the frame. Releasing a scene queues its objects for
+        // destruction once the frames already submitted have completed.
+        struct loaded_scene {
+            loaded_scene()
+                : id(0)
+                , cluster_count(0)
+                , joint_count(0)
+                , has_camera(false)
+                , camera_transform(1.0f)
+                , camera_position(0.0f)
+            {}
+
+            uint32_t id;
+            std::string file_name;
+
+            // Merged geometry and draw data; every buffer lives in buffers.
+            device_buffer_vector buffers;
+            vk::Buffer vertex_buffers[vertex_format_count];
+            vk::Buffer attribute_buffers[vertex_format_count];
+            vk::Buffer index_buffers[2]; // uint16, uint32
+
+            // Textures are shared with other scenes loading the same file. Virtual textures are sampled
+            // from the atlas, which stands in for them in textures.
+            std::vector<std::shared_ptr<device_image>> textures;
+            std::vector<virtual_texture_pointer> virtual_textures; // parallel to textures; null unless paged
+
+            // Immutable bound state = One set per material.
+            vk::DescriptorPool immutable_descriptor_pool;
+
+            // Node transforms; draws reference them by index.
+            transform_hierarchy transforms;
+
+            // Animations play in a loop from the moment the scene is published.
+            std::vector<animation::clip> animations;
+            std::chrono::steady_clock::time_point animation_start;
+
+            // Draw data per frame in flight (persistently mapped), rewritten where transforms changed.
+            device_buffer_vector draw_data_buffers;
+            std::vector<draw_data*> frame_draw_data;
+            std::vector<uint64_t> draw_data_serials; // transform serial each frame's copy is up to date with
+
+            // Scene bound state = One set per frame in flight pointing at its draw data storage buffer.
+            vk::DescriptorPool scene_descriptor_pool;
+            std::vector<vk::DescriptorSet> scene_sets;
+
+            draw_vector draws;
+            std::vector<uint32_t> draw_lods; // selected level of detail per draw this frame
+
+            // Cluster culling
+            uint32_t cluster_count;
+            vk::Buffer cull_draw_command_template; // index counts of zero
+            vk::DescriptorPool cull_descriptor_pool;
+            std::vector<vk::DescriptorSet> cull_sets;
+            device_buffer_vector cull_index_buffers;
+            device_buffer_vector cull_draw_command_buffers;
+            device_buffer_vector cull_lod_buffers; // persistently mapped
+            std::vector<uint32_t*> cull_lod_selections;
+
+            // Skinning; a compute pass writes every skinned draw's world space vertices each frame.
+            std::vector<skin_record> skins;
+            std::vector<skin_job> skin_jobs;
+            uint32_t joint_count;
+            vk::Buffer skin_vertex_buffer; // bind pose input
+            device_buffer_vector joint_buffers; // per frame in flight (persistently mapped)
+            std::vector<glm::mat4*> frame_joint_matrices;
+            std::vector<uint64_t> joint_serials; // transform serial each frame's joint matrices are up to date with
+            device_buffer_vector skinned_vertex_buffers; // per frame in flight
+            device_buffer_vector skinned_attribute_buffers; // per frame in flight, split streams only
+            vk::DescriptorPool skin_descriptor_pool;
+            std::vector<vk::DescriptorSet> skin_sets;
+
+            // Camera found in the file, applied when the scene is published.
+            bool has_camera;
+            glm::mat4 camera_transform;
+            glm::vec3 camera_position;
+
+            // Hot reload; material sets, the views they were written with and texture files are
+            // parallel to textures. A texture whose view changed needs new sets.
+            std::vector<vk::DescriptorSet> material_sets; // textures sharing an array share a set
+            std::vector<vk::ImageView> material_views;
+            std::vector<uint32_t> texture_layers; // of the array image; zero unless packed
+            std::vector<std::string> texture_files; // empty for textures the scene owns
+            std::vector<std::shared_ptr<device_image>> owned_textures; // decoded or packed; reload with the scene
+            std::vector<watched_file> watched_files;
+        };
+        typedef std::shared_ptr<loaded_scene> scene_pointer;
+        typedef std::vector<scene_pointer> scene_vector;
+
+        struct scene_load_request {
+            uint32_t id;
+            std::string file_name;
+            scene_pointer textures_of; // set when only this published scene's textures changed
+        };
+
+        // Material sets rebuilt for a published scene after some of its textures changed.
+        struct material_reload {
+            scene_pointer scene;
+            vk::DescriptorPool immutable_descriptor_pool;
+            std::vector<vk::DescriptorSet> material_sets;
+            std::vector<vk::ImageView> material_views;
+            std::vector<std::shared_ptr<device_image>> textures;
+        };
+        typedef std::vector<material_reload> material_reload_vector;
+
+        struct cached_texture {
+            std::weak_ptr<device_image> texture;
+            std::time_t write_time; // of the file when it was loaded
+
+            // Mip residency. The image holds the file's levels from resident_level down; streamed
+            // textures never drop below tail_level, others are fully resident.
+            uint32_t width; // of level 0
+            uint32_t height;
+            std::vector<vk::DeviceSize> level_sizes; // per file level, every layer
+            uint32_t tail_level;
+            uint32_t resident_level;
+            uint32_t requested_level; // differs from resident_level while a change is loading
+            uint32_t wanted_level; // finest level the draws using it needed when last drawn
+            uint64_t last_used_frame;
+        };
+        typedef std::map<std::string, cached_texture> texture_cache;
+
+        // A texture to reload with a different finest resident level.
+        struct residency_request {
+            std::string file_name;
+            std::weak_ptr<device_image> texture;
+            uint32_t level;
+        };
+
+        // The image of a residency request, swapped into the shared texture by the main thread. The
+        // image is empty if loading failed.
+        struct residency_change {
+            std::string file_name;
+            std::weak_ptr<device_image> texture;
+            uint32_t level;
+            device_image image;
+        };
+
+        // Texel data already in a staging buffer, with one copy region per level and layer.
+        struct staged_texture {
+            device_buffer buffer;
+            vk::Format format;
+            vk::Extent3D extent; // of the first staged level
+            uint32_t layers;
+            bool single_level; // the source has no mips, so a chain may be generated
+            std::vector<vk::BufferImageCopy> regions;
+        };
+
+        // A PNG or JPEG image decoding on the thread pool into mapped staging memory.
+        struct image_decode {
+            image_decode()
+                : width(0)
+                , height(0)
+                , mapped(nullptr)
+                , done(false)
+                , decoded(false)
+            {}
+
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [this]() { return (done); });
+            }
+
+            std::vector<uint8_t> encoded; // released once decoded
+            int width;
+            int height;
+            staged_texture staged; // the buffer is cleared once uploaded
+            void* mapped;
+            gli::texture texels; // instead of staging memory when the image may be packed
+
+            std::mutex mutex;
+            std::condition_variable finished;
+            bool done;
+            bool decoded; // false if the image turned out to be corrupt
+        };
+        typedef std::shared_ptr<image_decode> image_decode_pointer;
+
+        // Passed to the glTF image callback. Every decode is waited for before the load returns.
+        struct gltf_image_context {
+            ~gltf_image_context()
+            {
+                for (const image_decode_pointer& decode : decodes) {
+                    decode->wait();
+                }
+            }
+
+            application* app;
+            std::vector<image_decode_pointer> decodes;
+        };
+
+        // Objects released while frames in flight may still use them; any of the handles may be set.
+        struct deferred_release {
+            uint64_t frame_serial; // destroyed once this frame has completed
+            vk::Buffer buffer;
+            vk::Image image;
+            vk::ImageView view;
+            vk::DescriptorPool descriptor_pool; // frees its descriptor sets too
+            vk::DeviceMemory device_memory;
+        };
 
         struct gltf_load_state {
-            explicit gltf_load_state(const tinygltf::Model& m)
+            gltf_load_state(const tinygltf::Model& m, loaded_scene& s)
                 : model(m)
-                , draw_index(0)
+                , scene(s)
+                , camera_node(transform_hierarchy::no_parent)
+                , camera_projection(1.0f)
             {}
 
             const tinygltf::Model& model;
-            loaded_buffer_map loaded_ibo;
-            loaded_buffer_map loaded_vbo;
+            loaded_scene& scene;
+            loaded_primitive_map loaded_primitives;
+            primitive_vector primitives;
+            std::vector<uint32_t> draw_primitives; // draw index -> primitive index
             draw_vector draws;
-            std::vector<vk::DescriptorSet> simple_immutable_sets;
-            uint32_t draw_index;
+            std::vector<vk::DescriptorSet> material_sets; // material index -> immutable state
+            std::vector<uint32_t> material_textures; // material index -> scene texture index
+            uint32_t camera_node; // the last node with a camera
+            glm::mat4 camera_projection;
+            std::vector<uint32_t> node_transforms; // node index -> transform index
+            std::vector<bool> animated_transforms; // moved by an animation or under a node that is
+            std::vector<image_decode_pointer> image_decodes; // by the tag in each decoded image's extras
+        };
+
+        // A material image as loaded; small ones wait in memory until packed into array images.
+        struct material_image {
+            material_image()
+                : file(false)
+                , cached(false)
+                , write_time(0)
+                , layer(0)
+            {}
+
+            std::string name;
+            bool file; // loaded by gli from its uri
+            bool cached; // shared with other scenes through the texture cache
+            std::time_t write_time;
+            gli::texture texels;
+            std::shared_ptr<device_image> texture;
+            uint32_t layer;
+            virtual_texture_pointer virtual_texture; // texture is the atlas when set
+        };
+
+        // Main thread state of one virtual texture id.
+        struct virtual_texture_state {
+            virtual_texture_state()
+                : live(false)
+                , generation(0)
+                , page_table_offset(0)
+            {}
+
+            bool live;
+            uint32_t generation; // tiles read for an earlier texture with the id are dropped
+            std::string tile_file;
+            vt::page_table table;
+            uint32_t page_table_offset; // of its entries in the page table buffer
+        };
+
+        // A tile read from a tile file on the pool, waiting to be uploaded by the main thread.
+        struct virtual_tile {
+            uint32_t texture;
+            uint32_t generation;
+            uint32_t page;
+            std::vector<uint8_t> texels; // empty if the read failed
         };
 
-        // Logging
+        // (format, width, height, levels) -> images packed into array images
+        typedef std::map<std::tuple<vk::Format, uint32_t, uint32_t, uint32_t>, std::vector<int>> texture_pack_map;
+
+        // Vertex input state for one vertex layout.
+        struct vertex_input_state {
+            vk::VertexInputBindingDescription bindings[2];
+            vk::VertexInputAttributeDescription attributes[3];
+            vk::PipelineVertexInputStateCreateInfo create_info;
+        };
+
+        // Command line options
+        struct options {
+            options()
+                : split_vertex_streams(false)
+                , depth_prepass(false)
+                , static_batching(false)
+                , cluster_culling(false)
+                , lod(false)
+                , weld(false)
+                , weld_tolerance(0.0f)
+                , hot_reload(false)
+                , texture_lod_bias(0.0f)
+                , texture_budget(0)
+                , decode_bc(false)
+                , encode_textures(false)
+                , texture_arrays(false)
+                , virtual_texture_budget(0)
+                , staged_uploads(false)
+            {}
+
+            bool split_vertex_streams;
+            bool depth_prepass;
+            bool static_batching;
+            bool cluster_culling;
+            bool lod;
+            bool weld;
+            float weld_tolerance; // model space; zero welds bit identical vertices only
+            bool hot_reload;
+            float texture_lod_bias; // added to the mip level textures are sampled at
+            size_t texture_budget; // bytes of streamed mips; zero keeps every texture fully resident
+            bool decode_bc; // even when the device samples BC formats
+            bool encode_textures; // uncompressed textures to BC1 or BC7, cached on disk
+            bool texture_arrays; // small textures of one format and size share an array image
+            size_t virtual_texture_budget; // bytes of the page atlas; zero keeps every texture whole
+            bool staged_uploads; // even when device memory is host visible
+        };
+        options m_options;
+
+        // Logging; written from the main and loader threads.
         std::ofstream m_log_stream;
+        std::mutex m_log_mutex;
+
+        // Load time work that splits across primitives.
+        thread_pool m_thread_pool;
+
+        // Scene loading; files load on a background thread and are published by tick().
+        std::thread m_loader_thread;
+        std::mutex m_loader_mutex;
+        std::condition_variable m_load_requested;
+        std::deque<scene_load_request> m_load_requests;
+        scene_vector m_loaded_scenes; // waiting to be published
+        material_reload_vector m_material_reloads; // waiting to be applied
+        std::deque<residency_request> m_residency_requests; // loaded before waiting scenes
+        std::vector<residency_change> m_residency_changes; // waiting to be applied
+        uint32_t m_loading_scene_id; // zero when idle
+        bool m_loading_scene_cancelled;
+        bool m_loader_stopping;
+        uint32_t m_next_scene_id;
+
+        // Hot reload; files of published scenes are polled rather than watched, so every platform
+        // behaves the same.
+        std::chrono::steady_clock::time_point m_next_watch_poll;
 
         // GLFW
         GLFWwindow* m_window;
@@ -374,8 +1295,13 @@ namespace gtb {
         vk::DebugReportCallbackEXT m_debug_report_callback;
         vk::PhysicalDevice m_physical_device;
         uint32_t m_queue_family_index;
+        bool m_pipeline_statistics_supported;
+        bool m_texture_compression_bc_supported;
+        uint32_t m_direct_memory_types; // device local and host visible, in the main device heap; zero stages uploads
+        bool m_direct_texture_uploads; // linear images; only where the device has no memory of its own
         vk::Device m_device;
         vk::Queue m_queue;
+        std::mutex m_queue_mutex; // the loader thread submits uploads
         vk::DispatchLoaderDynamic m_dispatch;
 
         // Swap chain for display
@@ -385,7 +1311,7 @@ namespace gtb {
         vk::Extent2D m_swap_chain_extent;
         vk::SwapchainKHR m_swap_chain;
         device_image_vector m_swap_chain_color_images;
-        device_image_vector m_swap_chain_depth_images;
+        device_image m_depth_image; // shared by every frame in flight; the render pass orders their use
         vk::Fence m_next_image_ready;
 
         // Graphics memory
@@ -394,6 +1320,10 @@ namespace gtb {
         // Shaders
         vk::ShaderModule m_simple_vert;
         vk::ShaderModule m_simple_frag;
+        vk::ShaderModule m_virtual_frag;
+        vk::ShaderModule m_depth_vert;
+        vk::ShaderModule m_cull_comp;
+        vk::ShaderModule m_skin_comp;
 
         // Render pass and targets
         vk::RenderPass m_simple_render_pass;
@@ -401,46 +1331,129 @@ namespace gtb {
 
         // Command buffers (normally per-rendering thread)
         vk::CommandPool m_command_pool;
+        vk::CommandPool m_transfer_command_pool; // one-time uploads, recorded by whichever thread is loading
         std::vector<vk::CommandBuffer> m_command_buffers;
         std::vector<vk::Fence> m_command_fences;
 
+        // Pipeline statistics; one query per frame in flight.
+        vk::QueryPool m_statistics_query_pool;
+        std::vector<bool> m_statistics_query_pending;
+        uint64_t m_fragment_invocations;
+        uint32_t m_statistics_frames;
+
         // Samplers
-        vk::Sampler m_bilinear_sampler;
+        vk::Sampler m_trilinear_sampler;
 
         // Pipelines
         vk::PipelineLayout m_simple_pipeline_layout;
         vk::Pipeline m_simple_pipeline;
+        vk::Pipeline m_compact_pipeline;
+        vk::Pipeline m_simple_depth_pipeline;
+        vk::Pipeline m_compact_depth_pipeline;
 
-        // Uniform buffers
-        uint32_t m_ubo_min_field_align;
+        // Uniform buffers (persistently mapped)
         device_buffer_vector m_uniform_buffers;
+        std::vector<per_frame_uniforms*> m_per_frame_uniforms;
 
         // Mutable bound state = One set per frame pointing at each per-frame uniform buffer.
         vk::DescriptorPool m_mutable_descriptor_pool;
         vk::DescriptorSetLayout m_simple_mutable_set_layout;
         std::vector<vk::DescriptorSet> m_simple_mutable_sets;
 
-        // Immutable bound state = One set per draw.
-        vk::DescriptorPool m_immutable_descriptor_pool;
+        // Immutable bound state = One set per material, allocated per scene.
         vk::DescriptorSetLayout m_simple_immutable_set_layout;
 
+        // Scene bound state = One set per scene pointing at its draw data storage buffer.
+        vk::DescriptorSetLayout m_simple_scene_set_layout;
+
         // Static buffers
         device_buffer_vector m_static_buffers;
 
-        // Textures
-        device_image_vector m_textures;
+        // Cluster culling; a compute pass writes each frame's visible indices and one indirect draw per draw.
+        vk::DescriptorSetLayout m_cull_set_layout;
+        vk::PipelineLayout m_cull_pipeline_layout;
+        vk::Pipeline m_cull_pipeline;
+
+        // Skinning; a compute pass writes each frame's skinned vertices before anything reads them.
+        vk::DescriptorSetLayout m_skin_set_layout;
+        vk::PipelineLayout m_skin_pipeline_layout;
+        vk::Pipeline m_skin_pipeline;
+
+        // Textures; loaded once while any scene uses them.
+        std::mutex m_texture_mutex;
+        texture_cache m_textures;
+        std::vector<float> m_texture_footprints; // per texture of one scene; largest screen size in pixels this frame
+
+        // Virtual textures; pages load into a fixed size atlas as each frame's feedback asks for them,
+        // so memory stays bounded however large the textures are. Textures are created by the loader
+        // and handed to the main thread, which owns the page tables, the atlas and the uploads.
+        std::mutex m_virtual_texture_mutex;
+        std::map<std::string, std::weak_ptr<virtual_texture>> m_virtual_textures; // by tile file
+        std::vector<uint32_t> m_free_virtual_texture_ids;
+        std::vector<virtual_texture> m_added_virtual_textures; // waiting for the main thread
+        std::vector<uint32_t> m_released_virtual_textures; // ids waiting for the main thread
+        std::vector<virtual_tile> m_read_virtual_tiles; // waiting to be uploaded
+        std::vector<virtual_texture_state> m_virtual_texture_states; // by id; main thread only from here on
+        std::vector<virtual_texture_info> m_virtual_texture_infos; // by id
+        std::vector<uint32_t> m_page_table; // every texture's entries
+        std::vector<std::pair<uint32_t, uint32_t>> m_free_page_table_ranges; // (offset, entry count) by offset
+        std::vector<uint32_t> m_page_table_changes; // pages of one texture whose entries changed
+        std::vector<std::vector<uint32_t>> m_page_table_dirty; // per frame in flight; entries changed since it was recorded
+        std::set<uint64_t> m_pending_virtual_pages; // texture id << 32 | page; being read
+        std::vector<uint32_t> m_feedback_requests;
+        std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> m_virtual_page_reads; // (level, texture id, page)
+        std::vector<virtual_tile> m_uploading_virtual_tiles;
+        std::vector<vk::BufferImageCopy> m_virtual_page_copies;
+        vt::page_cache m_page_cache;
+        uint32_t m_atlas_slots_per_side;
+        device_image m_atlas; // RGBA8 UNORM; sRGB textures are decoded in the shader
+        std::shared_ptr<device_image> m_atlas_texture; // what scenes hold for their virtual textures
+        uint32_t m_feedback_cells_x;
+        uint32_t m_feedback_cell_count;
+        device_buffer_vector m_page_table_buffers; // per frame in flight (persistently mapped)
+        std::vector<uint32_t*> m_frame_page_tables;
+        std::vector<size_t> m_page_table_capacities; // entries
+        device_buffer_vector m_feedback_buffers; // per frame in flight (persistently mapped)
+        std::vector<const uint32_t*> m_frame_feedback;
+        device_buffer_vector m_virtual_staging_buffers; // per frame in flight (persistently mapped)
+        std::vector<uint8_t*> m_frame_virtual_staging;
+
+        // Scenes drawn this frame.
+        scene_vector m_scenes;
+
+        // Deferred destruction. Frames are numbered as they are submitted; released objects wait
+        // until every frame submitted before the release has completed.
+        std::mutex m_release_mutex;
+        std::deque<deferred_release> m_deferred_releases;
+        std::atomic<uint64_t> m_submitted_frame_serial;
+        uint64_t m_completed_frame_serial;
+        std::vector<uint64_t> m_frame_serials; // last frame submitted with each command fence
+
+        // Animation clips sampled this tick, with their scene's time in seconds.
+        std::vector<std::pair<animation::clip*, float>> m_animation_jobs;
 
         // Draw list
-        draw_vector m_draws;
+        std::vector<std::pair<float, uint32_t>> m_depth_sorted_draws; // (clip space depth, draw index)
+        uint64_t m_lod_triangles;
+        uint64_t m_full_detail_triangles;
+        uint32_t m_lod_frames;
 
         // Camera
         glm::mat4 m_camera_transform;
+        glm::vec3 m_camera_position;
 
     public:
         static application* get();
 
         int run(int argc, char* argv[]);
 
+        // Queues a glTF file to load in the background and add to the running scene. Returns an id
+        // for unload_scene.
+        uint32_t load_scene(const std::string& file_name);
+
+        // Removes a loaded or pending scene; its resources are released once no frame in flight uses them.
+        void unload_scene(uint32_t id);
+
     private:
         application();
         ~application();
@@ -448,9 +1461,37 @@ namespace gtb {
         void init(int argc, char* argv[]);
         void cleanup();
 
+        std::string parse_command_line(int argc, char* argv[]);
+
         void tick();
         void draw();
 
+        void animate_scenes();
+        void select_lods();
+        void skin_scene(vk::CommandBuffer command_buffer, loaded_scene& scene, uint32_t frame);
+        void cull_clusters(vk::CommandBuffer command_buffer, const loaded_scene& scene, uint32_t frame);
+        void draw_scene_depth(vk::CommandBuffer command_buffer, const loaded_scene& scene, uint32_t frame);
+        void draw_scene(vk::CommandBuffer command_buffer, const loaded_scene& scene, uint32_t frame);
+        void bind_geometry(vk::CommandBuffer command_buffer, const loaded_scene& scene, const geometry_record& geometry, bool position_only, uint32_t frame);
+        void draw_geometry(vk::CommandBuffer command_buffer, const loaded_scene& scene, const geometry_record& geometry, uint32_t draw_index, uint32_t frame);
+        bool scene_drawable(const loaded_scene& scene) const;
+        void read_statistics(uint32_t frame);
+
+        // Scene loading
+        void loader_init();
+        void loader_cleanup();
+        void loader_main();
+        void publish_scene(const scene_pointer& scene);
+        void scene_release(loaded_scene& scene);
+
+        // Hot reload
+        void watch_scenes();
+        material_reload reload_textures(const scene_pointer& scene);
+        void apply_material_reload(material_reload& reload);
+        void replace_material_sets(loaded_scene& scene, vk::DescriptorPool pool, std::vector<vk::DescriptorSet>& sets, std::vector<vk::ImageView>& views);
+        void refresh_material_sets(loaded_scene& scene);
+        static std::time_t file_write_time(const std::string& file_name);
+
         // GLFW
         void glfw_init();
         void glfw_cleanup();
@@ -459,6 +1500,7 @@ namespace gtb {
         static void glfw_error_callback(int error, const char* description);
         static void glfw_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
         static void glfw_refresh_callback(GLFWwindow* window);
+        static void glfw_drop_callback(GLFWwindow* window, int count, const char** paths);
 
         // Vulkan
         void vk_init();
@@ -486,6 +1528,7 @@ namespace gtb {
 
         // Graphics memory
         uint32_t get_memory_type(uint32_t allowed_types, vk::MemoryPropertyFlags desired_memory_properties);
+        bool find_memory_type(uint32_t allowed_types, vk::MemoryPropertyFlags desired_memory_properties, uint32_t& memory_type);
 
         // Shaders
         void shaders_init();
@@ -503,6 +1546,8 @@ namespace gtb {
         void pipeline_init();
         void pipeline_cleanup();
 
+        void vertex_input_init(vertex_format format, bool position_only, vertex_input_state& state) const;
+
         // Per-frame buffers
         void per_frame_init();
         void per_frame_cleanup();
@@ -511,25 +1556,53 @@ namespace gtb {
         void builtin_object_init();
 
         // Loaded objects
-        void gltf_load(const std::string& file_name);
+        scene_pointer gltf_load(const std::string& file_name);
         void gltf_load_node(
-            const tinygltf::Node& node,
-            const glm::mat4& parent_transform,
+            int node_index,
+            uint32_t parent_transform_index,
             gltf_load_state& load_state); // Recursive!
 
-        void gltf_load_ibo(
-            draw_record& node_draw,
+        void gltf_load_animations(gltf_load_state& load_state);
+        void gltf_load_skins(gltf_load_state& load_state);
+        static glm::vec4 gltf_read_vec4(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t element, bool normalized);
+
+        uint32_t gltf_load_primitive(
+            int mesh_index,
+            int primitive_index,
+            gltf_load_state& load_state);
+
+        void gltf_load_indices(
             const tinygltf::Primitive& primitive,
+            primitive_data& data,
             gltf_load_state& load_state);
 
-        void gltf_load_vbo(
-            draw_record& node_draw,
+        void gltf_load_vertices(
             const tinygltf::Primitive& primitive,
+            primitive_data& data,
             gltf_load_state& load_state);
 
-        void gltf_load_immutable_state(
-            const tinygltf::Node& node,
-            gltf_load_state& load_state); // Recursive!
+        void pack_primitive(
+            const primitive_data& data,
+            geometry_record& geometry,
+            merged_geometry& merged) const;
+
+        void merged_geometry_init(const merged_geometry& merged, loaded_scene& scene);
+        static size_t merged_geometry_size(const merged_geometry& merged);
+
+        void gltf_weld(gltf_load_state& load_state);
+        void gltf_static_batch(gltf_load_state& load_state);
+
+        void gltf_load_materials(gltf_load_state& load_state);
+        vk::DescriptorPool material_sets_init(
+            const std::vector<std::shared_ptr<device_image>>& textures,
+            std::vector<vk::DescriptorSet>& material_sets,
+            std::vector<vk::ImageView>& material_views);
+
+        void draw_data_init(loaded_scene& scene);
+        void write_draw_data(loaded_scene& scene, uint32_t frame);
+
+        void cluster_culling_init(loaded_scene& scene, const std::vector<cluster_data>& primitive_clusters);
+        void skinning_init(loaded_scene& scene, const std::vector<skin_vertex>& skin_vertices, uint32_t skinned_vertex_count);
 
         static bool gltf_load_image_data(
             tinygltf::Image* image,
@@ -549,7 +1622,7 @@ namespace gtb {
         void cleanup_one_time_command_buffer(vk::CommandBuffer cmd_buffer);
 
         // Buffers
-        device_buffer_vector::iterator create_static_buffer(
+        device_buffer create_static_buffer(
             vk::BufferUsageFlags flags,
             const void* data,
             size_t sizeof_data);
@@ -560,12 +1633,51 @@ namespace gtb {
             size_t sizeof_data,
             vk::MemoryPropertyFlags memory_properties);
         void cleanup_device_buffer(device_buffer& b);
+        void release_device_buffer(device_buffer& b);
 
         // Textures
-        device_image_vector::iterator create_texture(const std::string& file_name);
+        std::shared_ptr<device_image> create_texture(const std::string& file_name);
+        std::shared_ptr<device_image> find_texture(const std::string& file_name, std::time_t write_time, bool packable);
+        std::shared_ptr<device_image> cache_texture(const std::string& file_name, std::time_t write_time, gli::texture& gli_texture);
+        std::shared_ptr<device_image> create_owned_texture(const std::string& name, const gli::texture& gli_texture);
+        void pack_textures(const std::string& scene_name, texture_pack_map& packs, std::map<int, material_image>& images);
+        device_image upload_texture(const std::string& file_name, const gli::texture& gli_texture, uint32_t first_level);
+        bool upload_direct_texture(const std::string& file_name, const gli::texture& gli_texture, uint32_t first_level, device_image& texture);
+        device_image upload_staged_texture(const std::string& file_name, staged_texture& staged, uint32_t first_level);
+        std::shared_ptr<device_image> create_decoded_texture(const std::string& name, image_decode& decode);
+        void wait_for_decode(const std::string& name, image_decode& decode);
+        void cleanup_image_decode(image_decode& decode);
+        void decode_texture(const std::string& file_name, gli::texture& gli_texture, uint32_t first_level);
+        void decode_bcn_texture(const std::string& file_name, gli::texture& gli_texture, uint32_t first_level);
+        gli::texture load_texture_file(const std::string& file_name, std::time_t write_time);
+        void encode_texture(const std::string& file_name, std::time_t write_time, gli::texture& gli_texture);
         void textures_cleanup();
 
+        // Texture streaming
+        void stream_textures();
+        residency_change load_residency(const residency_request& request);
+        void apply_residency_change(residency_change& change);
+
+        // Virtual textures
+        void virtual_textures_init();
+        void virtual_textures_cleanup();
+        virtual_texture_pointer create_virtual_texture(const std::string& file_name, std::time_t write_time, gli::texture& gli_texture);
+        bool build_tile_file(const std::string& file_name, const std::string& tile_file, const gli::texture& gli_texture, vt::file_header& header);
+        void apply_virtual_texture_changes();
+        void update_virtual_textures(vk::CommandBuffer command_buffer, uint32_t frame);
+        bool read_virtual_page(uint32_t texture, uint32_t page);
+        void publish_page_table_changes(const virtual_texture_state& state);
+        uint32_t allocate_page_table_range(uint32_t entry_count);
+        void free_page_table_range(uint32_t offset, uint32_t entry_count);
+
         void cleanup_device_image(device_image& t);
+        void release_device_image(device_image& t);
+
+        // Deferred destruction
+        void release_descriptor_pool(vk::DescriptorPool pool);
+        void push_release(deferred_release& release);
+        void retire_frames();
+        void releases_cleanup();
 
         // Disallow some C++ operations.
         application(application&&) = delete;
@@ -583,6 +1695,10 @@ namespace gtb {
     // static
     const vk::MemoryPropertyFlags application::optimized_memory_properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
 
+    // static
+    const vk::MemoryPropertyFlags application::direct_memory_properties =
+        vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
     // static
     application* application::get()
     {
@@ -591,17 +1707,38 @@ namespace gtb {
     }
 
     application::application()
-        : m_window(nullptr)
+        : m_loading_scene_id(0)
+        , m_loading_scene_cancelled(false)
+        , m_loader_stopping(false)
+        , m_next_scene_id(1)
+        , m_window(nullptr)
         , m_queue_family_index(std::numeric_limits<uint32_t>::max())
-        , m_ubo_min_field_align(0)
+        , m_pipeline_statistics_supported(false)
+        , m_texture_compression_bc_supported(false)
+        , m_direct_memory_types(0)
+        , m_direct_texture_uploads(false)
+        , m_fragment_invocations(0)
+        , m_statistics_frames(0)
+        , m_submitted_frame_serial(0)
+        , m_completed_frame_serial(0)
+        , m_lod_triangles(0)
+        , m_full_detail_triangles(0)
+        , m_lod_frames(0)
+        , m_atlas_slots_per_side(0)
+        , m_feedback_cells_x(0)
+        , m_feedback_cell_count(0)
         , m_camera_transform(1.0f)
+        , m_camera_position(0.0f)
     {
         std::fexcept_t fe;
         std::fesetexceptflag(&fe, 0);
     }
 
     application::~application()
-    {}
+    {
+        // Never leave the loader thread running, even when cleanup was skipped by an exception.
+        loader_cleanup();
+    }
 
     int application::run(int argc, char* argv[])
     {
@@ -619,33 +1756,112 @@ namespace gtb {
 
     void application::init(int argc, char* argv[])
     {
-        std::string object_file("gtb.gltf");
-        if (argc >= 2) {
-            object_file = argv[1];
-        }
+        std::string object_file(parse_command_line(argc, argv));
 
         open_log_stream(m_log_stream, "runtime.log");
 
+        // The calling thread joins in on parallel work, so one worker fewer than the hardware threads.
+        m_thread_pool.start(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
         glfw_init();
         vk_init();
         shaders_init();
         render_pass_init();
         sampler_init();
         per_frame_init();
+        virtual_textures_init();
         pipeline_init();
 
         // geometry buffers and textures are either built-in or loaded.
         builtin_object_init();
-        gltf_load(object_file);
+
+        // The first scene loads before the first frame; later ones load in the background.
+        scene_pointer first_scene(gltf_load(object_file));
+        first_scene->id = m_next_scene_id++;
+        publish_scene(first_scene);
+
+        loader_init();
     }
 
-    void application::cleanup()
+    std::string application::parse_command_line(int argc, char* argv[])
     {
-        if (m_device) {
-            m_device.waitIdle(m_dispatch);
-        }
+        std::string object_file("gtb.gltf");
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "--split-vertex-streams") {
+                m_options.split_vertex_streams = true;
+            }
+            else if (arg == "--depth-prepass") {
+                m_options.depth_prepass = true;
+            }
+            else if (arg == "--static-batching") {
+                m_options.static_batching = true;
+            }
+            else if (arg == "--cluster-culling") {
+                m_options.cluster_culling = true;
+            }
+            else if (arg == "--lod") {
+                m_options.lod = true;
+            }
+            else if (arg == "--weld") {
+                m_options.weld = true;
+            }
+            else if ((arg == "--weld-tolerance") && ((i + 1) < argc)) {
+                m_options.weld = true;
+                m_options.weld_tolerance = std::max(std::stof(argv[++i]), 0.0f);
+            }
+            else if (arg == "--hot-reload") {
+                m_options.hot_reload = true;
+            }
+            else if ((arg == "--texture-lod-bias") && ((i + 1) < argc)) {
+                m_options.texture_lod_bias = std::stof(argv[++i]);
+            }
+            else if (arg == "--decode-bc") {
+                m_options.decode_bc = true;
+            }
+            else if (arg == "--encode-textures") {
+                m_options.encode_textures = true;
+            }
+            else if (arg == "--texture-arrays") {
+                m_options.texture_arrays = true;
+            }
+            else if ((arg == "--texture-budget") && ((i + 1) < argc)) {
+                m_options.texture_budget = static_cast<size_t>(std::max(std::stof(argv[++i]), 0.0f) * 1024.0f * 1024.0f);
+            }
+            else if ((arg == "--virtual-textures") && ((i + 1) < argc)) {
+                m_options.virtual_texture_budget = static_cast<size_t>(std::max(std::stof(argv[++i]), 0.0f) * 1024.0f * 1024.0f);
+            }
+            else if (arg == "--staged-uploads") {
+                m_options.staged_uploads = true;
+            }
+            else {
+                object_file = arg;
+            }
+        }
+
+        return (object_file);
+    }
+
+    void application::cleanup()
+    {
+        loader_cleanup();
+
+        if (m_device) {
+            m_device.waitIdle(m_dispatch);
+        }
+
+        // Dropping the last references releases every scene; the device is idle, so nothing waits.
+        for (material_reload& reload : m_material_reloads) {
+            release_descriptor_pool(reload.immutable_descriptor_pool);
+        }
+        m_material_reloads.clear();
+        m_loaded_scenes.clear();
+        m_scenes.clear();
 
         textures_cleanup();
+        virtual_textures_cleanup();
+        releases_cleanup();
         static_buffers_cleanup();
         pipeline_cleanup();
         per_frame_cleanup();
@@ -654,6 +1870,7 @@ namespace gtb {
         shaders_cleanup();
         vk_cleanup();
         glfw_cleanup();
+        m_thread_pool.stop();
 
         m_log_stream.close();
     }
@@ -683,6 +1900,7 @@ namespace gtb {
         glfwSetWindowUserPointer(m_window, this);
         glfwSetWindowRefreshCallback(m_window, glfw_refresh_callback);
         glfwSetKeyCallback(m_window, glfw_key_callback);
+        glfwSetDropCallback(m_window, glfw_drop_callback);
     }
 
     void application::glfw_cleanup()
@@ -726,8 +1944,8 @@ namespace gtb {
             m_device.destroyFence(m_next_image_ready, nullptr, m_dispatch);
         }
 
-        for (device_image& di : m_swap_chain_depth_images) {
-            cleanup_device_image(di);
+        if (m_depth_image.image) {
+            cleanup_device_image(m_depth_image);
         }
 
         for (device_image& ci : m_swap_chain_color_images) {
@@ -949,8 +2167,32 @@ namespace gtb {
         // Need some device-specific info.
         m_memory_properties = m_physical_device.getMemoryProperties(d);
 
-        vk::PhysicalDeviceProperties device_props = m_physical_device.getProperties(d);
-        m_ubo_min_field_align = static_cast<uint32_t>(device_props.limits.minUniformBufferOffsetAlignment);
+        // Integrated and CPU devices, and discrete ones with all of their memory mapped, have device
+        // local memory the host can write, so uploads skip the staging copy. A small mapped window
+        // next to a larger heap is left alone. Linear images sample slowly from dedicated memory, so
+        // textures only go direct on devices without any.
+        vk::DeviceSize device_heap_size = 0;
+        for (uint32_t heap = 0; heap < m_memory_properties.memoryHeapCount; ++heap) {
+            if (m_memory_properties.memoryHeaps[heap].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+                device_heap_size = std::max(device_heap_size, m_memory_properties.memoryHeaps[heap].size);
+            }
+        }
+        for (uint32_t mem_type = 0; mem_type < m_memory_properties.memoryTypeCount; ++mem_type) {
+            const vk::MemoryType& memory_type(m_memory_properties.memoryTypes[mem_type]);
+            if (!m_options.staged_uploads && ((memory_type.propertyFlags & direct_memory_properties) == direct_memory_properties) &&
+                (m_memory_properties.memoryHeaps[memory_type.heapIndex].size == device_heap_size)) {
+                m_direct_memory_types |= (1 << mem_type);
+            }
+        }
+        vk::PhysicalDeviceType device_type(m_physical_device.getProperties(d).deviceType);
+        m_direct_texture_uploads = (m_direct_memory_types != 0) &&
+            ((device_type == vk::PhysicalDeviceType::eIntegratedGpu) || (device_type == vk::PhysicalDeviceType::eCpu));
+        {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream
+                << "Uploads: buffers " << ((m_direct_memory_types != 0) ? "direct" : "staged")
+                << ", textures " << (m_direct_texture_uploads ? "direct where linear images allow" : "staged") << std::endl;
+        }
 
         // Create the device.
         float queue_priority = 1.0f; // Priority is not important when there is only a single queue.
@@ -959,8 +2201,36 @@ namespace gtb {
         queue_create_info.queueCount = 1;
         queue_create_info.pQueuePriorities = &queue_priority;
 
+        // Pipeline statistics are optional; they are only used for reporting.
+        vk::PhysicalDeviceFeatures supported_features = m_physical_device.getFeatures(d);
+        m_pipeline_statistics_supported = (supported_features.pipelineStatisticsQuery == VK_TRUE);
+
+        // Cluster culling draws indirectly with the draw index as the first instance.
+        if (m_options.cluster_culling && (supported_features.drawIndirectFirstInstance != VK_TRUE)) {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream << "Cluster culling disabled: drawIndirectFirstInstance is not supported" << std::endl;
+            m_options.cluster_culling = false;
+        }
+
+        // Virtual textures write page requests from the fragment shader.
+        if ((m_options.virtual_texture_budget > 0) && (supported_features.fragmentStoresAndAtomics != VK_TRUE)) {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream << "Virtual textures disabled: fragmentStoresAndAtomics is not supported" << std::endl;
+            m_options.virtual_texture_budget = 0;
+        }
+
+        // BC textures are decoded on the CPU without it.
+        m_texture_compression_bc_supported = (supported_features.textureCompressionBC == VK_TRUE);
+        if (!m_texture_compression_bc_supported) {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream << "BC textures decoded on the CPU: textureCompressionBC is not supported" << std::endl;
+        }
+
         vk::PhysicalDeviceFeatures device_features;
-        device_features.textureCompressionBC = VK_TRUE;
+        device_features.textureCompressionBC = supported_features.textureCompressionBC;
+        device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+        device_features.drawIndirectFirstInstance = m_options.cluster_culling ? VK_TRUE : VK_FALSE;
+        device_features.fragmentStoresAndAtomics = (m_options.virtual_texture_budget > 0) ? VK_TRUE : VK_FALSE;
 
         vk::DeviceCreateInfo device_create_info;
         device_create_info.queueCreateInfoCount = 1;
@@ -983,6 +2253,9 @@ namespace gtb {
         command_pool_create_info.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
         command_pool_create_info.queueFamilyIndex = m_queue_family_index;
         m_command_pool = m_device.createCommandPool(command_pool_create_info, nullptr, m_dispatch);
+
+        // Uploads get their own pool so the loader thread never shares one with frame recording.
+        m_transfer_command_pool = m_device.createCommandPool(command_pool_create_info, nullptr, m_dispatch);
     }
 
     void application::vk_create_swap_chain()
@@ -1028,7 +2301,7 @@ namespace gtb {
         depth_create_info.format = m_swap_chain_depth_format;
         depth_create_info.tiling = vk::ImageTiling::eOptimal;
         depth_create_info.initialLayout = vk::ImageLayout::eUndefined;
-        depth_create_info.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        depth_create_info.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransientAttachment;
         depth_create_info.sharingMode = vk::SharingMode::eExclusive;
         depth_create_info.samples = vk::SampleCountFlagBits::e1;
 
@@ -1044,11 +2317,7 @@ namespace gtb {
         depth_view_create_info.format = m_swap_chain_depth_format;
         depth_view_create_info.subresourceRange = subresource_range;
 
-        // Record a command buffer to copy the staging buffer to the optimized image.
-        vk::CommandBuffer layout_command_buffer = create_one_time_command_buffer();
-
         m_swap_chain_color_images.reserve(swap_chain_color_images.size());
-        m_swap_chain_depth_images.reserve(swap_chain_color_images.size());
         for (vk::Image &image : swap_chain_color_images) {
             device_image color_image;
 
@@ -1056,40 +2325,34 @@ namespace gtb {
             color_image.view = m_device.createImageView(color_view_create_info, nullptr, m_dispatch);
 
             m_swap_chain_color_images.emplace_back(color_image);
+        }
 
-            device_image depth_image;
-
-            depth_image.image = m_device.createImage(depth_create_info, nullptr, m_dispatch);
+        // Depth is cleared every frame and never stored, so one transient image serves every frame in
+        // flight, in lazily allocated memory where the device has it. The render pass sets its layout.
+        m_depth_image.image = m_device.createImage(depth_create_info, nullptr, m_dispatch);
 
-            vk::MemoryRequirements image_mem_reqs = m_device.getImageMemoryRequirements(depth_image.image, m_dispatch);
+        vk::MemoryRequirements image_mem_reqs = m_device.getImageMemoryRequirements(m_depth_image.image, m_dispatch);
 
-            vk::MemoryAllocateInfo image_alloc_info;
-            image_alloc_info.allocationSize = image_mem_reqs.size;
+        vk::MemoryAllocateInfo image_alloc_info;
+        image_alloc_info.allocationSize = image_mem_reqs.size;
+        bool lazily_allocated = find_memory_type(image_mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eLazilyAllocated, image_alloc_info.memoryTypeIndex);
+        if (!lazily_allocated) {
             image_alloc_info.memoryTypeIndex = get_memory_type(image_mem_reqs.memoryTypeBits, optimized_memory_properties);
-            depth_image.device_memory = m_device.allocateMemory(image_alloc_info, nullptr, m_dispatch);
-            m_device.bindImageMemory(depth_image.image, depth_image.device_memory, 0, m_dispatch);
-
-            depth_view_create_info.image = depth_image.image;
-            depth_image.view = m_device.createImageView(depth_view_create_info, nullptr, m_dispatch);
+        }
+        m_depth_image.device_memory = m_device.allocateMemory(image_alloc_info, nullptr, m_dispatch);
+        m_device.bindImageMemory(m_depth_image.image, m_depth_image.device_memory, 0, m_dispatch);
 
-            vk::ImageMemoryBarrier layout_barrier;
-            layout_barrier.srcAccessMask = vk::AccessFlags();
-            layout_barrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-            layout_barrier.oldLayout = vk::ImageLayout::eUndefined;
-            layout_barrier.newLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-            layout_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            layout_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            layout_barrier.image = depth_image.image;
-            layout_barrier.subresourceRange = subresource_range;
-            layout_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eEarlyFragmentTests, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &layout_barrier, m_dispatch);
+        depth_view_create_info.image = m_depth_image.image;
+        m_depth_image.view = m_device.createImageView(depth_view_create_info, nullptr, m_dispatch);
 
-            m_swap_chain_depth_images.emplace_back(depth_image);
+        {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream
+                << "Depth: " << m_swap_chain_extent.width << "x" << m_swap_chain_extent.height << " shared by "
+                << m_swap_chain_color_images.size() << " frames in flight, " << image_mem_reqs.size << " bytes"
+                << (lazily_allocated ? " lazily allocated" : "") << std::endl;
         }
 
-        // TODO: Rather than finish here, we could wait at the end of the application constructor; will need to
-        // remember staging details to be freed there.
-        finish_one_time_command_buffer(layout_command_buffer);
-
         // Need a fence to use when acquiring a texture from the swap chain.
         vk::FenceCreateInfo fence_create_info;
         fence_create_info.flags = vk::FenceCreateFlagBits::eSignaled;
@@ -1107,7 +2370,11 @@ namespace gtb {
             vk::ShaderModule& module;
         } init_list[] = {
             { "simple.vert.spv", m_simple_vert },
-            { "simple.frag.spv", m_simple_frag }
+            { "simple.frag.spv", m_simple_frag },
+            { "virtual.frag.spv", m_virtual_frag },
+            { "depth.vert.spv", m_depth_vert },
+            { "cull.comp.spv", m_cull_comp },
+            { "skin.comp.spv", m_skin_comp }
         };
 
         for (shader_to_init& init_this : init_list) {
@@ -1140,6 +2407,22 @@ namespace gtb {
 
     void application::shaders_cleanup()
     {
+        if (m_skin_comp) {
+            m_device.destroyShaderModule(m_skin_comp, nullptr, m_dispatch);
+        }
+
+        if (m_cull_comp) {
+            m_device.destroyShaderModule(m_cull_comp, nullptr, m_dispatch);
+        }
+
+        if (m_depth_vert) {
+            m_device.destroyShaderModule(m_depth_vert, nullptr, m_dispatch);
+        }
+
+        if (m_virtual_frag) {
+            m_device.destroyShaderModule(m_virtual_frag, nullptr, m_dispatch);
+        }
+
         if (m_simple_frag) {
             m_device.destroyShaderModule(m_simple_frag, nullptr, m_dispatch);
         }
@@ -1179,6 +2462,42 @@ namespace gtb {
         depth_reference.attachment = 1;
         depth_reference.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 
+        vk::AttachmentReference read_only_depth_reference;
+        read_only_depth_reference.attachment = 1;
+        read_only_depth_reference.layout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+
+        // With a depth pre-pass, the first subpass only lays down depth and the second shades
+        // exactly the visible fragments against that depth.
+        vk::SubpassDescription subpasses[2];
+        subpasses[0].pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpasses[0].pDepthStencilAttachment = &depth_reference;
+
+        subpasses[1].pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpasses[1].colorAttachmentCount = 1;
+        subpasses[1].pColorAttachments = &color_reference;
+        subpasses[1].pDepthStencilAttachment = &read_only_depth_reference;
+
+        vk::SubpassDependency prepass_dependency;
+        prepass_dependency.srcSubpass = 0;
+        prepass_dependency.dstSubpass = 1;
+        prepass_dependency.srcStageMask = vk::PipelineStageFlagBits::eLateFragmentTests;
+        prepass_dependency.dstStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+        prepass_dependency.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+        prepass_dependency.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead;
+        prepass_dependency.dependencyFlags = vk::DependencyFlagBits::eByRegion;
+
+        // Frames in flight share the depth image, so a frame's depth tests wait for the previous
+        // frame's to finish.
+        vk::SubpassDependency depth_dependency;
+        depth_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        depth_dependency.dstSubpass = 0;
+        depth_dependency.srcStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+        depth_dependency.dstStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+        depth_dependency.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+        depth_dependency.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+        vk::SubpassDependency dependencies[] = { depth_dependency, prepass_dependency };
+
         vk::SubpassDescription simple_subpass;
         simple_subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
         simple_subpass.colorAttachmentCount = 1;
@@ -1188,8 +2507,18 @@ namespace gtb {
         vk::RenderPassCreateInfo render_pass_create_info;
         render_pass_create_info.attachmentCount = _countof(attachments);
         render_pass_create_info.pAttachments = attachments;
-        render_pass_create_info.subpassCount = 1;
-        render_pass_create_info.pSubpasses = &simple_subpass;
+        if (m_options.depth_prepass) {
+            render_pass_create_info.subpassCount = _countof(subpasses);
+            render_pass_create_info.pSubpasses = subpasses;
+            render_pass_create_info.dependencyCount = _countof(dependencies);
+            render_pass_create_info.pDependencies = dependencies;
+        }
+        else {
+            render_pass_create_info.subpassCount = 1;
+            render_pass_create_info.pSubpasses = &simple_subpass;
+            render_pass_create_info.dependencyCount = 1;
+            render_pass_create_info.pDependencies = &depth_dependency;
+        }
         m_simple_render_pass = m_device.createRenderPass(render_pass_create_info, nullptr, m_dispatch);
 
         // Each render pass needs it's own set of frame buffers for the swap chain.
@@ -1199,7 +2528,7 @@ namespace gtb {
         m_simple_framebuffers.reserve(frames_in_flight);
         for (uint32_t i = 0; i < frames_in_flight; ++i) {
             fb_attachments[0] = m_swap_chain_color_images[i].view;
-            fb_attachments[1] = m_swap_chain_depth_images[i].view;
+            fb_attachments[1] = m_depth_image.view;
 
             vk::FramebufferCreateInfo frame_buffer_create_info;
             frame_buffer_create_info.renderPass = m_simple_render_pass;
@@ -1225,20 +2554,26 @@ namespace gtb {
 
     void application::sampler_init()
     {
+        // Trilinear over the whole mip chain; the bias is clamped to what the device allows.
+        float max_lod_bias = m_physical_device.getProperties(m_dispatch).limits.maxSamplerLodBias;
+
         vk::SamplerCreateInfo sampler_create_info;
         sampler_create_info.magFilter = vk::Filter::eLinear;
         sampler_create_info.minFilter = vk::Filter::eLinear;
-        sampler_create_info.mipmapMode = vk::SamplerMipmapMode::eNearest;
+        sampler_create_info.mipmapMode = vk::SamplerMipmapMode::eLinear;
         sampler_create_info.addressModeU = vk::SamplerAddressMode::eRepeat;
         sampler_create_info.addressModeV = vk::SamplerAddressMode::eRepeat;
         sampler_create_info.addressModeW = vk::SamplerAddressMode::eRepeat;
-        m_bilinear_sampler = m_device.createSampler(sampler_create_info, nullptr, m_dispatch);
+        sampler_create_info.mipLodBias = glm::clamp(m_options.texture_lod_bias, -max_lod_bias, max_lod_bias);
+        sampler_create_info.minLod = 0.0f;
+        sampler_create_info.maxLod = VK_LOD_CLAMP_NONE;
+        m_trilinear_sampler = m_device.createSampler(sampler_create_info, nullptr, m_dispatch);
     }
 
     void application::sampler_cleanup()
     {
-        if (m_bilinear_sampler) {
-            m_device.destroySampler(m_bilinear_sampler, nullptr, m_dispatch);
+        if (m_trilinear_sampler) {
+            m_device.destroySampler(m_trilinear_sampler, nullptr, m_dispatch);
         }
     }
 
@@ -1252,22 +2587,31 @@ namespace gtb {
         command_buffer_allocate_info.level = vk::CommandBufferLevel::ePrimary;
         command_buffer_allocate_info.commandBufferCount = frames_in_flight;
         m_command_buffers = m_device.allocateCommandBuffers(command_buffer_allocate_info, m_dispatch);
+        m_frame_serials.assign(frames_in_flight, 0);
 
-        // Need a uniform buffer per frame in flight as well.
+        // Need a uniform buffer per frame in flight as well. These stay mapped for the life of the buffer.
         m_uniform_buffers.reserve(frames_in_flight);
+        m_per_frame_uniforms.reserve(frames_in_flight);
         for (uint32_t i = 0; i < frames_in_flight; ++i) {
-            m_uniform_buffers.emplace_back(create_device_buffer(vk::BufferUsageFlagBits::eUniformBuffer, per_frame_ubo_size, ubo_memory_properties));
+            device_buffer& uniform_buffer = *m_uniform_buffers.emplace(m_uniform_buffers.end(),
+                create_device_buffer(vk::BufferUsageFlagBits::eUniformBuffer, sizeof(per_frame_uniforms), ubo_memory_properties));
+
+            m_per_frame_uniforms.push_back(reinterpret_cast<per_frame_uniforms*>(
+                m_device.mapMemory(uniform_buffer.device_memory, 0, sizeof(per_frame_uniforms), vk::MemoryMapFlags(), m_dispatch)));
         }
 
-        // Descriptors help us bind uniform buffer memory. Need a pool object to allocate them.
-        vk::DescriptorPoolSize descriptor_pool_size;
-        descriptor_pool_size.type = vk::DescriptorType::eUniformBufferDynamic;
-        descriptor_pool_size.descriptorCount = frames_in_flight * 1; // 1 == number of uniform buffers
+        // Descriptors help us bind uniform buffer memory. Need a pool object to allocate them. Virtual
+        // textures add the page table and feedback storage buffers.
+        vk::DescriptorPoolSize descriptor_pool_sizes[2];
+        descriptor_pool_sizes[0].type = vk::DescriptorType::eUniformBuffer;
+        descriptor_pool_sizes[0].descriptorCount = frames_in_flight * 1; // 1 == number of uniform buffers
+        descriptor_pool_sizes[1].type = vk::DescriptorType::eStorageBuffer;
+        descriptor_pool_sizes[1].descriptorCount = frames_in_flight * 2;
 
         vk::DescriptorPoolCreateInfo descriptor_pool_create_info;
         descriptor_pool_create_info.maxSets = frames_in_flight;
-        descriptor_pool_create_info.poolSizeCount = 1;
-        descriptor_pool_create_info.pPoolSizes = &descriptor_pool_size;
+        descriptor_pool_create_info.poolSizeCount = (m_options.virtual_texture_budget > 0) ? 2 : 1;
+        descriptor_pool_create_info.pPoolSizes = descriptor_pool_sizes;
 
         m_mutable_descriptor_pool = m_device.createDescriptorPool(descriptor_pool_create_info, nullptr, m_dispatch);
 
@@ -1279,10 +2623,25 @@ namespace gtb {
         for (uint32_t i = 0; i < frames_in_flight; ++i) {
             m_command_fences.emplace_back(m_device.createFence(fence_create_info, nullptr, m_dispatch));
         }
+
+        // Fragment shader invocations are counted per frame to show what the depth pre-pass saves.
+        if (m_pipeline_statistics_supported) {
+            vk::QueryPoolCreateInfo query_pool_create_info;
+            query_pool_create_info.queryType = vk::QueryType::ePipelineStatistics;
+            query_pool_create_info.queryCount = frames_in_flight;
+            query_pool_create_info.pipelineStatistics = vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+            m_statistics_query_pool = m_device.createQueryPool(query_pool_create_info, nullptr, m_dispatch);
+
+            m_statistics_query_pending.assign(frames_in_flight, false);
+        }
     }
 
     void application::per_frame_cleanup()
     {
+        if (m_statistics_query_pool) {
+            m_device.destroyQueryPool(m_statistics_query_pool, nullptr, m_dispatch);
+        }
+
         for (vk::Fence& fence : m_command_fences) {
             m_device.destroyFence(fence, nullptr, m_dispatch);
         }
@@ -1292,6 +2651,7 @@ namespace gtb {
         }
 
         for (device_buffer& b : m_uniform_buffers) {
+            m_device.unmapMemory(b.device_memory, m_dispatch);
             cleanup_device_buffer(b);
         }
 
@@ -1299,6 +2659,10 @@ namespace gtb {
             m_device.freeCommandBuffers(m_command_pool, m_command_buffers, m_dispatch);
         }
 
+        if (m_transfer_command_pool) {
+            m_device.destroyCommandPool(m_transfer_command_pool, nullptr, m_dispatch);
+        }
+
         if (m_command_pool) {
             m_device.destroyCommandPool(m_command_pool, nullptr, m_dispatch);
         }
@@ -1316,36 +2680,21 @@ namespace gtb {
         shader_stage_create_info[0].pName = "main";
 
         shader_stage_create_info[1].stage = vk::ShaderStageFlagBits::eFragment;
-        shader_stage_create_info[1].module = m_simple_frag;
+        shader_stage_create_info[1].module = (m_options.virtual_texture_budget > 0) ? m_virtual_frag : m_simple_frag;
         shader_stage_create_info[1].pName = "main";
 
-        // Vertex attribute layout.
-        vk::VertexInputBindingDescription input_binding_vbo;
-        input_binding_vbo.binding = 0;
-        input_binding_vbo.stride = sizeof(gtb::vertex);
-        input_binding_vbo.inputRate = vk::VertexInputRate::eVertex;
-
-        vk::VertexInputAttributeDescription vertex_attrib_descriptions[3];
-        vertex_attrib_descriptions[0].location = 0;
-        vertex_attrib_descriptions[0].binding = 0;
-        vertex_attrib_descriptions[0].format = vk::Format::eR32G32B32Sfloat;
-        vertex_attrib_descriptions[0].offset = offsetof(gtb::vertex, position);
-
-        vertex_attrib_descriptions[1].location = 1;
-        vertex_attrib_descriptions[1].binding = 0;
-        vertex_attrib_descriptions[1].format = vk::Format::eR32G32B32Uint;
-        vertex_attrib_descriptions[1].offset = offsetof(gtb::vertex, tangent_space_basis);
-
-        vertex_attrib_descriptions[2].location = 2;
-        vertex_attrib_descriptions[2].binding = 0;
-        vertex_attrib_descriptions[2].format = vk::Format::eR32G32Sfloat;
-        vertex_attrib_descriptions[2].offset = offsetof(gtb::vertex, tex_coord);
-
-        vk::PipelineVertexInputStateCreateInfo vertex_input_create_info;
-        vertex_input_create_info.vertexBindingDescriptionCount = 1;
-        vertex_input_create_info.pVertexBindingDescriptions = &input_binding_vbo;
-        vertex_input_create_info.vertexAttributeDescriptionCount = _countof(vertex_attrib_descriptions);
-        vertex_input_create_info.pVertexAttributeDescriptions = vertex_attrib_descriptions;
+        // Vertex attribute layouts; the shaders see the same types for every layout.
+        vertex_input_state vertex_input;
+        vertex_input_init(vertex_format::full, false, vertex_input);
+
+        vertex_input_state compact_vertex_input;
+        vertex_input_init(vertex_format::compact, false, compact_vertex_input);
+
+        vertex_input_state depth_vertex_input;
+        vertex_input_init(vertex_format::full, true, depth_vertex_input);
+
+        vertex_input_state compact_depth_vertex_input;
+        vertex_input_init(vertex_format::compact, true, compact_depth_vertex_input);
 
         // Input assembly.
         vk::PipelineInputAssemblyStateCreateInfo input_assembly_create_info;
@@ -1386,6 +2735,12 @@ namespace gtb {
         depth_create_info.depthWriteEnable = VK_TRUE;
         depth_create_info.depthCompareOp = vk::CompareOp::eLess;
 
+        // After a depth pre-pass, only fragments matching the pre-pass depth are shaded.
+        vk::PipelineDepthStencilStateCreateInfo equal_depth_create_info;
+        equal_depth_create_info.depthTestEnable = VK_TRUE;
+        equal_depth_create_info.depthWriteEnable = VK_FALSE;
+        equal_depth_create_info.depthCompareOp = vk::CompareOp::eEqual;
+
         // Multisampling.
         vk::PipelineMultisampleStateCreateInfo multisample_create_info;
         multisample_create_info.rasterizationSamples = vk::SampleCountFlagBits::e1;
@@ -1403,14 +2758,23 @@ namespace gtb {
         blend_create_info.pAttachments = &color_blend_attachment;
 
         // Binding layout.
-        vk::DescriptorSetLayoutBinding mutable_set_layout_bindings[1];
+        // Virtual textures read the page table and write feedback through per-frame storage buffers.
+        bool virtual_textures = (m_options.virtual_texture_budget > 0);
+        vk::DescriptorSetLayoutBinding mutable_set_layout_bindings[3];
         mutable_set_layout_bindings[0].binding = 0;
-        mutable_set_layout_bindings[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+        mutable_set_layout_bindings[0].descriptorType = vk::DescriptorType::eUniformBuffer;
         mutable_set_layout_bindings[0].descriptorCount = 1;
-        mutable_set_layout_bindings[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
+        mutable_set_layout_bindings[0].stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute |
+            (virtual_textures ? vk::ShaderStageFlagBits::eFragment : vk::ShaderStageFlags());
+        for (uint32_t i = 1; i < _countof(mutable_set_layout_bindings); ++i) {
+            mutable_set_layout_bindings[i].binding = i;
+            mutable_set_layout_bindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+            mutable_set_layout_bindings[i].descriptorCount = 1;
+            mutable_set_layout_bindings[i].stageFlags = vk::ShaderStageFlagBits::eFragment;
+        }
 
         vk::DescriptorSetLayoutCreateInfo mutable_set_layout_create_info;
-        mutable_set_layout_create_info.bindingCount = _countof(mutable_set_layout_bindings);
+        mutable_set_layout_create_info.bindingCount = virtual_textures ? _countof(mutable_set_layout_bindings) : 1;
         mutable_set_layout_create_info.pBindings = mutable_set_layout_bindings;
         m_simple_mutable_set_layout = m_device.createDescriptorSetLayout(mutable_set_layout_create_info, nullptr, m_dispatch);
 
@@ -1425,8 +2789,19 @@ namespace gtb {
         immutable_set_layout_create_info.pBindings = immutable_set_layout_bindings;
         m_simple_immutable_set_layout = m_device.createDescriptorSetLayout(immutable_set_layout_create_info, nullptr, m_dispatch);
 
+        vk::DescriptorSetLayoutBinding scene_set_layout_bindings[1];
+        scene_set_layout_bindings[0].binding = 0;
+        scene_set_layout_bindings[0].descriptorType = vk::DescriptorType::eStorageBuffer;
+        scene_set_layout_bindings[0].descriptorCount = 1;
+        scene_set_layout_bindings[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
+
+        vk::DescriptorSetLayoutCreateInfo scene_set_layout_create_info;
+        scene_set_layout_create_info.bindingCount = _countof(scene_set_layout_bindings);
+        scene_set_layout_create_info.pBindings = scene_set_layout_bindings;
+        m_simple_scene_set_layout = m_device.createDescriptorSetLayout(scene_set_layout_create_info, nullptr, m_dispatch);
+
         vk::DescriptorSetLayout set_layouts[] = {
-            m_simple_mutable_set_layout, m_simple_immutable_set_layout
+            m_simple_mutable_set_layout, m_simple_immutable_set_layout, m_simple_scene_set_layout
         };
 
         vk::PipelineLayoutCreateInfo layout_create_info;
@@ -1446,42 +2821,260 @@ namespace gtb {
         m_simple_mutable_sets = m_device.allocateDescriptorSets(set_allocate_info, m_dispatch);
 
         for (uint32_t i = 0; i < frames_in_flight; ++i) {
-            vk::DescriptorBufferInfo descriptor_buffer_info[1];
-            vk::WriteDescriptorSet write_descriptor_set[1];
+            vk::DescriptorBufferInfo descriptor_buffer_info[3];
+            vk::WriteDescriptorSet write_descriptor_set[3];
 
             descriptor_buffer_info[0].buffer = m_uniform_buffers[i].buffer;
-            descriptor_buffer_info[0].offset = 0; // Offsets will be set dynamically at bind time.
-            descriptor_buffer_info[0].range = sizeof(glm::mat4);
+            descriptor_buffer_info[0].offset = 0;
+            descriptor_buffer_info[0].range = sizeof(per_frame_uniforms);
 
             write_descriptor_set[0].dstSet = m_simple_mutable_sets[i];
             write_descriptor_set[0].dstBinding = 0;
-            write_descriptor_set[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+            write_descriptor_set[0].descriptorType = vk::DescriptorType::eUniformBuffer;
             write_descriptor_set[0].descriptorCount = 1;
             write_descriptor_set[0].pBufferInfo = &descriptor_buffer_info[0];
 
-            m_device.updateDescriptorSets(_countof(write_descriptor_set), write_descriptor_set, 0, nullptr, m_dispatch);
+            if (virtual_textures) {
+                descriptor_buffer_info[1].buffer = m_page_table_buffers[i].buffer;
+                descriptor_buffer_info[2].buffer = m_feedback_buffers[i].buffer;
+                for (uint32_t b = 1; b < _countof(write_descriptor_set); ++b) {
+                    descriptor_buffer_info[b].offset = 0;
+                    descriptor_buffer_info[b].range = VK_WHOLE_SIZE;
+
+                    write_descriptor_set[b].dstSet = m_simple_mutable_sets[i];
+                    write_descriptor_set[b].dstBinding = b;
+                    write_descriptor_set[b].descriptorType = vk::DescriptorType::eStorageBuffer;
+                    write_descriptor_set[b].descriptorCount = 1;
+                    write_descriptor_set[b].pBufferInfo = &descriptor_buffer_info[b];
+                }
+            }
+
+            m_device.updateDescriptorSets(virtual_textures ? _countof(write_descriptor_set) : 1, write_descriptor_set, 0, nullptr, m_dispatch);
         }
 
         // Combine the pipeline.
         vk::GraphicsPipelineCreateInfo pipeline_create_info;
         pipeline_create_info.stageCount = _countof(shader_stage_create_info);
         pipeline_create_info.pStages = shader_stage_create_info;
-        pipeline_create_info.pVertexInputState = &vertex_input_create_info;
+        pipeline_create_info.pVertexInputState = &vertex_input.create_info;
         pipeline_create_info.pInputAssemblyState = &input_assembly_create_info;
         pipeline_create_info.pViewportState = &viewport_create_info;
         pipeline_create_info.pRasterizationState = &rasterization_create_info;
         pipeline_create_info.pMultisampleState = &multisample_create_info;
-        pipeline_create_info.pDepthStencilState = &depth_create_info;
+        pipeline_create_info.pDepthStencilState = m_options.depth_prepass ? &equal_depth_create_info : &depth_create_info;
         pipeline_create_info.pColorBlendState = &blend_create_info;
         pipeline_create_info.layout = m_simple_pipeline_layout;
         pipeline_create_info.renderPass = m_simple_render_pass;
-        pipeline_create_info.subpass = 0;
+        pipeline_create_info.subpass = m_options.depth_prepass ? 1 : 0;
 
         m_simple_pipeline = m_device.createGraphicsPipeline(vk::PipelineCache(), pipeline_create_info, nullptr, m_dispatch);
+
+        // Compact vertices only change the vertex input state.
+        pipeline_create_info.pVertexInputState = &compact_vertex_input.create_info;
+
+        m_compact_pipeline = m_device.createGraphicsPipeline(vk::PipelineCache(), pipeline_create_info, nullptr, m_dispatch);
+
+        // Depth-only pipelines fetch positions alone and have no fragment shader or color writes.
+        vk::PipelineColorBlendAttachmentState depth_only_blend_attachment;
+        depth_only_blend_attachment.blendEnable = VK_FALSE;
+        depth_only_blend_attachment.colorWriteMask = vk::ColorComponentFlags();
+
+        vk::PipelineColorBlendStateCreateInfo depth_only_blend_create_info;
+        depth_only_blend_create_info.logicOpEnable = VK_FALSE;
+        depth_only_blend_create_info.attachmentCount = m_options.depth_prepass ? 0 : 1; // The pre-pass subpass has no color attachment.
+        depth_only_blend_create_info.pAttachments = &depth_only_blend_attachment;
+
+        vk::PipelineShaderStageCreateInfo depth_shader_stage_create_info[1];
+        depth_shader_stage_create_info[0].stage = vk::ShaderStageFlagBits::eVertex;
+        depth_shader_stage_create_info[0].module = m_depth_vert;
+        depth_shader_stage_create_info[0].pName = "main";
+
+        pipeline_create_info.stageCount = _countof(depth_shader_stage_create_info);
+        pipeline_create_info.pStages = depth_shader_stage_create_info;
+        pipeline_create_info.pDepthStencilState = &depth_create_info;
+        pipeline_create_info.pColorBlendState = &depth_only_blend_create_info;
+        pipeline_create_info.subpass = 0;
+
+        pipeline_create_info.pVertexInputState = &depth_vertex_input.create_info;
+        m_simple_depth_pipeline = m_device.createGraphicsPipeline(vk::PipelineCache(), pipeline_create_info, nullptr, m_dispatch);
+
+        pipeline_create_info.pVertexInputState = &compact_depth_vertex_input.create_info;
+        m_compact_depth_pipeline = m_device.createGraphicsPipeline(vk::PipelineCache(), pipeline_create_info, nullptr, m_dispatch);
+
+        // Skinning reads the bind pose and joint matrices and writes vertices, all storage buffers;
+        // each draw's ranges are push constants.
+        vk::DescriptorSetLayoutBinding skin_set_layout_bindings[4];
+        for (uint32_t i = 0; i < _countof(skin_set_layout_bindings); ++i) {
+            skin_set_layout_bindings[i].binding = i;
+            skin_set_layout_bindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+            skin_set_layout_bindings[i].descriptorCount = 1;
+            skin_set_layout_bindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+        }
+
+        vk::DescriptorSetLayoutCreateInfo skin_set_layout_create_info;
+        skin_set_layout_create_info.bindingCount = _countof(skin_set_layout_bindings);
+        skin_set_layout_create_info.pBindings = skin_set_layout_bindings;
+        m_skin_set_layout = m_device.createDescriptorSetLayout(skin_set_layout_create_info, nullptr, m_dispatch);
+
+        vk::PushConstantRange skin_push_constant_range;
+        skin_push_constant_range.stageFlags = vk::ShaderStageFlagBits::eCompute;
+        skin_push_constant_range.offset = 0;
+        skin_push_constant_range.size = sizeof(skin_job);
+
+        vk::PipelineLayoutCreateInfo skin_layout_create_info;
+        skin_layout_create_info.setLayoutCount = 1;
+        skin_layout_create_info.pSetLayouts = &m_skin_set_layout;
+        skin_layout_create_info.pushConstantRangeCount = 1;
+        skin_layout_create_info.pPushConstantRanges = &skin_push_constant_range;
+        m_skin_pipeline_layout = m_device.createPipelineLayout(skin_layout_create_info, nullptr, m_dispatch);
+
+        vk::ComputePipelineCreateInfo skin_pipeline_create_info;
+        skin_pipeline_create_info.stage.stage = vk::ShaderStageFlagBits::eCompute;
+        skin_pipeline_create_info.stage.module = m_skin_comp;
+        skin_pipeline_create_info.stage.pName = "main";
+        skin_pipeline_create_info.layout = m_skin_pipeline_layout;
+
+        m_skin_pipeline = m_device.createComputePipeline(vk::PipelineCache(), skin_pipeline_create_info, nullptr, m_dispatch);
+
+        if (!m_options.cluster_culling) {
+            return;
+        }
+
+        // Cluster culling reads the per-frame uniforms and a per-frame set of storage buffers.
+        vk::DescriptorSetLayoutBinding cull_set_layout_bindings[6];
+        for (uint32_t i = 0; i < _countof(cull_set_layout_bindings); ++i) {
+            cull_set_layout_bindings[i].binding = i;
+            cull_set_layout_bindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+            cull_set_layout_bindings[i].descriptorCount = 1;
+            cull_set_layout_bindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+        }
+
+        vk::DescriptorSetLayoutCreateInfo cull_set_layout_create_info;
+        cull_set_layout_create_info.bindingCount = _countof(cull_set_layout_bindings);
+        cull_set_layout_create_info.pBindings = cull_set_layout_bindings;
+        m_cull_set_layout = m_device.createDescriptorSetLayout(cull_set_layout_create_info, nullptr, m_dispatch);
+
+        vk::DescriptorSetLayout cull_set_layouts[] = {
+            m_simple_mutable_set_layout, m_cull_set_layout
+        };
+
+        vk::PipelineLayoutCreateInfo cull_layout_create_info;
+        cull_layout_create_info.setLayoutCount = _countof(cull_set_layouts);
+        cull_layout_create_info.pSetLayouts = cull_set_layouts;
+        m_cull_pipeline_layout = m_device.createPipelineLayout(cull_layout_create_info, nullptr, m_dispatch);
+
+        vk::ComputePipelineCreateInfo cull_pipeline_create_info;
+        cull_pipeline_create_info.stage.stage = vk::ShaderStageFlagBits::eCompute;
+        cull_pipeline_create_info.stage.module = m_cull_comp;
+        cull_pipeline_create_info.stage.pName = "main";
+        cull_pipeline_create_info.layout = m_cull_pipeline_layout;
+
+        m_cull_pipeline = m_device.createComputePipeline(vk::PipelineCache(), cull_pipeline_create_info, nullptr, m_dispatch);
+    }
+
+    void application::vertex_input_init(vertex_format format, bool position_only, vertex_input_state& state) const
+    {
+        // Positions are always location 0 in binding 0. Everything else is in binding 1 when the
+        // streams are split, otherwise interleaved in binding 0.
+        bool split = m_options.split_vertex_streams;
+        uint32_t attribute_binding = split ? 1 : 0;
+        uint32_t binding_count = (split && !position_only) ? 2 : 1;
+
+        state.bindings[0].binding = 0;
+        state.bindings[0].inputRate = vk::VertexInputRate::eVertex;
+        state.bindings[1].binding = 1;
+        state.bindings[1].inputRate = vk::VertexInputRate::eVertex;
+
+        state.attributes[0].location = 0;
+        state.attributes[0].binding = 0;
+        state.attributes[1].location = 1;
+        state.attributes[1].binding = attribute_binding;
+        state.attributes[2].location = 2;
+        state.attributes[2].binding = attribute_binding;
+
+        if (format == vertex_format::compact) {
+            state.attributes[0].format = vk::Format::eR16G16B16A16Unorm;
+            state.attributes[1].format = vk::Format::eR8G8B8A8Snorm;
+            state.attributes[2].format = vk::Format::eR16G16Sfloat;
+
+            if (split) {
+                state.bindings[0].stride = sizeof(glm::u16vec4);
+                state.bindings[1].stride = sizeof(gtb::compact_vertex_attributes);
+                state.attributes[0].offset = 0;
+                state.attributes[1].offset = offsetof(gtb::compact_vertex_attributes, tangent_frame);
+                state.attributes[2].offset = offsetof(gtb::compact_vertex_attributes, tex_coord);
+            }
+            else {
+                state.bindings[0].stride = sizeof(gtb::compact_vertex);
+                state.attributes[0].offset = offsetof(gtb::compact_vertex, position);
+                state.attributes[1].offset = offsetof(gtb::compact_vertex, tangent_frame);
+                state.attributes[2].offset = offsetof(gtb::compact_vertex, tex_coord);
+            }
+        }
+        else {
+            state.attributes[0].format = vk::Format::eR32G32B32Sfloat;
+            state.attributes[1].format = vk::Format::eR16G16B16A16Snorm;
+            state.attributes[2].format = vk::Format::eR32G32Sfloat;
+
+            if (split) {
+                state.bindings[0].stride = sizeof(glm::vec3);
+                state.bindings[1].stride = sizeof(gtb::vertex_attributes);
+                state.attributes[0].offset = 0;
+                state.attributes[1].offset = offsetof(gtb::vertex_attributes, tangent_frame);
+                state.attributes[2].offset = offsetof(gtb::vertex_attributes, tex_coord);
+            }
+            else {
+                state.bindings[0].stride = sizeof(gtb::vertex);
+                state.attributes[0].offset = offsetof(gtb::vertex, position);
+                state.attributes[1].offset = offsetof(gtb::vertex, tangent_frame);
+                state.attributes[2].offset = offsetof(gtb::vertex, tex_coord);
+            }
+        }
+
+        state.create_info.vertexBindingDescriptionCount = binding_count;
+        state.create_info.pVertexBindingDescriptions = state.bindings;
+        state.create_info.vertexAttributeDescriptionCount = position_only ? 1 : _countof(state.attributes);
+        state.create_info.pVertexAttributeDescriptions = state.attributes;
     }
     
     void application::pipeline_cleanup()
     {
+        if (m_skin_pipeline) {
+            m_device.destroyPipeline(m_skin_pipeline, nullptr, m_dispatch);
+        }
+
+        if (m_skin_pipeline_layout) {
+            m_device.destroyPipelineLayout(m_skin_pipeline_layout, nullptr, m_dispatch);
+        }
+
+        if (m_skin_set_layout) {
+            m_device.destroyDescriptorSetLayout(m_skin_set_layout, nullptr, m_dispatch);
+        }
+
+        if (m_cull_pipeline) {
+            m_device.destroyPipeline(m_cull_pipeline, nullptr, m_dispatch);
+        }
+
+        if (m_cull_pipeline_layout) {
+            m_device.destroyPipelineLayout(m_cull_pipeline_layout, nullptr, m_dispatch);
+        }
+
+        if (m_cull_set_layout) {
+            m_device.destroyDescriptorSetLayout(m_cull_set_layout, nullptr, m_dispatch);
+        }
+
+        if (m_compact_depth_pipeline) {
+            m_device.destroyPipeline(m_compact_depth_pipeline, nullptr, m_dispatch);
+        }
+
+        if (m_simple_depth_pipeline) {
+            m_device.destroyPipeline(m_simple_depth_pipeline, nullptr, m_dispatch);
+        }
+
+        if (m_compact_pipeline) {
+            m_device.destroyPipeline(m_compact_pipeline, nullptr, m_dispatch);
+        }
+
         if (m_simple_pipeline) {
             m_device.destroyPipeline(m_simple_pipeline, nullptr, m_dispatch);
         }
@@ -1497,31 +3090,46 @@ namespace gtb {
         if (m_simple_immutable_set_layout) {
             m_device.destroyDescriptorSetLayout(m_simple_immutable_set_layout, nullptr, m_dispatch);
         }
+
+        if (m_simple_scene_set_layout) {
+            m_device.destroyDescriptorSetLayout(m_simple_scene_set_layout, nullptr, m_dispatch);
+        }
     }
 
     void application::builtin_object_init()
     {
         // A Textured Quad (No quad primitive in Vulkan, so two tris and eat the helpers.)
         static const gtb::vertex quad_verts[] = {
-            //  position                normal                tangent               bitangent               texcoord
-            { { 0.0f, 0.0f, 0.0f }, { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } }, { 0.0f, 0.0f } },
-            { { 0.0f, 1.0f, 0.0f }, { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } }, { 0.0f, 1.0f } },
-            { { 1.0f, 1.0f, 0.0f }, { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } }, { 1.0f, 1.0f } },
-            { { 1.0f, 0.0f, 0.0f }, { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } }, { 1.0f, 0.0f } }
+            //  position              tangent frame (identity)  texcoord
+            { { 0.0f, 0.0f, 0.0f }, { 0, 0, 0, 32767 }, { 0.0f, 0.0f } },
+            { { 0.0f, 1.0f, 0.0f }, { 0, 0, 0, 32767 }, { 0.0f, 1.0f } },
+            { { 1.0f, 1.0f, 0.0f }, { 0, 0, 0, 32767 }, { 1.0f, 1.0f } },
+            { { 1.0f, 0.0f, 0.0f }, { 0, 0, 0, 32767 }, { 1.0f, 0.0f } }
         };
-        create_static_buffer(vk::BufferUsageFlagBits::eVertexBuffer, quad_verts, sizeof(quad_verts));
+        m_static_buffers.push_back(create_static_buffer(vk::BufferUsageFlagBits::eVertexBuffer, quad_verts, sizeof(quad_verts)));
 
         static const uint16_t quad_indices[] = {
             0, 1, 3,
             1, 2, 3
         };
-        create_static_buffer(vk::BufferUsageFlagBits::eIndexBuffer, quad_indices, sizeof(quad_indices));
+        m_static_buffers.push_back(create_static_buffer(vk::BufferUsageFlagBits::eIndexBuffer, quad_indices, sizeof(quad_indices)));
     }
 
-    void application::gltf_load(const std::string& file_name)
+    application::scene_pointer application::gltf_load(const std::string& file_name)
     {
+        // Whatever has been created is released if loading throws part way.
+        scene_pointer scene(new loaded_scene, [this](loaded_scene* s) {
+            scene_release(*s);
+            delete s;
+        });
+        scene->file_name = file_name;
+
+        // Images start decoding while the file is parsed.
+        gltf_image_context image_context;
+        image_context.app = this;
+
         tinygltf::TinyGLTF loader;
-        loader.SetImageLoader(gltf_load_image_data, this);
+        loader.SetImageLoader(gltf_load_image_data, &image_context);
 
         tinygltf::Model model;
         std::string loader_error;
@@ -1539,60 +3147,155 @@ namespace gtb {
             }
         }
 
-        // First pass over the model to load ibo /vbo as well as count draws.
-        const tinygltf::Scene& scene(model.scenes.at(model.defaultScene));
-        glm::mat4 scene_transform(1.0f);
-        gltf_load_state load_state(model);
+        // The glTF file and its external buffers are watched for hot reload; textures are added as they load.
+        watched_file gltf_file;
+        gltf_file.file_name = file_name;
+        gltf_file.write_time = file_write_time(file_name);
+        gltf_file.texture = false;
+        scene->watched_files.push_back(gltf_file);
+
+        boost::filesystem::path base_path(boost::filesystem::path(file_name).parent_path());
+        for (const tinygltf::Buffer& buffer : model.buffers) {
+            if (buffer.uri.empty() || (buffer.uri.compare(0, 5, "data:") == 0)) {
+                continue;
+            }
+
+            watched_file buffer_file;
+            buffer_file.file_name = (base_path / buffer.uri).string();
+            buffer_file.write_time = file_write_time(buffer_file.file_name);
+            buffer_file.texture = false;
+            scene->watched_files.push_back(buffer_file);
+        }
+
+        // First pass over the model to load ibo /vbo as well as count draws. Transform 0 is the
+        // identity, for geometry baked into world space.
+        const tinygltf::Scene& gltf_scene(model.scenes.at(model.defaultScene));
+        gltf_load_state load_state(model, *scene);
+        load_state.node_transforms.assign(model.nodes.size(), transform_hierarchy::no_parent);
+        load_state.image_decodes = image_context.decodes;
+        scene->transforms.add(transform_hierarchy::no_parent, glm::mat4(1.0f));
 
-        for (int node_index : scene.nodes) {
-            const tinygltf::Node& scene_node(model.nodes.at(node_index));
-            gltf_load_node(scene_node, scene_transform, load_state);
+        for (int node_index : gltf_scene.nodes) {
+            gltf_load_node(node_index, transform_hierarchy::no_parent, load_state);
         }
 
-        uint32_t draw_count = static_cast<uint32_t>(load_state.draws.size());
+        gltf_load_animations(load_state);
+        gltf_load_skins(load_state);
 
-        // Immutable state needs a pool and one set per draw.
-        vk::DescriptorPoolSize descriptor_pool_sizes[1];
-        descriptor_pool_sizes[0].type = vk::DescriptorType::eCombinedImageSampler;
-        descriptor_pool_sizes[0].descriptorCount = draw_count; // Each draw needs a single sampler.
+        // World transforms as loaded; later updates only touch what changed.
+        scene->transforms.update();
 
-        vk::DescriptorPoolCreateInfo descriptor_pool_create_info;
-        descriptor_pool_create_info.maxSets = draw_count;
-        descriptor_pool_create_info.poolSizeCount = _countof(descriptor_pool_sizes);
-        descriptor_pool_create_info.pPoolSizes = descriptor_pool_sizes;
+        if (load_state.camera_node != transform_hierarchy::no_parent) {
+            const glm::mat4& camera_world(scene->transforms.world(load_state.camera_node));
+            scene->has_camera = true;
+            scene->camera_transform = load_state.camera_projection * camera_world;
+            scene->camera_position = glm::vec3(glm::inverse(camera_world)[3]);
+        }
 
-        m_immutable_descriptor_pool = m_device.createDescriptorPool(descriptor_pool_create_info, nullptr, m_dispatch);
+        if (m_options.weld) {
+            gltf_weld(load_state);
+        }
 
-        std::vector<vk::DescriptorSetLayout> replicated_set_layouts(draw_count, m_simple_immutable_set_layout);
-        vk::DescriptorSetAllocateInfo set_allocate_info;
-        set_allocate_info.descriptorPool = m_immutable_descriptor_pool;
-        set_allocate_info.descriptorSetCount = draw_count;
-        set_allocate_info.pSetLayouts = replicated_set_layouts.data();
+        if (m_options.static_batching) {
+            gltf_static_batch(load_state);
+        }
+
+        // Pack every primitive once into the merged geometry.
+        merged_geometry merged;
+        std::vector<geometry_record> primitive_geometry(load_state.primitives.size());
+        for (size_t i = 0; i < load_state.primitives.size(); ++i) {
+            pack_primitive(load_state.primitives[i], primitive_geometry[i], merged);
+        }
+
+        merged_geometry_init(merged, *scene);
+
+        // Load textures and set up immutable descriptor sets.
+        gltf_load_materials(load_state);
+
+        // Point each draw at its geometry and material. Every skinned draw gets its own range of the
+        // skinning output, already in world space; glTF requires nodes drawing skinned meshes to have
+        // a skin, so draws without one are dropped.
+        uint32_t skinned_vertex_count = 0;
+        for (size_t i = 0; i < load_state.draws.size(); ++i) {
+            const primitive_data& data(load_state.primitives[load_state.draw_primitives[i]]);
+            draw_record& d(load_state.draws[i]);
+            d.geometry = primitive_geometry[load_state.draw_primitives[i]];
+            d.immutable_state = load_state.material_sets.at(data.material);
+            d.texture_index = load_state.material_textures.at(data.material);
+
+            if (!d.geometry.skinned || (d.skin < 0)) {
+                continue;
+            }
+
+            skin_job job;
+            job.first_input_vertex = static_cast<uint32_t>(d.geometry.vertex_offset);
+            job.first_output_vertex = skinned_vertex_count;
+            job.vertex_count = static_cast<uint32_t>(data.vertices.size());
+            job.first_joint = scene->skins.at(d.skin).first_joint;
+            job.split = m_options.split_vertex_streams ? 1 : 0;
+            scene->skin_jobs.push_back(job);
+
+            d.transform_index = 0; // identity
+            d.geometry.vertex_offset = static_cast<int32_t>(skinned_vertex_count);
+            skinned_vertex_count += job.vertex_count;
+        }
+
+        load_state.draws.erase(std::remove_if(load_state.draws.begin(), load_state.draws.end(),
+            [](const draw_record& d) { return (d.geometry.skinned && (d.skin < 0)); }), load_state.draws.end());
+
+        // Each scene keeps its own draw list, so loading another one appends rather than replaces.
+        scene->draws.swap(load_state.draws);
+
+        // Group draws by vertex format and index type so the merged buffers rebind as rarely as
+        // possible; skinned draws read their own buffers and go last in each group. Within a group,
+        // draws sharing a set, such as those whose textures share an array, go together.
+        std::stable_sort(scene->draws.begin(), scene->draws.end(), [](const draw_record& a, const draw_record& b) {
+            if (a.geometry.format != b.geometry.format) {
+                return (a.geometry.format < b.geometry.format);
+            }
+            if (a.geometry.index_type != b.geometry.index_type) {
+                return (a.geometry.index_type < b.geometry.index_type);
+            }
+            if (a.geometry.skinned != b.geometry.skinned) {
+                return (a.geometry.skinned < b.geometry.skinned);
+            }
+            return (a.immutable_state < b.immutable_state);
+        });
+
+        if (scene->draws.empty()) {
+            return (scene);
+        }
 
-        load_state.simple_immutable_sets = m_device.allocateDescriptorSets(set_allocate_info, m_dispatch);
+        draw_data_init(*scene);
 
-        // Second pass over the model to load textures and set up immutable descriptor sets.
-        for (int node_index : scene.nodes) {
-            const tinygltf::Node& scene_node(model.nodes.at(node_index));
-            gltf_load_immutable_state(scene_node, load_state);
+        if (!scene->skin_jobs.empty()) {
+            skinning_init(*scene, merged.skin_vertices, skinned_vertex_count);
         }
 
-        // This might be an append later on.
-        m_draws = load_state.draws;
+        if (m_options.cluster_culling) {
+            cluster_culling_init(*scene, merged.clusters);
+        }
+
+        return (scene);
     }
 
     void application::gltf_load_node(
-        const tinygltf::Node& node,
-        const glm::mat4& parent_transform,
+        int node_index,
+        uint32_t parent_transform_index,
         gltf_load_state& load_state)
     {
-        glm::mat4 node_transform(1.0f);
+        const tinygltf::Node& node(load_state.model.nodes.at(node_index));
+
+        // Children are added after their parent, which keeps the hierarchy sorted.
+        uint32_t transform_index;
         if (node.matrix.size() == 16) {
+            glm::mat4 node_transform(1.0f);
             for (int col = 0; col < 4; ++col) {
                 for (int row = 0; row < 4; ++row) {
                     node_transform[col][row] = static_cast<glm::mat4::value_type>(node.matrix[(col * 4) + row]);
                 }
             }
+            transform_index = load_state.scene.transforms.add(parent_transform_index, node_transform);
         }
         else {
             glm::vec3 node_translation(0.0f, 0.0f, 0.0f);
@@ -1616,22 +3319,18 @@ namespace gtb {
                 }
             }
 
-            node_transform =
-                glm::translate(node_translation) * // Translate to final position
-                glm::scale(node_scale) *
-                glm::mat4_cast(node_rotation);
+            transform_index = load_state.scene.transforms.add(parent_transform_index, node_translation, node_rotation, node_scale);
         }
-        node_transform *= parent_transform;
+        load_state.node_transforms[node_index] = transform_index;
 
         if (node.mesh != -1) {
             const tinygltf::Mesh& mesh = load_state.model.meshes.at(node.mesh);
-            for (const tinygltf::Primitive& primitive : mesh.primitives) {
+            for (int primitive_index = 0; primitive_index < static_cast<int>(mesh.primitives.size()); ++primitive_index) {
                 draw_record node_draw;
-                node_draw.transform = node_transform;
-
-                gltf_load_ibo(node_draw, primitive, load_state);
-                gltf_load_vbo(node_draw, primitive, load_state);
+                node_draw.transform_index = transform_index;
+                node_draw.skin = node.skin;
 
+                load_state.draw_primitives.push_back(gltf_load_primitive(node.mesh, primitive_index, load_state));
                 load_state.draws.push_back(node_draw);
             }
         }
@@ -1662,78 +3361,284 @@ namespace gtb {
                     camera.orthographic.zfar);
             }
 
-            m_camera_transform = projection_transform * node_transform;
+            // Applied once world transforms are known.
+            load_state.camera_node = transform_index;
+            load_state.camera_projection = projection_transform;
         }
 
-        for (int node_index : node.children) {
-            const tinygltf::Node& child_node(load_state.model.nodes.at(node_index));
-            gltf_load_node(child_node, node_transform, load_state);
+        for (int child_index : node.children) {
+            gltf_load_node(child_index, transform_index, load_state);
         }
     }
 
-    void application::gltf_load_ibo(
-        draw_record& node_draw,
-        const tinygltf::Primitive& primitive,
-        gltf_load_state& load_state)
+    void application::gltf_load_animations(gltf_load_state& load_state)
     {
-        // Index buffer
-        const tinygltf::Accessor& index_accessor = load_state.model.accessors.at(primitive.indices);
+        const tinygltf::Model& model(load_state.model);
+        loaded_scene& scene(load_state.scene);
+
+        load_state.animated_transforms.assign(scene.transforms.size(), false);
+
+        for (const tinygltf::Animation& gltf_animation : model.animations) {
+            animation::clip clip;
+            for (const tinygltf::AnimationChannel& gltf_channel : gltf_animation.channels) {
+                // Morph target weights are not supported, nor are nodes outside the loaded scene.
+                animation::channel c;
+                if (gltf_channel.target_path == "translation") {
+                    c.path = animation::target_path::translation;
+                }
+                else if (gltf_channel.target_path == "rotation") {
+                    c.path = animation::target_path::rotation;
+                }
+                else if (gltf_channel.target_path == "scale") {
+                    c.path = animation::target_path::scale;
+                }
+                else {
+                    continue;
+                }
 
-        loaded_buffer_map::iterator loaded_buffer(load_state.loaded_ibo.find(index_accessor.bufferView));
-        if (loaded_buffer != load_state.loaded_ibo.end()) {
-            node_draw.ibo = loaded_buffer->second;
-        }
-        else {
-            const tinygltf::BufferView& index_buffer_view = load_state.model.bufferViews.at(index_accessor.bufferView);
-            const tinygltf::Buffer& index_buffer = load_state.model.buffers.at(index_buffer_view.buffer);
+                if ((gltf_channel.target_node < 0) ||
+                    (load_state.node_transforms.at(gltf_channel.target_node) == transform_hierarchy::no_parent)) {
+                    continue;
+                }
+                c.transform_index = load_state.node_transforms[gltf_channel.target_node];
 
-            device_buffer_vector::iterator device_buffer(create_static_buffer(
-                vk::BufferUsageFlagBits::eIndexBuffer,
-                index_buffer.data.data() + index_buffer_view.byteOffset,
-                index_buffer_view.byteLength));
-            uint8_t device_buffer_index = static_cast<uint8_t>(device_buffer - m_static_buffers.begin());
+                const tinygltf::AnimationSampler& sampler(gltf_animation.samplers.at(gltf_channel.sampler));
+                if (sampler.interpolation == "STEP") {
+                    c.mode = animation::interpolation::step;
+                }
+                else if (sampler.interpolation == "CUBICSPLINE") {
+                    c.mode = animation::interpolation::cubic_spline;
+                }
+                else {
+                    c.mode = animation::interpolation::linear;
+                }
+
+                const tinygltf::Accessor& time_accessor(model.accessors.at(sampler.input));
+                const tinygltf::Accessor& value_accessor(model.accessors.at(sampler.output));
+                size_t values_per_key = (c.mode == animation::interpolation::cubic_spline) ? 3 : 1;
+                if ((time_accessor.count == 0) || (value_accessor.count != (time_accessor.count * values_per_key))) {
+                    continue;
+                }
+
+                c.times.reserve(time_accessor.count);
+                for (size_t k = 0; k < time_accessor.count; ++k) {
+                    c.times.push_back(gltf_read_vec4(model, time_accessor, k, true).x);
+                }
 
-            load_state.loaded_ibo.emplace(index_accessor.bufferView, device_buffer_index);
-            node_draw.ibo = device_buffer_index;
+                c.values.reserve(value_accessor.count);
+                for (size_t v = 0; v < value_accessor.count; ++v) {
+                    c.values.push_back(gltf_read_vec4(model, value_accessor, v, true));
+                }
+
+                load_state.animated_transforms[c.transform_index] = true;
+                clip.add_channel(std::move(c));
+            }
+
+            if (!clip.empty()) {
+                scene.animations.emplace_back(std::move(clip));
+            }
         }
 
-        // Draw parameters also come from index information.
-        node_draw.first_index = static_cast<uint32_t>(index_accessor.byteOffset / gltf_component_size(index_accessor.componentType));
-        node_draw.index_count = static_cast<uint32_t>(index_accessor.count);
-        node_draw.vertex_offset = 0;
+        // Children of animated nodes move with them; parents always come first.
+        for (uint32_t i = 0; i < scene.transforms.size(); ++i) {
+            uint32_t parent = scene.transforms.parent(i);
+            if ((parent != transform_hierarchy::no_parent) && load_state.animated_transforms[parent]) {
+                load_state.animated_transforms[i] = true;
+            }
+        }
     }
 
-    void application::gltf_load_vbo(
-        draw_record& node_draw,
-        const tinygltf::Primitive& primitive,
-        gltf_load_state& load_state)
+    void application::gltf_load_skins(gltf_load_state& load_state)
     {
-        const tinygltf::Accessor& index_accessor = load_state.model.accessors.at(primitive.indices);
-        uint32_t count = static_cast<uint32_t>(index_accessor.count);
-
-        std::vector<vertex> vbo_data;
-        vbo_data.reserve(count);
+        const tinygltf::Model& model(load_state.model);
+        loaded_scene& scene(load_state.scene);
+
+        for (const tinygltf::Skin& gltf_skin : model.skins) {
+            skin_record skin;
+            skin.first_joint = scene.joint_count;
+
+            // Joints outside the loaded scene stay at the origin.
+            skin.joints.reserve(gltf_skin.joints.size());
+            for (int joint_node : gltf_skin.joints) {
+                uint32_t transform_index = load_state.node_transforms.at(joint_node);
+                skin.joints.push_back((transform_index == transform_hierarchy::no_parent) ? 0 : transform_index);
+            }
 
-        // gltf supports flexible attrib arrays that need to be packed into the vbo
-        uint32_t position_accessor_index = primitive.attributes.at("POSITION");
-        uint32_t normal_accessor_index = primitive.attributes.at("NORMAL");
-        uint32_t texcoord_accessor_index = primitive.attributes.at("TEXCOORD_0");
-        uint32_t tangent_accessor_index = primitive.attributes.at("TANGENT");
+            // Without inverse bind matrices every joint is bound at the origin.
+            skin.inverse_bind_matrices.assign(skin.joints.size(), glm::mat4(1.0f));
+            if (gltf_skin.inverseBindMatrices >= 0) {
+                const tinygltf::Accessor& accessor = model.accessors.at(gltf_skin.inverseBindMatrices);
+                const tinygltf::BufferView& buffer_view = model.bufferViews.at(accessor.bufferView);
+                const tinygltf::Buffer& buffer = model.buffers.at(buffer_view.buffer);
+
+                const unsigned char* base_pointer = buffer.data.data() + buffer_view.byteOffset + accessor.byteOffset;
+                size_t stride = (buffer_view.byteStride == 0) ? sizeof(glm::mat4) : buffer_view.byteStride;
+                size_t count = std::min(accessor.count, skin.inverse_bind_matrices.size());
+                for (size_t j = 0; j < count; ++j) {
+                    std::memcpy(&skin.inverse_bind_matrices[j][0][0], base_pointer + (stride * j), sizeof(glm::mat4));
+                }
+            }
 
-        const tinygltf::Accessor& position_accessor = load_state.model.accessors.at(position_accessor_index);
-        const tinygltf::Accessor& normal_accessor = load_state.model.accessors.at(normal_accessor_index);
-        const tinygltf::Accessor& texcoord_accessor = load_state.model.accessors.at(texcoord_accessor_index);
-        const tinygltf::Accessor& tangent_accessor = load_state.model.accessors.at(tangent_accessor_index);
+            scene.joint_count += static_cast<uint32_t>(skin.joints.size());
+            scene.skins.emplace_back(std::move(skin));
+        }
+    }
 
-        const tinygltf::BufferView& position_buffer_view = load_state.model.bufferViews.at(position_accessor.bufferView);
-        const tinygltf::BufferView& normal_buffer_view = load_state.model.bufferViews.at(normal_accessor.bufferView);
-        const tinygltf::BufferView& texcoord_buffer_view = load_state.model.bufferViews.at(texcoord_accessor.bufferView);
-        const tinygltf::BufferView& tangent_buffer_view = load_state.model.bufferViews.at(tangent_accessor.bufferView);
+    // static
+    glm::vec4 application::gltf_read_vec4(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t element, bool normalized)
+    {
+        const tinygltf::BufferView& buffer_view = model.bufferViews.at(accessor.bufferView);
+        const tinygltf::Buffer& buffer = model.buffers.at(buffer_view.buffer);
 
-        const tinygltf::Buffer& position_buffer = load_state.model.buffers.at(position_buffer_view.buffer);
-        const tinygltf::Buffer& normal_buffer = load_state.model.buffers.at(normal_buffer_view.buffer);
-        const tinygltf::Buffer& texcoord_buffer = load_state.model.buffers.at(texcoord_buffer_view.buffer);
-        const tinygltf::Buffer& tangent_buffer = load_state.model.buffers.at(tangent_buffer_view.buffer);
+        uint32_t component_count = 1;
+        switch (accessor.type) {
+        case TINYGLTF_TYPE_VEC2:
+            component_count = 2;
+            break;
+        case TINYGLTF_TYPE_VEC3:
+            component_count = 3;
+            break;
+        case TINYGLTF_TYPE_VEC4:
+            component_count = 4;
+            break;
+        }
+
+        uint32_t component_size = gltf_component_size(accessor.componentType);
+        size_t stride = (buffer_view.byteStride == 0) ? (component_size * component_count) : buffer_view.byteStride;
+        const unsigned char* pointer = buffer.data.data() + buffer_view.byteOffset + accessor.byteOffset + (stride * element);
+
+        // Integer components are normalized, as glTF allows for rotations and weights, unless they
+        // are indices such as joints.
+        glm::vec4 value(0.0f);
+        for (uint32_t i = 0; i < component_count; ++i) {
+            const unsigned char* component = pointer + (component_size * i);
+            if (!normalized) {
+                switch (accessor.componentType) {
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                    value[i] = static_cast<float>(*component);
+                    break;
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                    value[i] = static_cast<float>(*reinterpret_cast<const uint16_t*>(component));
+                    break;
+                }
+                continue;
+            }
+
+            switch (accessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_FLOAT:
+                value[i] = *reinterpret_cast<const float*>(component);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_BYTE:
+                value[i] = std::max(static_cast<float>(*reinterpret_cast<const int8_t*>(component)) / 127.0f, -1.0f);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                value[i] = static_cast<float>(*component) / 255.0f;
+                break;
+            case TINYGLTF_COMPONENT_TYPE_SHORT:
+                value[i] = std::max(static_cast<float>(*reinterpret_cast<const int16_t*>(component)) / 32767.0f, -1.0f);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                value[i] = static_cast<float>(*reinterpret_cast<const uint16_t*>(component)) / 65535.0f;
+                break;
+            }
+        }
+
+        return (value);
+    }
+
+    uint32_t application::gltf_load_primitive(
+        int mesh_index,
+        int primitive_index,
+        gltf_load_state& load_state)
+    {
+        // Meshes instanced by several nodes are only loaded once.
+        std::pair<int, int> key(mesh_index, primitive_index);
+        loaded_primitive_map::iterator loaded_primitive(load_state.loaded_primitives.find(key));
+        if (loaded_primitive != load_state.loaded_primitives.end()) {
+            return (loaded_primitive->second);
+        }
+
+        const tinygltf::Primitive& primitive = load_state.model.meshes.at(mesh_index).primitives.at(primitive_index);
+
+        primitive_data data;
+        gltf_load_vertices(primitive, data, load_state);
+        gltf_load_indices(primitive, data, load_state);
+        data.material = primitive.material;
+
+        uint32_t index = static_cast<uint32_t>(load_state.primitives.size());
+        load_state.primitives.emplace_back(std::move(data));
+        load_state.loaded_primitives.emplace(key, index);
+        return (index);
+    }
+
+    void application::gltf_load_indices(
+        const tinygltf::Primitive& primitive,
+        primitive_data& data,
+        gltf_load_state& load_state)
+    {
+        // Non-indexed primitives draw their vertices in order.
+        if (primitive.indices < 0) {
+            data.indices.resize(data.vertices.size());
+            for (uint32_t i = 0; i < data.indices.size(); ++i) {
+                data.indices[i] = i;
+            }
+            return;
+        }
+
+        const tinygltf::Accessor& index_accessor = load_state.model.accessors.at(primitive.indices);
+        const tinygltf::BufferView& index_buffer_view = load_state.model.bufferViews.at(index_accessor.bufferView);
+        const tinygltf::Buffer& index_buffer = load_state.model.buffers.at(index_buffer_view.buffer);
+
+        const unsigned char* index_base_pointer = index_buffer.data.data() + index_buffer_view.byteOffset + index_accessor.byteOffset;
+        uint32_t index_stride = gltf_component_size(index_accessor.componentType);
+
+        data.indices.reserve(index_accessor.count);
+        for (size_t i = 0; i < index_accessor.count; ++i) {
+            const unsigned char* index_pointer = index_base_pointer + (index_stride * i);
+            switch (index_accessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                data.indices.push_back(*index_pointer);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                data.indices.push_back(*reinterpret_cast<const uint16_t*>(index_pointer));
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                data.indices.push_back(*reinterpret_cast<const uint32_t*>(index_pointer));
+                break;
+            }
+        }
+    }
+
+    void application::gltf_load_vertices(
+        const tinygltf::Primitive& primitive,
+        primitive_data& data,
+        gltf_load_state& load_state)
+    {
+        // gltf supports flexible attrib arrays that need to be packed into the vbo
+        uint32_t position_accessor_index = primitive.attributes.at("POSITION");
+        uint32_t normal_accessor_index = primitive.attributes.at("NORMAL");
+        uint32_t texcoord_accessor_index = primitive.attributes.at("TEXCOORD_0");
+        uint32_t tangent_accessor_index = primitive.attributes.at("TANGENT");
+
+        const tinygltf::Accessor& position_accessor = load_state.model.accessors.at(position_accessor_index);
+        uint32_t count = static_cast<uint32_t>(position_accessor.count);
+
+        std::vector<vertex>& vbo_data(data.vertices);
+        vbo_data.reserve(count);
+
+        const tinygltf::Accessor& normal_accessor = load_state.model.accessors.at(normal_accessor_index);
+        const tinygltf::Accessor& texcoord_accessor = load_state.model.accessors.at(texcoord_accessor_index);
+        const tinygltf::Accessor& tangent_accessor = load_state.model.accessors.at(tangent_accessor_index);
+
+        const tinygltf::BufferView& position_buffer_view = load_state.model.bufferViews.at(position_accessor.bufferView);
+        const tinygltf::BufferView& normal_buffer_view = load_state.model.bufferViews.at(normal_accessor.bufferView);
+        const tinygltf::BufferView& texcoord_buffer_view = load_state.model.bufferViews.at(texcoord_accessor.bufferView);
+        const tinygltf::BufferView& tangent_buffer_view = load_state.model.bufferViews.at(tangent_accessor.bufferView);
+
+        const tinygltf::Buffer& position_buffer = load_state.model.buffers.at(position_buffer_view.buffer);
+        const tinygltf::Buffer& normal_buffer = load_state.model.buffers.at(normal_buffer_view.buffer);
+        const tinygltf::Buffer& texcoord_buffer = load_state.model.buffers.at(texcoord_buffer_view.buffer);
+        const tinygltf::Buffer& tangent_buffer = load_state.model.buffers.at(tangent_buffer_view.buffer);
 
         const unsigned char* position_base_pointer = position_buffer.data.data() + position_buffer_view.byteOffset + position_accessor.byteOffset;
         const unsigned char* normal_base_pointer = normal_buffer.data.data() + normal_buffer_view.byteOffset + normal_accessor.byteOffset;
@@ -1766,9 +3671,12 @@ namespace gtb {
             vertex vert;
 
             vert.position = *reinterpret_cast<const glm::vec3*>(position_base_pointer + (position_stride * v));
-            vert.tangent_space_basis.x = *reinterpret_cast<const glm::vec3*>(normal_base_pointer + (normal_stride * v));
-            vert.tangent_space_basis.y = (*reinterpret_cast<const glm::vec4*>(tangent_base_pointer + (tangent_stride * v))).xyz;
-            // TODO: Work out the rest of the tangent space basis
+
+            glm::vec4 tangent_frame(qtangent_encode(
+                *reinterpret_cast<const glm::vec3*>(normal_base_pointer + (normal_stride * v)),
+                *reinterpret_cast<const glm::vec4*>(tangent_base_pointer + (tangent_stride * v)),
+                qtangent_snorm16_bias));
+            vert.tangent_frame = glm::i16vec4(glm::round(tangent_frame * 32767.0f));
 
             switch (texcoord_accessor.componentType) {
             case TINYGLTF_COMPONENT_TYPE_FLOAT:
@@ -1787,369 +3695,3261 @@ namespace gtb {
             vbo_data.push_back(vert);
         }
 
-        device_buffer_vector::iterator device_buffer(create_static_buffer(
-            vk::BufferUsageFlagBits::eVertexBuffer,
-            vbo_data.data(),
-            vbo_data.size() * sizeof(vertex)));
-        uint8_t device_buffer_index = static_cast<uint8_t>(device_buffer - m_static_buffers.begin());
+        // Only the first set of joint influences is used.
+        std::map<std::string, int>::const_iterator joints_attribute(primitive.attributes.find("JOINTS_0"));
+        std::map<std::string, int>::const_iterator weights_attribute(primitive.attributes.find("WEIGHTS_0"));
+        if ((joints_attribute == primitive.attributes.end()) || (weights_attribute == primitive.attributes.end())) {
+            return;
+        }
+
+        const tinygltf::Accessor& joints_accessor = load_state.model.accessors.at(joints_attribute->second);
+        const tinygltf::Accessor& weights_accessor = load_state.model.accessors.at(weights_attribute->second);
+
+        data.skin.reserve(count);
+        for (uint32_t v = 0; v < count; ++v) {
+            skin_influence influence;
+            influence.joints = glm::u16vec4(gltf_read_vec4(load_state.model, joints_accessor, v, false));
+            influence.weights = gltf_read_vec4(load_state.model, weights_accessor, v, true);
+
+            // Weights should sum to one already; quantized ones rarely do exactly.
+            float weight_sum = influence.weights.x + influence.weights.y + influence.weights.z + influence.weights.w;
+            if (weight_sum > 0.0f) {
+                influence.weights /= weight_sum;
+            }
 
-        node_draw.vbo = device_buffer_index;
+            data.skin.push_back(influence);
+        }
     }
 
-    void application::gltf_load_immutable_state(
-        const tinygltf::Node& node,
-        gltf_load_state& load_state)
+    void application::pack_primitive(
+        const primitive_data& data,
+        geometry_record& geometry,
+        merged_geometry& merged) const
     {
-        if (node.mesh == -1) {
-            return;
+        const std::vector<vertex>& vbo_data(data.vertices);
+
+        // Use the compact layout when quantizing against the mesh bounds and storing half float
+        // texture coordinates loses nothing visible.
+        glm::vec3 position_min(std::numeric_limits<float>::max());
+        glm::vec3 position_max(-std::numeric_limits<float>::max());
+        float tex_coord_max = 0.0f;
+        for (const vertex& vert : vbo_data) {
+            position_min = glm::min(position_min, vert.position);
+            position_max = glm::max(position_max, vert.position);
+            tex_coord_max = std::max(tex_coord_max, std::max(std::abs(vert.tex_coord.x), std::abs(vert.tex_coord.y)));
         }
 
-        const tinygltf::Mesh& mesh = load_state.model.meshes.at(node.mesh);
-        for (const tinygltf::Primitive& primitive : mesh.primitives) {
-            const tinygltf::Material& material = load_state.model.materials.at(primitive.material);
+        glm::vec3 position_extent(glm::max(position_max - position_min, glm::vec3(0.0f)));
+        geometry.bounds_center = vbo_data.empty() ? glm::vec3(0.0f) : ((position_min + position_max) * 0.5f);
+        geometry.bounds_radius = glm::length(position_extent) * 0.5f;
+
+        float position_error = std::max(position_extent.x, std::max(position_extent.y, position_extent.z)) / (2.0f * 65535.0f);
+
+        bool split = m_options.split_vertex_streams;
+        geometry.skinned = !data.skin.empty();
+        if (geometry.skinned) {
+            // Skinned vertices only go to the skinning input. What the graphics pipelines read is the
+            // full layout in world space, where the bind pose bounds no longer hold.
+            geometry.vertex_offset = static_cast<int32_t>(merged.skin_vertices.size());
+            for (size_t v = 0; v < vbo_data.size(); ++v) {
+                skin_vertex skin_vert;
+                skin_vert.position = glm::vec4(vbo_data[v].position, 1.0f);
+                skin_vert.tangent_frame = glm::max(glm::vec4(vbo_data[v].tangent_frame) / 32767.0f, -1.0f);
+                skin_vert.weights = data.skin[v].weights;
+                skin_vert.joints = glm::uvec4(data.skin[v].joints);
+                skin_vert.tex_coord = vbo_data[v].tex_coord;
+                skin_vert.unused = glm::vec2(0.0f);
+                merged.skin_vertices.push_back(skin_vert);
+            }
 
-            int color_texture_index = material.values.at("baseColorTexture").TextureIndex();
-            const tinygltf::Texture& color_texture = load_state.model.textures.at(color_texture_index);
-            const tinygltf::Image& color_texture_image = load_state.model.images.at(color_texture.source);
+            geometry.format = vertex_format::full;
+            geometry.position_scale = glm::vec3(1.0f);
+            geometry.position_bias = glm::vec3(0.0f);
+            geometry.bounds_radius = std::numeric_limits<float>::max();
+        }
+        else if (!vbo_data.empty() &&
+            (position_error <= compact_vertex_position_tolerance) &&
+            (tex_coord_max < compact_vertex_tex_coord_range)) {
+            // Degenerate extents still need a valid divisor.
+            glm::vec3 quantize_scale(
+                (position_extent.x > 0.0f) ? (65535.0f / position_extent.x) : 0.0f,
+                (position_extent.y > 0.0f) ? (65535.0f / position_extent.y) : 0.0f,
+                (position_extent.z > 0.0f) ? (65535.0f / position_extent.z) : 0.0f);
+
+            std::vector<compact_vertex> compact_vbo_data;
+            std::vector<glm::u16vec4> position_data;
+            std::vector<compact_vertex_attributes> attribute_data;
+            compact_vbo_data.reserve(split ? 0 : vbo_data.size());
+            position_data.reserve(split ? vbo_data.size() : 0);
+            attribute_data.reserve(split ? vbo_data.size() : 0);
+            for (const vertex& vert : vbo_data) {
+                compact_vertex compact_vert;
+
+                glm::vec3 quantized(glm::round((vert.position - position_min) * quantize_scale));
+                compact_vert.position = glm::u16vec4(glm::clamp(quantized, glm::vec3(0.0f), glm::vec3(65535.0f)), 0.0f);
+
+                // The snorm8 qtangent needs a larger bias to keep the reflection sign.
+                glm::vec4 tangent_frame(glm::max(glm::vec4(vert.tangent_frame) / 32767.0f, -1.0f));
+                compact_vert.tangent_frame = glm::packSnorm4x8(qtangent_bias(tangent_frame, qtangent_snorm8_bias));
+
+                compact_vert.tex_coord = glm::u16vec2(glm::packHalf1x16(vert.tex_coord.x), glm::packHalf1x16(vert.tex_coord.y));
+
+                if (split) {
+                    compact_vertex_attributes attributes;
+                    attributes.tangent_frame = compact_vert.tangent_frame;
+                    attributes.tex_coord = compact_vert.tex_coord;
+
+                    position_data.push_back(compact_vert.position);
+                    attribute_data.push_back(attributes);
+                }
+                else {
+                    compact_vbo_data.push_back(compact_vert);
+                }
+            }
 
-            device_image_vector::iterator texture_image(create_texture(color_texture_image.uri));
+            size_t f = static_cast<size_t>(vertex_format::compact);
+            if (split) {
+                geometry.vertex_offset = append_stream(merged.vertices[f], position_data);
+                append_stream(merged.attributes[f], attribute_data);
+            }
+            else {
+                geometry.vertex_offset = append_stream(merged.vertices[f], compact_vbo_data);
+            }
 
-            // Write the immutable state binding information into the set for this draw.
-            vk::DescriptorSet immutable_state_set = load_state.simple_immutable_sets[load_state.draw_index];
-            vk::DescriptorImageInfo descriptor_image_info[1];
-            vk::WriteDescriptorSet write_descriptor_set[1];
+            geometry.format = vertex_format::compact;
+            geometry.position_scale = position_extent; // unorm attributes arrive in [0, 1]
+            geometry.position_bias = position_min;
+        }
+        else {
+            size_t f = static_cast<size_t>(vertex_format::full);
+            if (split) {
+                std::vector<glm::vec3> position_data;
+                std::vector<vertex_attributes> attribute_data;
+                position_data.reserve(vbo_data.size());
+                attribute_data.reserve(vbo_data.size());
+                for (const vertex& vert : vbo_data) {
+                    vertex_attributes attributes;
+                    attributes.tangent_frame = vert.tangent_frame;
+                    attributes.tex_coord = vert.tex_coord;
+
+                    position_data.push_back(vert.position);
+                    attribute_data.push_back(attributes);
+                }
 
-            descriptor_image_info[0].sampler = m_bilinear_sampler;
-            descriptor_image_info[0].imageView = texture_image->view;
-            descriptor_image_info[0].imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                geometry.vertex_offset = append_stream(merged.vertices[f], position_data);
+                append_stream(merged.attributes[f], attribute_data);
+            }
+            else {
+                geometry.vertex_offset = append_stream(merged.vertices[f], vbo_data);
+            }
 
-            write_descriptor_set[0].dstSet = immutable_state_set;
-            write_descriptor_set[0].dstBinding = 1;
-            write_descriptor_set[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-            write_descriptor_set[0].descriptorCount = 1;
-            write_descriptor_set[0].pImageInfo = &descriptor_image_info[0];
+            geometry.format = vertex_format::full;
+            geometry.position_scale = glm::vec3(1.0f);
+            geometry.position_bias = glm::vec3(0.0f);
+        }
 
-            m_device.updateDescriptorSets(_countof(write_descriptor_set), write_descriptor_set, 0, nullptr, m_dispatch);
+        // Simplified levels of detail index the same vertices. Errors measured in the bind pose would
+        // not hold for skinned primitives, so they only have full detail.
+        std::vector<std::vector<uint32_t>> lod_indices(1, data.indices);
+        std::vector<float> lod_errors(1, 0.0f);
+        if (m_options.lod && !geometry.skinned) {
+            std::vector<glm::vec3> positions;
+            positions.reserve(vbo_data.size());
+            for (const vertex& vert : vbo_data) {
+                positions.push_back(vert.position);
+            }
+
+            while ((lod_indices.size() < lod_max_levels) && (lod_indices.back().size() >= (lod_min_triangles * 3 * 2))) {
+                const std::vector<uint32_t>& previous(lod_indices.back());
+
+                std::vector<uint32_t> simplified;
+                float error = simplify::simplify(positions, previous, previous.size() / 2, simplified);
+                if (simplified.size() > ((previous.size() * 9) / 10)) {
+                    break; // Stopped simplifying.
+                }
 
-            load_state.draws.at(load_state.draw_index).immutable_state = immutable_state_set;
-            load_state.draw_index++;
+                lod_errors.push_back(lod_errors.back() + error);
+                lod_indices.emplace_back(std::move(simplified));
+            }
+        }
+
+        // Indices are relative to vertex_offset, so nearly every primitive fits 16 bit indices. Cluster
+        // culling reads and writes indices in a compute shader, which needs them 32 bit.
+        bool index16 = !m_options.cluster_culling && (vbo_data.size() <= (std::numeric_limits<uint16_t>::max() + size_t(1)));
+        geometry.index_type = index16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+
+        geometry.lod_count = static_cast<uint32_t>(lod_indices.size());
+        for (uint32_t l = 0; l < geometry.lod_count; ++l) {
+            lod_record& lod(geometry.lods[l]);
+            lod.index_count = static_cast<uint32_t>(lod_indices[l].size());
+            lod.error = lod_errors[l];
+            if (index16) {
+                lod.first_index = static_cast<uint32_t>(merged.indices16.size());
+                for (uint32_t index : lod_indices[l]) {
+                    merged.indices16.push_back(static_cast<uint16_t>(index));
+                }
+            }
+            else {
+                lod.first_index = static_cast<uint32_t>(merged.indices32.size());
+                merged.indices32.insert(merged.indices32.end(), lod_indices[l].begin(), lod_indices[l].end());
+            }
         }
 
-        for (int node_index : node.children) {
-            const tinygltf::Node& child_node(load_state.model.nodes.at(node_index));
-            gltf_load_immutable_state(child_node, load_state);
+        geometry.index_count = geometry.lods[0].index_count;
+        geometry.first_index = geometry.lods[0].first_index;
+
+        // Clusters of every level, with first indices relative to the full detail range.
+        geometry.first_cluster = static_cast<uint32_t>(merged.clusters.size());
+        if (m_options.cluster_culling) {
+            for (uint32_t l = 0; l < geometry.lod_count; ++l) {
+                size_t first_level_cluster = merged.clusters.size();
+                build_clusters(vbo_data, lod_indices[l], merged.clusters);
+                for (size_t c = first_level_cluster; c < merged.clusters.size(); ++c) {
+                    merged.clusters[c].first_index += geometry.lods[l].first_index - geometry.first_index;
+                    merged.clusters[c].lod = l;
+
+                    // Skinned clusters move, so they are never culled.
+                    if (geometry.skinned) {
+                        merged.clusters[c].bounds.w = std::numeric_limits<float>::max();
+                        merged.clusters[c].cone.w = 1.0f;
+                    }
+                }
+            }
         }
+        geometry.cluster_count = static_cast<uint32_t>(merged.clusters.size()) - geometry.first_cluster;
     }
 
-    // static
-    bool application::gltf_load_image_data(
-        tinygltf::Image* /*image*/,
-        std::string* /*load_error*/,
-        std::string* /*load_warn*/,
-        int /*required_width*/,
-        int /*required_height*/,
-        const unsigned char* /*bytes*/,
-        int /*size*/,
-        void* user_data)
+    void application::merged_geometry_init(const merged_geometry& merged, loaded_scene& scene)
     {
-        application* app = static_cast<application*>(user_data);
-        app;
+        for (size_t f = 0; f < vertex_format_count; ++f) {
+            if (!merged.vertices[f].empty()) {
+                scene.buffers.push_back(create_static_buffer(
+                    vk::BufferUsageFlagBits::eVertexBuffer,
+                    merged.vertices[f].data(),
+                    merged.vertices[f].size()));
+                scene.vertex_buffers[f] = scene.buffers.back().buffer;
+            }
 
-        return (true);
+            if (!merged.attributes[f].empty()) {
+                scene.buffers.push_back(create_static_buffer(
+                    vk::BufferUsageFlagBits::eVertexBuffer,
+                    merged.attributes[f].data(),
+                    merged.attributes[f].size()));
+                scene.attribute_buffers[f] = scene.buffers.back().buffer;
+            }
+        }
+
+        if (!merged.indices16.empty()) {
+            scene.buffers.push_back(create_static_buffer(
+                vk::BufferUsageFlagBits::eIndexBuffer,
+                merged.indices16.data(),
+                merged.indices16.size() * sizeof(uint16_t)));
+            scene.index_buffers[0] = scene.buffers.back().buffer;
+        }
+
+        if (!merged.indices32.empty()) {
+            scene.buffers.push_back(create_static_buffer(
+                vk::BufferUsageFlagBits::eIndexBuffer | (m_options.cluster_culling ? vk::BufferUsageFlagBits::eStorageBuffer : vk::BufferUsageFlags()),
+                merged.indices32.data(),
+                merged.indices32.size() * sizeof(uint32_t)));
+            scene.index_buffers[1] = scene.buffers.back().buffer;
+        }
     }
 
     // static
-    uint32_t application::gltf_component_size(int component)
+    size_t application::merged_geometry_size(const merged_geometry& merged)
     {
-        switch (component) {
-        case TINYGLTF_COMPONENT_TYPE_BYTE:
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-            return (1);
-        case TINYGLTF_COMPONENT_TYPE_SHORT:
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-            return (2);
-        case TINYGLTF_COMPONENT_TYPE_INT:
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-        case TINYGLTF_COMPONENT_TYPE_FLOAT:
-            return (4);
-        case TINYGLTF_COMPONENT_TYPE_DOUBLE:
-            return (8);
+        size_t size = (merged.indices16.size() * sizeof(uint16_t)) + (merged.indices32.size() * sizeof(uint32_t));
+        for (size_t f = 0; f < vertex_format_count; ++f) {
+            size += merged.vertices[f].size() + merged.attributes[f].size();
         }
-        return (0);
+        return (size);
     }
 
-    vk::CommandBuffer application::create_one_time_command_buffer()
+    void application::gltf_weld(gltf_load_state& load_state)
     {
-        vk::CommandBufferAllocateInfo command_buffer_allocate_info;
-        command_buffer_allocate_info.commandPool = m_command_pool;
-        command_buffer_allocate_info.level = vk::CommandBufferLevel::ePrimary;
-        command_buffer_allocate_info.commandBufferCount = 1;
-        vk::CommandBuffer one_time_command_buffer = m_device.allocateCommandBuffers(command_buffer_allocate_info, m_dispatch)[0];
-
-        vk::CommandBufferBeginInfo begin_info;
-        begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-        one_time_command_buffer.begin(begin_info, m_dispatch);
+        std::vector<size_t> removed_vertices(load_state.primitives.size(), 0);
+        m_thread_pool.parallel_for(load_state.primitives.size(), [&](size_t i) {
+            // Welding would need to compare joint influences too; skinned primitives are left alone.
+            primitive_data& data(load_state.primitives[i]);
+            if (data.skin.empty()) {
+                removed_vertices[i] = weld_vertices(data.vertices, data.indices, m_options.weld_tolerance);
+            }
+        });
+
+        // Report per mesh; every loaded primitive still maps back to its mesh here.
+        std::map<int, size_t> mesh_bytes_saved;
+        size_t total_bytes_saved = 0;
+        for (const loaded_primitive_map::value_type& loaded_primitive : load_state.loaded_primitives) {
+            size_t bytes_saved = removed_vertices[loaded_primitive.second] * sizeof(vertex);
+            mesh_bytes_saved[loaded_primitive.first.first] += bytes_saved;
+            total_bytes_saved += bytes_saved;
+        }
 
-        return (one_time_command_buffer);
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        for (const std::pair<const int, size_t>& mesh : mesh_bytes_saved) {
+            m_log_stream
+                << "Welding mesh " << mesh.first << " (" << load_state.model.meshes.at(mesh.first).name << "): "
+                << mesh.second << " bytes saved" << std::endl;
+        }
+        m_log_stream << "Welding: " << total_bytes_saved << " bytes saved in total" << std::endl;
     }
 
-    void application::finish_one_time_command_buffer(vk::CommandBuffer cmd_buffer)
+    void application::gltf_static_batch(gltf_load_state& load_state)
     {
-        cmd_buffer.end(m_dispatch);
+        // Primitives drawn by more than one node are instanced, and animated or skinned ones move; all
+        // keep their own draws.
+        std::vector<uint32_t> primitive_use_count(load_state.primitives.size(), 0);
+        for (uint32_t p : load_state.draw_primitives) {
+            primitive_use_count[p]++;
+        }
 
-        // Submit the command buffer.
-        vk::SubmitInfo submit_info;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &cmd_buffer;
-        m_queue.submit(submit_info, nullptr, m_dispatch);
+        // World space centers of the candidates size the chunk grid.
+        std::vector<uint32_t> candidates;
+        std::vector<glm::vec3> candidate_centers;
+        glm::vec3 scene_min(std::numeric_limits<float>::max());
+        glm::vec3 scene_max(-std::numeric_limits<float>::max());
+        for (uint32_t i = 0; i < load_state.draws.size(); ++i) {
+            const primitive_data& data(load_state.primitives[load_state.draw_primitives[i]]);
+            if ((primitive_use_count[load_state.draw_primitives[i]] != 1) || data.vertices.empty() || !data.skin.empty() ||
+                load_state.animated_transforms[load_state.draws[i].transform_index]) {
+                continue;
+            }
 
-        // Finish it by waiting for queue idle.
-        m_queue.waitIdle(m_dispatch);
-    }
+            glm::vec3 position_min(std::numeric_limits<float>::max());
+            glm::vec3 position_max(-std::numeric_limits<float>::max());
+            for (const vertex& vert : data.vertices) {
+                position_min = glm::min(position_min, vert.position);
+                position_max = glm::max(position_max, vert.position);
+            }
 
-    void application::cleanup_one_time_command_buffer(vk::CommandBuffer cmd_buffer)
-    {
-        m_device.freeCommandBuffers(m_command_pool, cmd_buffer, m_dispatch);
-    }
+            const glm::mat4& transform(load_state.scene.transforms.world(load_state.draws[i].transform_index));
+            glm::vec3 center(transform * glm::vec4((position_min + position_max) * 0.5f, 1.0f));
+            scene_min = glm::min(scene_min, center);
+            scene_max = glm::max(scene_max, center);
 
-    application::device_buffer_vector::iterator application::create_static_buffer(
-        vk::BufferUsageFlags flags,
-        const void* data,
-        size_t sizeof_data)
-    {
-        // Need a staging buffer to upload the data from.
-        device_buffer staging_buffer = create_device_buffer(vk::BufferUsageFlagBits::eTransferSrc, sizeof_data, staging_memory_properties);
+            candidates.push_back(i);
+            candidate_centers.push_back(center);
+        }
 
-        // Write the data to the staging buffer.
-        void* mapped_staging_memory = m_device.mapMemory(staging_buffer.device_memory, 0, sizeof_data, vk::MemoryMapFlags(), m_dispatch);
-        memcpy(mapped_staging_memory, data, sizeof_data);
-        m_device.unmapMemory(staging_buffer.device_memory, m_dispatch);
+        glm::vec3 scene_extent(glm::max(scene_max - scene_min, glm::vec3(0.0f)));
+        float cell_size = std::max(scene_extent.x, std::max(scene_extent.y, scene_extent.z)) / static_cast<float>(static_batch_grid_cells);
 
-        // Optimized buffer for actual GPU use.
-        device_buffer optimized_buffer = create_device_buffer(flags | vk::BufferUsageFlagBits::eTransferDst, sizeof_data, optimized_memory_properties);
+        static_batch_map batches;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            glm::uvec3 cell(0);
+            if (cell_size > 0.0f) {
+                cell = glm::uvec3(glm::clamp((candidate_centers[c] - scene_min) / cell_size, glm::vec3(0.0f), glm::vec3(static_batch_grid_cells - 1)));
+            }
 
-        // Record a command buffer to copy the staging buffer to the optimized buffer.
-        vk::CommandBuffer copy_command_buffer = create_one_time_command_buffer();
+            uint32_t cell_index = cell.x + (static_batch_grid_cells * (cell.y + (static_batch_grid_cells * cell.z)));
+            int material = load_state.primitives[load_state.draw_primitives[candidates[c]]].material;
+            batches[std::make_pair(material, cell_index)].push_back(candidates[c]);
+        }
 
-        vk::BufferCopy copy_region;
-        copy_region.size = sizeof_data;
-        copy_command_buffer.copyBuffer(staging_buffer.buffer, optimized_buffer.buffer, copy_region, m_dispatch);
+        // Measure what the batched draws cost before merging.
+        merged_geometry unbatched_geometry;
+        for (const static_batch_map::value_type& batch : batches) {
+            if (batch.second.size() > 1) {
+                for (uint32_t draw_index : batch.second) {
+                    geometry_record scratch;
+                    pack_primitive(load_state.primitives[load_state.draw_primitives[draw_index]], scratch, unbatched_geometry);
+                }
+            }
+        }
 
-        // TODO: Rather than finish here, we could wait at the end of the application constructor; will need to
-        // remember staging details to be freed there.
-        finish_one_time_command_buffer(copy_command_buffer);
+        std::vector<bool> batched_draws(load_state.draws.size(), false);
+        primitive_vector batched_primitives;
+        for (const static_batch_map::value_type& batch : batches) {
+            if (batch.second.size() < 2) {
+                continue;
+            }
 
-        // Cleanup.
-        cleanup_one_time_command_buffer(copy_command_buffer);
-        cleanup_device_buffer(staging_buffer);
+            // Every grid cell starts a new chunk.
+            size_t first_chunk = batched_primitives.size();
+            for (uint32_t draw_index : batch.second) {
+                const primitive_data& data(load_state.primitives[load_state.draw_primitives[draw_index]]);
+                if ((batched_primitives.size() == first_chunk) ||
+                    ((batched_primitives.back().vertices.size() + data.vertices.size()) > static_batch_max_vertices)) {
+                    batched_primitives.emplace_back();
+                    batched_primitives.back().material = batch.first.first;
+                }
+                primitive_data& chunk(batched_primitives.back());
+
+                // Pre-transform into world space; normals use the inverse transpose, and a reflecting
+                // transform flips both the bitangent sign and the triangle winding.
+                const glm::mat4& transform(load_state.scene.transforms.world(load_state.draws[draw_index].transform_index));
+                glm::mat3 tangent_transform(transform);
+                glm::mat3 normal_transform(glm::inverseTranspose(tangent_transform));
+                bool reflected = (glm::determinant(tangent_transform) < 0.0f);
+
+                uint32_t base_vertex = static_cast<uint32_t>(chunk.vertices.size());
+                for (const vertex& vert : data.vertices) {
+                    glm::vec3 normal;
+                    glm::vec4 tangent;
+                    qtangent_decode(glm::vec4(vert.tangent_frame) / 32767.0f, normal, tangent);
+
+                    vertex world_vert;
+                    world_vert.position = glm::vec3(transform * glm::vec4(vert.position, 1.0f));
+                    glm::vec4 tangent_frame(qtangent_encode(
+                        normal_transform * normal,
+                        glm::vec4(tangent_transform * glm::vec3(tangent), reflected ? -tangent.w : tangent.w),
+                        qtangent_snorm16_bias));
+                    world_vert.tangent_frame = glm::i16vec4(glm::round(tangent_frame * 32767.0f));
+                    world_vert.tex_coord = vert.tex_coord;
+
+                    chunk.vertices.push_back(world_vert);
+                }
 
-        return (m_static_buffers.emplace(m_static_buffers.end(), optimized_buffer));
-    }
+                for (size_t i = 0; i < data.indices.size(); i += 3) {
+                    chunk.indices.push_back(base_vertex + data.indices[i]);
+                    chunk.indices.push_back(base_vertex + data.indices[i + (reflected ? 2 : 1)]);
+                    chunk.indices.push_back(base_vertex + data.indices[i + (reflected ? 1 : 2)]);
+                }
 
-    void application::static_buffers_cleanup()
-    {
-        for (device_buffer& b : m_static_buffers) {
-            cleanup_device_buffer(b);
+                batched_draws[draw_index] = true;
+            }
         }
-    }
 
-    application::device_buffer application::create_device_buffer(
-        vk::BufferUsageFlags flags,
-        size_t sizeof_data,
-        vk::MemoryPropertyFlags memory_properties)
-    {
-        device_buffer b;
+        if (batched_primitives.empty()) {
+            return;
+        }
 
-        // Create buffer object
-        vk::BufferCreateInfo buffer_create_info;
-        buffer_create_info.size = sizeof_data;
-        buffer_create_info.usage = flags;
-        buffer_create_info.sharingMode = vk::SharingMode::eExclusive;
-        b.buffer = m_device.createBuffer(buffer_create_info, nullptr, m_dispatch);
+        merged_geometry batched_geometry;
+        for (const primitive_data& data : batched_primitives) {
+            geometry_record scratch;
+            pack_primitive(data, scratch, batched_geometry);
+        }
 
-        // Allocate memory for the buffer object.
-        vk::MemoryRequirements buffer_mem_reqs = m_device.getBufferMemoryRequirements(b.buffer, m_dispatch);
+        // Rebuild the draw list with the unbatched draws first, then one identity draw per chunk, and
+        // drop primitives nothing refers to anymore.
+        size_t draw_count = load_state.draws.size();
+        draw_vector draws;
+        std::vector<uint32_t> draw_primitives;
+        primitive_vector primitives;
+        std::vector<uint32_t> primitive_remap(load_state.primitives.size(), std::numeric_limits<uint32_t>::max());
+        for (size_t i = 0; i < draw_count; ++i) {
+            if (batched_draws[i]) {
+                continue;
+            }
 
-        vk::MemoryAllocateInfo buffer_alloc_info;
-        buffer_alloc_info.allocationSize = buffer_mem_reqs.size;
-        buffer_alloc_info.memoryTypeIndex = get_memory_type(buffer_mem_reqs.memoryTypeBits, memory_properties);
-        b.device_memory = m_device.allocateMemory(buffer_alloc_info, nullptr, m_dispatch);
-        m_device.bindBufferMemory(b.buffer, b.device_memory, 0, m_dispatch);
+            uint32_t& remapped = primitive_remap[load_state.draw_primitives[i]];
+            if (remapped == std::numeric_limits<uint32_t>::max()) {
+                remapped = static_cast<uint32_t>(primitives.size());
+                primitives.emplace_back(std::move(load_state.primitives[load_state.draw_primitives[i]]));
+            }
 
-        return (b);
+            draws.push_back(load_state.draws[i]);
+            draw_primitives.push_back(remapped);
+        }
+
+        for (primitive_data& data : batched_primitives) {
+            draw_record batch_draw;
+            batch_draw.transform_index = 0; // identity
+            batch_draw.skin = -1;
+
+            draws.push_back(batch_draw);
+            draw_primitives.push_back(static_cast<uint32_t>(primitives.size()));
+            primitives.emplace_back(std::move(data));
+        }
+
+        load_state.draws.swap(draws);
+        load_state.draw_primitives.swap(draw_primitives);
+        load_state.primitives.swap(primitives);
+        load_state.loaded_primitives.clear(); // indices no longer match
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Static batching: " << draw_count << " draws -> " << load_state.draws.size() << " draws, "
+            << "batched geometry " << merged_geometry_size(unbatched_geometry) << " -> "
+            << merged_geometry_size(batched_geometry) << " bytes" << std::endl;
     }
 
-    void application::cleanup_device_buffer(device_buffer& b)
+    void application::gltf_load_materials(gltf_load_state& load_state)
     {
-        m_device.destroyBuffer(b.buffer, nullptr, m_dispatch);
-        m_device.freeMemory(b.device_memory, nullptr, m_dispatch);
+        // Only materials that are drawn get a set.
+        std::vector<int> used_materials;
+        for (const primitive_data& data : load_state.primitives) {
+            used_materials.push_back(data.material);
+        }
+        std::sort(used_materials.begin(), used_materials.end());
+        used_materials.erase(std::unique(used_materials.begin(), used_materials.end()), used_materials.end());
+
+        if (used_materials.empty()) {
+            return;
+        }
+
+        // Base color image of each used material; an image used by several materials loads once.
+        std::vector<int> material_images;
+        material_images.reserve(used_materials.size());
+        for (int material_index : used_materials) {
+            const tinygltf::Material& material = load_state.model.materials.at(material_index);
+
+            int color_texture_index = material.values.at("baseColorTexture").TextureIndex();
+            material_images.push_back(load_state.model.textures.at(color_texture_index).source);
+        }
+
+        loaded_scene& scene(load_state.scene);
+        std::map<int, material_image> images;
+        texture_pack_map packs;
+        for (int image_index : material_images) {
+            if (images.count(image_index) > 0) {
+                continue;
+            }
+
+            const tinygltf::Image& color_texture_image = load_state.model.images.at(image_index);
+            material_image& image(images[image_index]);
+            if (color_texture_image.extras.Has("gtb_image_decode")) {
+                // Decoded images belong to this scene alone.
+                image_decode& decode(*load_state.image_decodes.at(color_texture_image.extras.Get("gtb_image_decode").Get<int>()));
+                image.name = color_texture_image.uri.empty() ?
+                    (scene.file_name + " image " + std::to_string(image_index)) : color_texture_image.uri;
+                if (decode.texels.empty()) {
+                    image.texture = create_decoded_texture(image.name, decode);
+                }
+                else {
+                    wait_for_decode(image.name, decode);
+                    image.texels = decode.texels;
+                }
+            }
+            else {
+                // Textures from files are shared with other scenes through the cache, unless packed.
+                image.name = color_texture_image.uri;
+                image.file = true;
+                image.write_time = file_write_time(image.name);
+                image.texture = find_texture(image.name, image.write_time, m_options.texture_arrays);
+
+                // Large textures are paged instead; the file is loaded once either way.
+                gli::texture gli_texture;
+                if (!image.texture && (m_options.virtual_texture_budget > 0)) {
+                    image.virtual_texture = create_virtual_texture(image.name, image.write_time, gli_texture);
+                }
+
+                if (image.virtual_texture) {
+                    image.texture = m_atlas_texture;
+                }
+                else if (!image.texture) {
+                    if (gli_texture.empty()) {
+                        gli_texture = load_texture_file(image.name, image.write_time);
+                    }
+                    else {
+                        encode_texture(image.name, image.write_time, gli_texture);
+                    }
+
+                    if (m_options.texture_arrays && (gli_texture.target() == gli::TARGET_2D) &&
+                        texture_packable(static_cast<uint32_t>(gli_texture.extent().x), static_cast<uint32_t>(gli_texture.extent().y))) {
+                        decode_texture(image.name, gli_texture, 0);
+                        image.texels = gli_texture;
+                    }
+                    else {
+                        image.texture = cache_texture(image.name, image.write_time, gli_texture);
+                    }
+                }
+                image.cached = (image.texture != nullptr) && !image.virtual_texture;
+            }
+
+            if (!image.texels.empty()) {
+                packs[std::make_tuple(static_cast<vk::Format>(image.texels.format()),
+                    static_cast<uint32_t>(image.texels.extent().x), static_cast<uint32_t>(image.texels.extent().y),
+                    static_cast<uint32_t>(image.texels.levels()))].push_back(image_index);
+            }
+        }
+
+        pack_textures(scene.file_name, packs, images);
+
+        // A change to anything but a shared texture reloads the whole scene.
+        for (const std::map<int, material_image>::value_type& entry : images) {
+            const std::string& uri(load_state.model.images.at(entry.first).uri);
+            if (uri.empty()) {
+                continue;
+            }
+
+            watched_file image_file;
+            image_file.file_name = uri;
+            image_file.write_time = entry.second.file ? entry.second.write_time : file_write_time(uri);
+            image_file.texture = entry.second.cached;
+            scene.watched_files.push_back(image_file);
+        }
+
+        for (int image_index : material_images) {
+            const material_image& image(images.at(image_index));
+            scene.textures.push_back(image.texture);
+            scene.virtual_textures.push_back(image.virtual_texture);
+            scene.texture_layers.push_back(image.layer);
+            scene.texture_files.push_back(image.cached ? image.name : std::string());
+            scene.owned_textures.push_back(image.cached ? nullptr : image.texture);
+        }
+
+        scene.immutable_descriptor_pool = material_sets_init(scene.textures, scene.material_sets, scene.material_views);
+
+        load_state.material_sets.resize(load_state.model.materials.size());
+        load_state.material_textures.resize(load_state.model.materials.size());
+        for (size_t i = 0; i < used_materials.size(); ++i) {
+            load_state.material_sets[used_materials[i]] = scene.material_sets[i];
+            load_state.material_textures[used_materials[i]] = static_cast<uint32_t>(i);
+        }
+    }
+
+    vk::DescriptorPool application::material_sets_init(
+        const std::vector<std::shared_ptr<device_image>>& textures,
+        std::vector<vk::DescriptorSet>& material_sets,
+        std::vector<vk::ImageView>& material_views)
+    {
+        // Textures packed into one array image share a set.
+        std::map<const device_image*, uint32_t> image_sets;
+        std::vector<uint32_t> texture_sets; // parallel to textures
+        std::vector<uint32_t> set_textures; // first texture using each set
+        texture_sets.reserve(textures.size());
+        for (uint32_t i = 0; i < textures.size(); ++i) {
+            std::pair<std::map<const device_image*, uint32_t>::iterator, bool> inserted(
+                image_sets.insert(std::make_pair(textures[i].get(), static_cast<uint32_t>(set_textures.size()))));
+            if (inserted.second) {
+                set_textures.push_back(i);
+            }
+            texture_sets.push_back(inserted.first->second);
+        }
+        uint32_t set_count = static_cast<uint32_t>(set_textures.size());
+
+        // Immutable state needs a pool and one set per image.
+        vk::DescriptorPoolSize descriptor_pool_sizes[1];
+        descriptor_pool_sizes[0].type = vk::DescriptorType::eCombinedImageSampler;
+        descriptor_pool_sizes[0].descriptorCount = set_count; // Each image needs a single sampler.
+
+        vk::DescriptorPoolCreateInfo descriptor_pool_create_info;
+        descriptor_pool_create_info.maxSets = set_count;
+        descriptor_pool_create_info.poolSizeCount = _countof(descriptor_pool_sizes);
+        descriptor_pool_create_info.pPoolSizes = descriptor_pool_sizes;
+
+        vk::DescriptorPool descriptor_pool = m_device.createDescriptorPool(descriptor_pool_create_info, nullptr, m_dispatch);
+
+        // Streaming swaps texture views on the main thread.
+        material_views.clear();
+        {
+            std::lock_guard<std::mutex> texture_lock(m_texture_mutex);
+            for (const std::shared_ptr<device_image>& texture : textures) {
+                material_views.push_back(texture->view);
+            }
+        }
+
+        std::vector<vk::DescriptorSetLayout> replicated_set_layouts(set_count, m_simple_immutable_set_layout);
+        vk::DescriptorSetAllocateInfo set_allocate_info;
+        set_allocate_info.descriptorPool = descriptor_pool;
+        set_allocate_info.descriptorSetCount = set_count;
+        set_allocate_info.pSetLayouts = replicated_set_layouts.data();
+
+        std::vector<vk::DescriptorSet> sets(m_device.allocateDescriptorSets(set_allocate_info, m_dispatch));
+
+        for (uint32_t i = 0; i < set_count; ++i) {
+            // Write the immutable state binding information into the set for this image.
+            vk::DescriptorImageInfo descriptor_image_info[1];
+            vk::WriteDescriptorSet write_descriptor_set[1];
+
+            descriptor_image_info[0].sampler = m_trilinear_sampler;
+            descriptor_image_info[0].imageView = material_views[set_textures[i]];
+            descriptor_image_info[0].imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+            write_descriptor_set[0].dstSet = sets[i];
+            write_descriptor_set[0].dstBinding = 1;
+            write_descriptor_set[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+            write_descriptor_set[0].descriptorCount = 1;
+            write_descriptor_set[0].pImageInfo = &descriptor_image_info[0];
+
+            m_device.updateDescriptorSets(_countof(write_descriptor_set), write_descriptor_set, 0, nullptr, m_dispatch);
+        }
+
+        material_sets.clear();
+        material_sets.reserve(textures.size());
+        for (uint32_t set_index : texture_sets) {
+            material_sets.push_back(sets[set_index]);
+        }
+
+        return (descriptor_pool);
+    }
+
+    void application::draw_data_init(loaded_scene& scene)
+    {
+        uint32_t frames_in_flight = static_cast<uint32_t>(m_swap_chain_color_images.size());
+        size_t draw_data_size = scene.draws.size() * sizeof(draw_data);
+
+        scene.draw_data_buffers.reserve(frames_in_flight);
+        scene.frame_draw_data.reserve(frames_in_flight);
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            device_buffer& draw_data_buffer = *scene.draw_data_buffers.emplace(scene.draw_data_buffers.end(),
+                create_device_buffer(vk::BufferUsageFlagBits::eStorageBuffer, draw_data_size, ubo_memory_properties));
+
+            draw_data* data = reinterpret_cast<draw_data*>(
+                m_device.mapMemory(draw_data_buffer.device_memory, 0, draw_data_size, vk::MemoryMapFlags(), m_dispatch));
+            scene.frame_draw_data.push_back(data);
+
+            for (const draw_record& d : scene.draws) {
+                data->model_transform = scene.transforms.world(d.transform_index);
+                const virtual_texture_pointer& virtual_texture(scene.virtual_textures[d.texture_index]);
+                data->position_scale = glm::vec4(d.geometry.position_scale, virtual_texture ? static_cast<float>(virtual_texture->id + 1) : 0.0f);
+                data->position_bias = glm::vec4(d.geometry.position_bias, static_cast<float>(scene.texture_layers[d.texture_index]));
+                ++data;
+            }
+        }
+        scene.draw_data_serials.assign(frames_in_flight, scene.transforms.serial());
+
+        // Scene state needs a pool and one set per frame in flight.
+        vk::DescriptorPoolSize scene_pool_sizes[1];
+        scene_pool_sizes[0].type = vk::DescriptorType::eStorageBuffer;
+        scene_pool_sizes[0].descriptorCount = frames_in_flight;
+
+        vk::DescriptorPoolCreateInfo scene_pool_create_info;
+        scene_pool_create_info.maxSets = frames_in_flight;
+        scene_pool_create_info.poolSizeCount = _countof(scene_pool_sizes);
+        scene_pool_create_info.pPoolSizes = scene_pool_sizes;
+
+        scene.scene_descriptor_pool = m_device.createDescriptorPool(scene_pool_create_info, nullptr, m_dispatch);
+
+        std::vector<vk::DescriptorSetLayout> replicated_set_layouts(frames_in_flight, m_simple_scene_set_layout);
+        vk::DescriptorSetAllocateInfo scene_set_allocate_info;
+        scene_set_allocate_info.descriptorPool = scene.scene_descriptor_pool;
+        scene_set_allocate_info.descriptorSetCount = frames_in_flight;
+        scene_set_allocate_info.pSetLayouts = replicated_set_layouts.data();
+
+        std::vector<vk::DescriptorSet> scene_sets(m_device.allocateDescriptorSets(scene_set_allocate_info, m_dispatch));
+
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            vk::DescriptorBufferInfo descriptor_buffer_info[1];
+            vk::WriteDescriptorSet write_descriptor_set[1];
+
+            descriptor_buffer_info[0].buffer = scene.draw_data_buffers[i].buffer;
+            descriptor_buffer_info[0].offset = 0;
+            descriptor_buffer_info[0].range = VK_WHOLE_SIZE;
+
+            write_descriptor_set[0].dstSet = scene_sets[i];
+            write_descriptor_set[0].dstBinding = 0;
+            write_descriptor_set[0].descriptorType = vk::DescriptorType::eStorageBuffer;
+            write_descriptor_set[0].descriptorCount = 1;
+            write_descriptor_set[0].pBufferInfo = &descriptor_buffer_info[0];
+
+            m_device.updateDescriptorSets(_countof(write_descriptor_set), write_descriptor_set, 0, nullptr, m_dispatch);
+        }
+
+        // Only set once complete; scenes without sets are not drawn.
+        scene.scene_sets.swap(scene_sets);
+    }
+
+    void application::write_draw_data(loaded_scene& scene, uint32_t frame)
+    {
+        // Only draws whose transforms changed since this frame's copy was last written are touched.
+        uint64_t& written_serial(scene.draw_data_serials[frame]);
+        if (written_serial == scene.transforms.serial()) {
+            return;
+        }
+
+        draw_data* data = scene.frame_draw_data[frame];
+        for (size_t i = 0; i < scene.draws.size(); ++i) {
+            uint32_t transform_index = scene.draws[i].transform_index;
+            if (scene.transforms.world_serial(transform_index) > written_serial) {
+                data[i].model_transform = scene.transforms.world(transform_index);
+            }
+        }
+        written_serial = scene.transforms.serial();
+    }
+
+    void application::cluster_culling_init(loaded_scene& scene, const std::vector<cluster_data>& primitive_clusters)
+    {
+        // Instances of a primitive are culled independently, so every draw gets its own copy of the
+        // primitive's clusters and its own range of the visible index buffer.
+        std::vector<cluster_data> clusters;
+        std::vector<vk::DrawIndexedIndirectCommand> draw_commands;
+        draw_commands.reserve(scene.draws.size());
+        uint32_t visible_index_count = 0;
+        for (uint32_t i = 0; i < scene.draws.size(); ++i) {
+            const geometry_record& geometry(scene.draws[i].geometry);
+            for (uint32_t c = 0; c < geometry.cluster_count; ++c) {
+                cluster_data cluster(primitive_clusters[geometry.first_cluster + c]);
+                cluster.first_index += geometry.first_index;
+                cluster.draw_index = i;
+                clusters.push_back(cluster);
+            }
+
+            vk::DrawIndexedIndirectCommand draw_command;
+            draw_command.indexCount = 0;
+            draw_command.instanceCount = 1;
+            draw_command.firstIndex = visible_index_count;
+            draw_command.vertexOffset = geometry.vertex_offset;
+            draw_command.firstInstance = i;
+            draw_commands.push_back(draw_command);
+
+            visible_index_count += geometry.index_count;
+        }
+
+        // A scene without clusters has nothing to draw.
+        if (clusters.empty()) {
+            return;
+        }
+
+        scene.cluster_count = static_cast<uint32_t>(clusters.size());
+
+        scene.buffers.push_back(create_static_buffer(
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            clusters.data(),
+            clusters.size() * sizeof(cluster_data)));
+        vk::Buffer cluster_buffer(scene.buffers.back().buffer);
+
+        scene.buffers.push_back(create_static_buffer(
+            vk::BufferUsageFlagBits::eTransferSrc,
+            draw_commands.data(),
+            draw_commands.size() * sizeof(vk::DrawIndexedIndirectCommand)));
+        scene.cull_draw_command_template = scene.buffers.back().buffer;
+
+        // Visible indices and draw commands are written by the GPU every frame.
+        uint32_t frames_in_flight = static_cast<uint32_t>(m_swap_chain_color_images.size());
+        scene.cull_index_buffers.reserve(frames_in_flight);
+        scene.cull_draw_command_buffers.reserve(frames_in_flight);
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            scene.cull_index_buffers.push_back(create_device_buffer(
+                vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                visible_index_count * sizeof(uint32_t),
+                optimized_memory_properties));
+
+            scene.cull_draw_command_buffers.push_back(create_device_buffer(
+                vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                draw_commands.size() * sizeof(vk::DrawIndexedIndirectCommand),
+                optimized_memory_properties));
+
+            // Selected levels of detail are written by the CPU each frame; all full detail until then.
+            device_buffer& lod_buffer = *scene.cull_lod_buffers.emplace(scene.cull_lod_buffers.end(),
+                create_device_buffer(vk::BufferUsageFlagBits::eStorageBuffer, scene.draws.size() * sizeof(uint32_t), ubo_memory_properties));
+
+            scene.cull_lod_selections.push_back(reinterpret_cast<uint32_t*>(
+                m_device.mapMemory(lod_buffer.device_memory, 0, scene.draws.size() * sizeof(uint32_t), vk::MemoryMapFlags(), m_dispatch)));
+            std::fill(scene.cull_lod_selections.back(), scene.cull_lod_selections.back() + scene.draws.size(), 0);
+        }
+
+        // One set per frame in flight.
+        vk::DescriptorPoolSize cull_pool_sizes[1];
+        cull_pool_sizes[0].type = vk::DescriptorType::eStorageBuffer;
+        cull_pool_sizes[0].descriptorCount = frames_in_flight * 6; // 6 == number of storage buffers
+
+        vk::DescriptorPoolCreateInfo cull_pool_create_info;
+        cull_pool_create_info.maxSets = frames_in_flight;
+        cull_pool_create_info.poolSizeCount = _countof(cull_pool_sizes);
+        cull_pool_create_info.pPoolSizes = cull_pool_sizes;
+
+        scene.cull_descriptor_pool = m_device.createDescriptorPool(cull_pool_create_info, nullptr, m_dispatch);
+
+        std::vector<vk::DescriptorSetLayout> replicated_set_layouts(frames_in_flight, m_cull_set_layout);
+        vk::DescriptorSetAllocateInfo set_allocate_info;
+        set_allocate_info.descriptorPool = scene.cull_descriptor_pool;
+        set_allocate_info.descriptorSetCount = frames_in_flight;
+        set_allocate_info.pSetLayouts = replicated_set_layouts.data();
+
+        scene.cull_sets = m_device.allocateDescriptorSets(set_allocate_info, m_dispatch);
+
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            vk::Buffer buffers[] = {
+                scene.draw_data_buffers[i].buffer,
+                cluster_buffer,
+                scene.index_buffers[1],
+                scene.cull_index_buffers[i].buffer,
+                scene.cull_draw_command_buffers[i].buffer,
+                scene.cull_lod_buffers[i].buffer
+            };
+
+            vk::DescriptorBufferInfo descriptor_buffer_info[_countof(buffers)];
+            vk::WriteDescriptorSet write_descriptor_set[_countof(buffers)];
+            for (uint32_t b = 0; b < _countof(buffers); ++b) {
+                descriptor_buffer_info[b].buffer = buffers[b];
+                descriptor_buffer_info[b].offset = 0;
+                descriptor_buffer_info[b].range = VK_WHOLE_SIZE;
+
+                write_descriptor_set[b].dstSet = scene.cull_sets[i];
+                write_descriptor_set[b].dstBinding = b;
+                write_descriptor_set[b].descriptorType = vk::DescriptorType::eStorageBuffer;
+                write_descriptor_set[b].descriptorCount = 1;
+                write_descriptor_set[b].pBufferInfo = &descriptor_buffer_info[b];
+            }
+
+            m_device.updateDescriptorSets(_countof(write_descriptor_set), write_descriptor_set, 0, nullptr, m_dispatch);
+        }
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream << "Cluster culling: " << scene.cluster_count << " clusters in " << scene.draws.size() << " draws" << std::endl;
+    }
+
+    void application::skinning_init(loaded_scene& scene, const std::vector<skin_vertex>& skin_vertices, uint32_t skinned_vertex_count)
+    {
+        scene.buffers.push_back(create_static_buffer(
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            skin_vertices.data(),
+            skin_vertices.size() * sizeof(skin_vertex)));
+        scene.skin_vertex_buffer = scene.buffers.back().buffer;
+
+        // Joint matrices are written by the CPU and skinned vertices by the GPU, once per frame in
+        // flight. Skinned vertices have the full layout, split or interleaved like the merged streams.
+        uint32_t frames_in_flight = static_cast<uint32_t>(m_swap_chain_color_images.size());
+        bool split = m_options.split_vertex_streams;
+        size_t joint_size = scene.joint_count * sizeof(glm::mat4);
+        size_t vertex_size = skinned_vertex_count * (split ? sizeof(glm::vec3) : sizeof(vertex));
+        size_t attribute_size = skinned_vertex_count * sizeof(vertex_attributes);
+
+        scene.joint_buffers.reserve(frames_in_flight);
+        scene.frame_joint_matrices.reserve(frames_in_flight);
+        scene.skinned_vertex_buffers.reserve(frames_in_flight);
+        scene.skinned_attribute_buffers.reserve(split ? frames_in_flight : 0);
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            device_buffer& joint_buffer = *scene.joint_buffers.emplace(scene.joint_buffers.end(),
+                create_device_buffer(vk::BufferUsageFlagBits::eStorageBuffer, joint_size, ubo_memory_properties));
+
+            scene.frame_joint_matrices.push_back(reinterpret_cast<glm::mat4*>(
+                m_device.mapMemory(joint_buffer.device_memory, 0, joint_size, vk::MemoryMapFlags(), m_dispatch)));
+
+            scene.skinned_vertex_buffers.push_back(create_device_buffer(
+                vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                vertex_size,
+                optimized_memory_properties));
+
+            if (split) {
+                scene.skinned_attribute_buffers.push_back(create_device_buffer(
+                    vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                    attribute_size,
+                    optimized_memory_properties));
+            }
+        }
+
+        // Nothing is up to date yet, so the first frame writes every joint.
+        scene.joint_serials.assign(frames_in_flight, std::numeric_limits<uint64_t>::max());
+
+        // One set per frame in flight.
+        vk::DescriptorPoolSize skin_pool_sizes[1];
+        skin_pool_sizes[0].type = vk::DescriptorType::eStorageBuffer;
+        skin_pool_sizes[0].descriptorCount = frames_in_flight * 4; // 4 == number of storage buffers
+
+        vk::DescriptorPoolCreateInfo skin_pool_create_info;
+        skin_pool_create_info.maxSets = frames_in_flight;
+        skin_pool_create_info.poolSizeCount = _countof(skin_pool_sizes);
+        skin_pool_create_info.pPoolSizes = skin_pool_sizes;
+
+        scene.skin_descriptor_pool = m_device.createDescriptorPool(skin_pool_create_info, nullptr, m_dispatch);
+
+        std::vector<vk::DescriptorSetLayout> replicated_set_layouts(frames_in_flight, m_skin_set_layout);
+        vk::DescriptorSetAllocateInfo set_allocate_info;
+        set_allocate_info.descriptorPool = scene.skin_descriptor_pool;
+        set_allocate_info.descriptorSetCount = frames_in_flight;
+        set_allocate_info.pSetLayouts = replicated_set_layouts.data();
+
+        scene.skin_sets = m_device.allocateDescriptorSets(set_allocate_info, m_dispatch);
+
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            // Interleaved vertices never write the attribute binding, but it still needs a buffer.
+            vk::Buffer buffers[] = {
+                scene.skin_vertex_buffer,
+                scene.joint_buffers[i].buffer,
+                scene.skinned_vertex_buffers[i].buffer,
+                split ? scene.skinned_attribute_buffers[i].buffer : scene.skinned_vertex_buffers[i].buffer
+            };
+
+            vk::DescriptorBufferInfo descriptor_buffer_info[_countof(buffers)];
+            vk::WriteDescriptorSet write_descriptor_set[_countof(buffers)];
+            for (uint32_t b = 0; b < _countof(buffers); ++b) {
+                descriptor_buffer_info[b].buffer = buffers[b];
+                descriptor_buffer_info[b].offset = 0;
+                descriptor_buffer_info[b].range = VK_WHOLE_SIZE;
+
+                write_descriptor_set[b].dstSet = scene.skin_sets[i];
+                write_descriptor_set[b].dstBinding = b;
+                write_descriptor_set[b].descriptorType = vk::DescriptorType::eStorageBuffer;
+                write_descriptor_set[b].descriptorCount = 1;
+                write_descriptor_set[b].pBufferInfo = &descriptor_buffer_info[b];
+            }
+
+            m_device.updateDescriptorSets(_countof(write_descriptor_set), write_descriptor_set, 0, nullptr, m_dispatch);
+        }
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Skinning: " << skinned_vertex_count << " vertices in " << scene.skin_jobs.size() << " draws, "
+            << scene.joint_count << " joints" << std::endl;
+    }
+
+    // static
+    bool application::gltf_load_image_data(
+        tinygltf::Image* image,
+        std::string* load_error,
+        std::string* /*load_warn*/,
+        int /*required_width*/,
+        int /*required_height*/,
+        const unsigned char* bytes,
+        int size,
+        void* user_data)
+    {
+        // DDS and KTX images are read by gli from their uri when materials load. PNG and JPEG images,
+        // embedded or not, decode on the thread pool while the rest of the file loads.
+        gltf_image_context* context = static_cast<gltf_image_context*>(user_data);
+        application* app = context->app;
+
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        if (!stbi_info_from_memory(bytes, size, &width, &height, &components)) {
+            return (true);
+        }
+
+        image_decode_pointer decode(new image_decode, [app](image_decode* d) {
+            app->cleanup_image_decode(*d);
+            delete d;
+        });
+        decode->encoded.assign(bytes, bytes + size);
+        decode->width = width;
+        decode->height = height;
+
+        // Base color, so sRGB; mips are generated on upload. Images that may be packed are copied
+        // into their array later, so they decode into memory rather than write combined staging.
+        bool packable = app->m_options.texture_arrays && texture_packable(width, height);
+        if (packable) {
+            decode->texels = gli::texture2d(gli::FORMAT_RGBA8_SRGB_PACK8, gli::extent2d(width, height), 1);
+        }
+
+        vk::DeviceSize image_size = static_cast<vk::DeviceSize>(width) * height * 4;
+        staged_texture& staged(decode->staged);
+        staged.format = vk::Format::eR8G8B8A8Srgb;
+        staged.extent = vk::Extent3D(width, height, 1);
+        staged.layers = 1;
+        staged.single_level = true;
+
+        vk::BufferImageCopy copy_image_region;
+        copy_image_region.bufferOffset = 0;
+        copy_image_region.bufferRowLength = 0;
+        copy_image_region.bufferImageHeight = 0;
+        copy_image_region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        copy_image_region.imageSubresource.mipLevel = 0;
+        copy_image_region.imageSubresource.baseArrayLayer = 0;
+        copy_image_region.imageSubresource.layerCount = 1;
+        copy_image_region.imageOffset = vk::Offset3D(0, 0, 0);
+        copy_image_region.imageExtent = staged.extent;
+        staged.regions.push_back(copy_image_region);
+
+        if (!packable) {
+            try {
+                staged.buffer = app->create_device_buffer(vk::BufferUsageFlagBits::eTransferSrc, image_size, staging_memory_properties);
+                decode->mapped = app->m_device.mapMemory(staged.buffer.device_memory, 0, image_size, vk::MemoryMapFlags(), app->m_dispatch);
+            }
+            catch (...) {
+                *load_error = boost::current_exception_diagnostic_information();
+                return (false);
+            }
+        }
+
+        // tinygltf hands over a temporary image, so the decode is found again through a tag in its extras.
+        tinygltf::Value::Object tag;
+        tag["gtb_image_decode"] = tinygltf::Value(static_cast<int>(context->decodes.size()));
+        image->extras = tinygltf::Value(tag);
+        image->width = width;
+        image->height = height;
+        image->component = 4;
+        context->decodes.push_back(decode);
+
+        app->m_thread_pool.push([decode]() {
+            int decoded_width = 0;
+            int decoded_height = 0;
+            int decoded_components = 0;
+            stbi_uc* pixels = stbi_load_from_memory(
+                decode->encoded.data(), static_cast<int>(decode->encoded.size()), &decoded_width, &decoded_height, &decoded_components, 4);
+            bool decoded = (pixels != nullptr) && (decoded_width == decode->width) && (decoded_height == decode->height);
+            if (decoded) {
+                memcpy(decode->mapped ? decode->mapped : decode->texels.data(), pixels, static_cast<size_t>(decoded_width) * decoded_height * 4);
+            }
+            stbi_image_free(pixels);
+            std::vector<uint8_t>().swap(decode->encoded);
+
+            std::lock_guard<std::mutex> lock(decode->mutex);
+            decode->decoded = decoded;
+            decode->done = true;
+            decode->finished.notify_all();
+        });
+
+        return (true);
+    }
+
+    // static
+    uint32_t application::gltf_component_size(int component)
+    {
+        switch (component) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return (1);
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return (2);
+        case TINYGLTF_COMPONENT_TYPE_INT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return (4);
+        case TINYGLTF_COMPONENT_TYPE_DOUBLE:
+            return (8);
+        }
+        return (0);
+    }
+
+    vk::CommandBuffer application::create_one_time_command_buffer()
+    {
+        vk::CommandBufferAllocateInfo command_buffer_allocate_info;
+        command_buffer_allocate_info.commandPool = m_transfer_command_pool;
+        command_buffer_allocate_info.level = vk::CommandBufferLevel::ePrimary;
+        command_buffer_allocate_info.commandBufferCount = 1;
+        vk::CommandBuffer one_time_command_buffer = m_device.allocateCommandBuffers(command_buffer_allocate_info, m_dispatch)[0];
+
+        vk::CommandBufferBeginInfo begin_info;
+        begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+        one_time_command_buffer.begin(begin_info, m_dispatch);
+
+        return (one_time_command_buffer);
+    }
+
+    void application::finish_one_time_command_buffer(vk::CommandBuffer cmd_buffer)
+    {
+        cmd_buffer.end(m_dispatch);
+
+        // Submit the command buffer. The queue is shared with the frames being drawn meanwhile.
+        vk::Fence finished_fence = m_device.createFence(vk::FenceCreateInfo(), nullptr, m_dispatch);
+
+        vk::SubmitInfo submit_info;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &cmd_buffer;
+        {
+            std::lock_guard<std::mutex> queue_lock(m_queue_mutex);
+            m_queue.submit(submit_info, finished_fence, m_dispatch);
+        }
+
+        // Finish it by waiting for just this submission rather than the whole queue.
+        m_device.waitForFences(finished_fence, VK_FALSE, std::numeric_limits<uint64_t>::max(), m_dispatch);
+        m_device.destroyFence(finished_fence, nullptr, m_dispatch);
+    }
+
+    void application::cleanup_one_time_command_buffer(vk::CommandBuffer cmd_buffer)
+    {
+        m_device.freeCommandBuffers(m_transfer_command_pool, cmd_buffer, m_dispatch);
+    }
+
+    application::device_buffer application::create_static_buffer(
+        vk::BufferUsageFlags flags,
+        const void* data,
+        size_t sizeof_data)
+    {
+        // Device local memory the host can write takes the data as is.
+        if (m_direct_memory_types != 0) {
+            device_buffer direct_buffer;
+
+            vk::BufferCreateInfo buffer_create_info;
+            buffer_create_info.size = sizeof_data;
+            buffer_create_info.usage = flags;
+            buffer_create_info.sharingMode = vk::SharingMode::eExclusive;
+            direct_buffer.buffer = m_device.createBuffer(buffer_create_info, nullptr, m_dispatch);
+
+            vk::MemoryRequirements buffer_mem_reqs = m_device.getBufferMemoryRequirements(direct_buffer.buffer, m_dispatch);
+
+            vk::MemoryAllocateInfo buffer_alloc_info;
+            buffer_alloc_info.allocationSize = buffer_mem_reqs.size;
+            if (find_memory_type(buffer_mem_reqs.memoryTypeBits & m_direct_memory_types, direct_memory_properties, buffer_alloc_info.memoryTypeIndex)) {
+                direct_buffer.device_memory = m_device.allocateMemory(buffer_alloc_info, nullptr, m_dispatch);
+                m_device.bindBufferMemory(direct_buffer.buffer, direct_buffer.device_memory, 0, m_dispatch);
+
+                void* mapped_memory = m_device.mapMemory(direct_buffer.device_memory, 0, sizeof_data, vk::MemoryMapFlags(), m_dispatch);
+                memcpy(mapped_memory, data, sizeof_data);
+                m_device.unmapMemory(direct_buffer.device_memory, m_dispatch);
+                return (direct_buffer);
+            }
+
+            m_device.destroyBuffer(direct_buffer.buffer, nullptr, m_dispatch);
+        }
+
+        // Need a staging buffer to upload the data from.
+        device_buffer staging_buffer = create_device_buffer(vk::BufferUsageFlagBits::eTransferSrc, sizeof_data, staging_memory_properties);
+
+        // Write the data to the staging buffer.
+        void* mapped_staging_memory = m_device.mapMemory(staging_buffer.device_memory, 0, sizeof_data, vk::MemoryMapFlags(), m_dispatch);
+        memcpy(mapped_staging_memory, data, sizeof_data);
+        m_device.unmapMemory(staging_buffer.device_memory, m_dispatch);
+
+        // Optimized buffer for actual GPU use.
+        device_buffer optimized_buffer = create_device_buffer(flags | vk::BufferUsageFlagBits::eTransferDst, sizeof_data, optimized_memory_properties);
+
+        // Record a command buffer to copy the staging buffer to the optimized buffer.
+        vk::CommandBuffer copy_command_buffer = create_one_time_command_buffer();
+
+        vk::BufferCopy copy_region;
+        copy_region.size = sizeof_data;
+        copy_command_buffer.copyBuffer(staging_buffer.buffer, optimized_buffer.buffer, copy_region, m_dispatch);
+
+        // TODO: Rather than finish here, we could wait at the end of the application constructor; will need to
+        // remember staging details to be freed there.
+        finish_one_time_command_buffer(copy_command_buffer);
+
+        // Cleanup.
+        cleanup_one_time_command_buffer(copy_command_buffer);
+        cleanup_device_buffer(staging_buffer);
+
+        return (optimized_buffer);
+    }
+
+    void application::static_buffers_cleanup()
+    {
+        for (device_buffer& b : m_static_buffers) {
+            cleanup_device_buffer(b);
+        }
+    }
+
+    application::device_buffer application::create_device_buffer(
+        vk::BufferUsageFlags flags,
+        size_t sizeof_data,
+        vk::MemoryPropertyFlags memory_properties)
+    {
+        device_buffer b;
+
+        // Create buffer object
+        vk::BufferCreateInfo buffer_create_info;
+        buffer_create_info.size = sizeof_data;
+        buffer_create_info.usage = flags;
+        buffer_create_info.sharingMode = vk::SharingMode::eExclusive;
+        b.buffer = m_device.createBuffer(buffer_create_info, nullptr, m_dispatch);
+
+        // Allocate memory for the buffer object.
+        vk::MemoryRequirements buffer_mem_reqs = m_device.getBufferMemoryRequirements(b.buffer, m_dispatch);
+
+        vk::MemoryAllocateInfo buffer_alloc_info;
+        buffer_alloc_info.allocationSize = buffer_mem_reqs.size;
+        buffer_alloc_info.memoryTypeIndex = get_memory_type(buffer_mem_reqs.memoryTypeBits, memory_properties);
+        b.device_memory = m_device.allocateMemory(buffer_alloc_info, nullptr, m_dispatch);
+        m_device.bindBufferMemory(b.buffer, b.device_memory, 0, m_dispatch);
+
+        return (b);
+    }
+
+    void application::cleanup_device_buffer(device_buffer& b)
+    {
+        m_device.destroyBuffer(b.buffer, nullptr, m_dispatch);
+        m_device.freeMemory(b.device_memory, nullptr, m_dispatch);
+    }
+
+    std::shared_ptr<application::device_image> application::create_texture(const std::string& file_name)
+    {
+        // Scenes using the same file share the image until the last of them is released, or until
+        // the file changes on disk.
+        std::time_t write_time = file_write_time(file_name);
+        std::shared_ptr<device_image> texture(find_texture(file_name, write_time, false));
+        if (texture) {
+            return (texture);
+        }
+
+        gli::texture gli_texture(load_texture_file(file_name, write_time));
+        return (cache_texture(file_name, write_time, gli_texture));
+    }
+
+    std::shared_ptr<application::device_image> application::find_texture(const std::string& file_name, std::time_t write_time, bool packable)
+    {
+        // Packable textures are not shared; the caller loads them again to pack them.
+        std::lock_guard<std::mutex> texture_lock(m_texture_mutex);
+        texture_cache::iterator cached(m_textures.find(file_name));
+        if ((cached == m_textures.end()) || (cached->second.write_time != write_time) ||
+            (packable && texture_packable(cached->second.width, cached->second.height))) {
+            return (nullptr);
+        }
+
+        return (cached->second.texture.lock());
+    }
+
+    std::shared_ptr<application::device_image> application::cache_texture(const std::string& file_name, std::time_t write_time, gli::texture& gli_texture)
+    {
+        // Streamed textures start with their smallest levels only; the rest load once a draw needs them.
+        cached_texture residency;
+        residency.write_time = write_time;
+        residency.width = static_cast<uint32_t>(gli_texture.extent().x);
+        residency.height = static_cast<uint32_t>(gli_texture.extent().y);
+
+        residency.tail_level = 0;
+        if (m_options.texture_budget > 0) {
+            uint32_t levels = static_cast<uint32_t>(gli_texture.levels());
+            while (((residency.tail_level + 1) < levels) &&
+                (std::max(residency.width >> residency.tail_level, residency.height >> residency.tail_level) > texture_tail_size)) {
+                ++residency.tail_level;
+            }
+        }
+
+        // Sizes as uploaded, after any decode.
+        decode_texture(file_name, gli_texture, residency.tail_level);
+        residency.level_sizes.reserve(gli_texture.levels());
+        for (size_t level = 0; level < gli_texture.levels(); ++level) {
+            residency.level_sizes.push_back(gli_texture.size(level) * gli_texture.layers());
+        }
+        residency.resident_level = residency.tail_level;
+        residency.requested_level = residency.tail_level;
+        residency.wanted_level = residency.tail_level;
+        residency.last_used_frame = 0;
+
+        std::shared_ptr<device_image> texture(new device_image(upload_texture(file_name, gli_texture, residency.tail_level)), [this](device_image* t) {
+            release_device_image(*t);
+            delete t;
+        });
+        residency.texture = texture;
+
+        std::lock_guard<std::mutex> texture_lock(m_texture_mutex);
+        m_textures[file_name] = residency;
+        return (texture);
+    }
+
+    application::device_image application::upload_texture(const std::string& file_name, const gli::texture& gli_texture, uint32_t first_level)
+    {
+        device_image direct_texture;
+        if (m_direct_texture_uploads && upload_direct_texture(file_name, gli_texture, first_level, direct_texture)) {
+            return (direct_texture);
+        }
+
+        // Need a staging buffer to upload the data from.
+        staged_texture staged;
+        staged.buffer = create_device_buffer(vk::BufferUsageFlagBits::eTransferSrc, gli_texture.size(), staging_memory_properties);
+
+        // Write the data to the staging buffer.
+        void* mapped_staging_memory = m_device.mapMemory(staged.buffer.device_memory, 0, gli_texture.size(), vk::MemoryMapFlags(), m_dispatch);
+        memcpy(mapped_staging_memory, gli_texture.data(), gli_texture.size());
+        m_device.unmapMemory(staged.buffer.device_memory, m_dispatch);
+
+        // The image's first level is first_level of the file.
+        gli::extent3d gli_texture_extent(gli_texture.extent(first_level));
+        staged.format = static_cast<vk::Format>(gli_texture.format());
+        staged.layers = static_cast<uint32_t>(gli_texture.layers());
+        staged.single_level = (gli_texture.levels() == 1);
+        switch (gli_texture.target()) {
+        case gli::TARGET_1D:
+        case gli::TARGET_1D_ARRAY:
+            break;
+
+        case gli::TARGET_2D:
+        case gli::TARGET_2D_ARRAY:
+            staged.extent = vk::Extent3D(gli_texture_extent.x, gli_texture_extent.y, 1);
+            break;
+
+        case gli::TARGET_3D:
+        case gli::TARGET_RECT:
+        case gli::TARGET_RECT_ARRAY:
+        case gli::TARGET_CUBE:
+        case gli::TARGET_CUBE_ARRAY:
+            break;
+        }
+
+        // Every loaded level and layer; gli keeps them packed in the staging data.
+        const uint8_t* gli_texture_data = static_cast<const uint8_t*>(gli_texture.data());
+        uint32_t loaded_levels = static_cast<uint32_t>(gli_texture.levels()) - first_level;
+        staged.regions.reserve(loaded_levels * staged.layers);
+        for (uint32_t level = 0; level < loaded_levels; ++level) {
+            gli::extent3d level_extent(gli_texture.extent(first_level + level));
+            for (uint32_t layer = 0; layer < staged.layers; ++layer) {
+                vk::BufferImageCopy copy_image_region;
+                copy_image_region.bufferOffset = static_cast<const uint8_t*>(gli_texture.data(layer, 0, first_level + level)) - gli_texture_data;
+                copy_image_region.bufferRowLength = 0;
+                copy_image_region.bufferImageHeight = 0;
+                copy_image_region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+                copy_image_region.imageSubresource.mipLevel = level;
+                copy_image_region.imageSubresource.baseArrayLayer = layer;
+                copy_image_region.imageSubresource.layerCount = 1;
+                copy_image_region.imageOffset = vk::Offset3D(0, 0, 0);
+                copy_image_region.imageExtent = vk::Extent3D(level_extent.x, level_extent.y, 1);
+                staged.regions.push_back(copy_image_region);
+            }
+        }
+
+        return (upload_staged_texture(file_name, staged, first_level));
+    }
+
+    bool application::upload_direct_texture(const std::string& file_name, const gli::texture& gli_texture, uint32_t first_level, device_image& texture)
+    {
+        // Linear images get no generated mips, so only files carrying their own qualify, and only in
+        // formats and sizes the device can sample and filter linearly.
+        if (((gli_texture.target() != gli::TARGET_2D) && (gli_texture.target() != gli::TARGET_2D_ARRAY)) || (gli_texture.levels() == 1)) {
+            return (false);
+        }
+
+        vk::Format format(static_cast<vk::Format>(gli_texture.format()));
+        const vk::FormatFeatureFlags sample_features = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        vk::FormatProperties format_properties(m_physical_device.getFormatProperties(format, m_dispatch));
+        if ((format_properties.linearTilingFeatures & sample_features) != sample_features) {
+            return (false);
+        }
+
+        gli::extent3d extent(gli_texture.extent(first_level));
+        uint32_t levels = static_cast<uint32_t>(gli_texture.levels()) - first_level;
+        uint32_t layers = static_cast<uint32_t>(gli_texture.layers());
+        vk::ImageFormatProperties image_format_properties;
+        if ((m_physical_device.getImageFormatProperties(format, vk::ImageType::e2D, vk::ImageTiling::eLinear, vk::ImageUsageFlagBits::eSampled,
+                vk::ImageCreateFlags(), &image_format_properties, m_dispatch) != vk::Result::eSuccess) ||
+            (image_format_properties.maxMipLevels < levels) || (image_format_properties.maxArrayLayers < layers) ||
+            (image_format_properties.maxExtent.width < static_cast<uint32_t>(extent.x)) ||
+            (image_format_properties.maxExtent.height < static_cast<uint32_t>(extent.y))) {
+            return (false);
+        }
+
+        vk::ImageCreateInfo image_create_info;
+        image_create_info.imageType = vk::ImageType::e2D;
+        image_create_info.extent = vk::Extent3D(extent.x, extent.y, 1);
+        image_create_info.mipLevels = levels;
+        image_create_info.arrayLayers = layers;
+        image_create_info.format = format;
+        image_create_info.tiling = vk::ImageTiling::eLinear;
+        image_create_info.initialLayout = vk::ImageLayout::ePreinitialized;
+        image_create_info.usage = vk::ImageUsageFlagBits::eSampled;
+        image_create_info.sharingMode = vk::SharingMode::eExclusive;
+        image_create_info.samples = vk::SampleCountFlagBits::e1;
+
+        texture.image = m_device.createImage(image_create_info, nullptr, m_dispatch);
+
+        vk::MemoryRequirements image_mem_reqs = m_device.getImageMemoryRequirements(texture.image, m_dispatch);
+
+        vk::MemoryAllocateInfo image_alloc_info;
+        image_alloc_info.allocationSize = image_mem_reqs.size;
+        if (!find_memory_type(image_mem_reqs.memoryTypeBits & m_direct_memory_types, direct_memory_properties, image_alloc_info.memoryTypeIndex)) {
+            m_device.destroyImage(texture.image, nullptr, m_dispatch);
+            texture = device_image();
+            return (false);
+        }
+        texture.device_memory = m_device.allocateMemory(image_alloc_info, nullptr, m_dispatch);
+        m_device.bindImageMemory(texture.image, texture.device_memory, 0, m_dispatch);
+
+        // Every loaded level and layer, row by row at the pitch the device lays it out with. Rows of
+        // block compressed formats are rows of blocks.
+        uint8_t* mapped_memory = static_cast<uint8_t*>(m_device.mapMemory(texture.device_memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), m_dispatch));
+        gli::extent3d block_extent(gli::block_extent(gli_texture.format()));
+        size_t block_size = gli::block_size(gli_texture.format());
+        for (uint32_t level = 0; level < levels; ++level) {
+            gli::extent3d level_extent(gli_texture.extent(first_level + level));
+            size_t row_size = static_cast<size_t>((level_extent.x + block_extent.x - 1) / block_extent.x) * block_size;
+            uint32_t rows = static_cast<uint32_t>((level_extent.y + block_extent.y - 1) / block_extent.y);
+            for (uint32_t layer = 0; layer < layers; ++layer) {
+                vk::ImageSubresource subresource(vk::ImageAspectFlagBits::eColor, level, layer);
+                vk::SubresourceLayout subresource_layout(m_device.getImageSubresourceLayout(texture.image, subresource, m_dispatch));
+                const uint8_t* source = static_cast<const uint8_t*>(gli_texture.data(layer, 0, first_level + level));
+                for (uint32_t row = 0; row < rows; ++row) {
+                    memcpy(mapped_memory + subresource_layout.offset + (row * subresource_layout.rowPitch), source + (row * row_size), row_size);
+                }
+            }
+        }
+        m_device.unmapMemory(texture.device_memory, m_dispatch);
+
+        vk::ImageSubresourceRange subresource_range;
+        subresource_range.aspectMask = vk::ImageAspectFlagBits::eColor;
+        subresource_range.baseMipLevel = 0;
+        subresource_range.levelCount = levels;
+        subresource_range.baseArrayLayer = 0;
+        subresource_range.layerCount = layers;
+
+        // Materials sample every texture as an array; single textures are one layer.
+        vk::ImageViewCreateInfo image_view_create_info;
+        image_view_create_info.image = texture.image;
+        image_view_create_info.viewType = vk::ImageViewType::e2DArray;
+        image_view_create_info.format = format;
+        image_view_create_info.subresourceRange = subresource_range;
+
+        texture.view = m_device.createImageView(image_view_create_info, nullptr, m_dispatch);
+
+        // Leaving the preinitialized layout makes the host writes available; no copy is recorded.
+        vk::CommandBuffer layout_command_buffer = create_one_time_command_buffer();
+
+        vk::ImageMemoryBarrier layout_barrier;
+        layout_barrier.srcAccessMask = vk::AccessFlagBits::eHostWrite;
+        layout_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        layout_barrier.oldLayout = vk::ImageLayout::ePreinitialized;
+        layout_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        layout_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        layout_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        layout_barrier.image = texture.image;
+        layout_barrier.subresourceRange = subresource_range;
+        layout_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &layout_barrier, m_dispatch);
+
+        finish_one_time_command_buffer(layout_command_buffer);
+        cleanup_one_time_command_buffer(layout_command_buffer);
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Texture " << file_name << ": " << image_create_info.extent.width << "x" << image_create_info.extent.height
+            << " from level " << first_level << ", " << levels << " mip levels, " << image_mem_reqs.size << " bytes, written in place" << std::endl;
+
+        return (true);
+    }
+
+    application::device_image application::upload_staged_texture(const std::string& file_name, staged_texture& staged, uint32_t first_level)
+    {
+        // Create a backing image.
+        device_image optimized_texture;
+        vk::Format format(staged.format);
+        uint32_t layers = staged.layers;
+
+        // Textures shipped without mips get a full chain, each level blitted from the one above, when
+        // the format can be blitted and filtered linearly. Compressed formats cannot.
+        uint32_t loaded_levels = static_cast<uint32_t>(staged.regions.size()) / layers;
+        uint32_t levels = loaded_levels;
+        if (staged.single_level) {
+            const vk::FormatFeatureFlags blit_features =
+                vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+            vk::FormatProperties format_properties(m_physical_device.getFormatProperties(format, m_dispatch));
+            if ((format_properties.optimalTilingFeatures & blit_features) == blit_features) {
+                uint32_t largest_extent = std::max(staged.extent.width, staged.extent.height);
+                while ((largest_extent >> levels) > 0) {
+                    ++levels;
+                }
+            }
+        }
+        bool generate_mips = (levels > loaded_levels);
+
+        vk::ImageCreateInfo image_create_info;
+        image_create_info.imageType = vk::ImageType::e2D;
+        image_create_info.extent = staged.extent;
+        image_create_info.mipLevels = levels;
+        image_create_info.arrayLayers = layers;
+        image_create_info.format = format;
+        image_create_info.tiling = vk::ImageTiling::eOptimal;
+        image_create_info.initialLayout = vk::ImageLayout::eUndefined;
+        image_create_info.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst |
+            (generate_mips ? vk::ImageUsageFlagBits::eTransferSrc : vk::ImageUsageFlags());
+        image_create_info.sharingMode = vk::SharingMode::eExclusive;
+        image_create_info.samples = vk::SampleCountFlagBits::e1;
+
+        optimized_texture.image = m_device.createImage(image_create_info, nullptr, m_dispatch);
+
+        // Allocate memory for the image object.
+        vk::MemoryRequirements image_mem_reqs = m_device.getImageMemoryRequirements(optimized_texture.image, m_dispatch);
+
+        vk::MemoryAllocateInfo image_alloc_info;
+        image_alloc_info.allocationSize = image_mem_reqs.size;
+        image_alloc_info.memoryTypeIndex = get_memory_type(image_mem_reqs.memoryTypeBits, optimized_memory_properties);
+        optimized_texture.device_memory = m_device.allocateMemory(image_alloc_info, nullptr, m_dispatch);
+        m_device.bindImageMemory(optimized_texture.image, optimized_texture.device_memory, 0, m_dispatch);
+
+        // Create a image view to access the image through.
+        vk::ImageSubresourceRange subresource_range;
+        subresource_range.aspectMask = vk::ImageAspectFlagBits::eColor;
+        subresource_range.baseMipLevel = 0;
+        subresource_range.levelCount = levels;
+        subresource_range.baseArrayLayer = 0;
+        subresource_range.layerCount = layers;
+
+        // Materials sample every texture as an array; single textures are one layer.
+        vk::ImageViewCreateInfo image_view_create_info;
+        image_view_create_info.image = optimized_texture.image;
+        image_view_create_info.viewType = vk::ImageViewType::e2DArray;
+        image_view_create_info.format = image_create_info.format;
+        image_view_create_info.subresourceRange = subresource_range;
+
+        optimized_texture.view = m_device.createImageView(image_view_create_info, nullptr, m_dispatch);
+
+        // Record a command buffer to copy the staging buffer to the optimized image.
+        vk::CommandBuffer copy_command_buffer = create_one_time_command_buffer();
+
+        vk::ImageMemoryBarrier start_barrier;
+        start_barrier.srcAccessMask = vk::AccessFlags();
+        start_barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        start_barrier.oldLayout = vk::ImageLayout::eUndefined;
+        start_barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+        start_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        start_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        start_barrier.image = optimized_texture.image;
+        start_barrier.subresourceRange = subresource_range;
+        copy_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &start_barrier, m_dispatch);
+
+        // Every staged level and layer in one copy.
+        copy_command_buffer.copyBufferToImage(staged.buffer.buffer, optimized_texture.image, vk::ImageLayout::eTransferDstOptimal,
+            static_cast<uint32_t>(staged.regions.size()), staged.regions.data(), m_dispatch);
+
+        vk::ImageMemoryBarrier end_barriers[2];
+        uint32_t end_barrier_count = 0;
+        if (generate_mips) {
+            // Halve each level into the next; a level becomes a blit source once it has been written.
+            for (uint32_t level = 1; level < levels; ++level) {
+                vk::ImageMemoryBarrier source_barrier;
+                source_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+                source_barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+                source_barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+                source_barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+                source_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                source_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                source_barrier.image = optimized_texture.image;
+                source_barrier.subresourceRange = subresource_range;
+                source_barrier.subresourceRange.baseMipLevel = level - 1;
+                source_barrier.subresourceRange.levelCount = 1;
+                copy_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &source_barrier, m_dispatch);
+
+                vk::ImageBlit blit;
+                blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+                blit.srcSubresource.mipLevel = level - 1;
+                blit.srcSubresource.baseArrayLayer = 0;
+                blit.srcSubresource.layerCount = layers;
+                blit.srcOffsets[0] = vk::Offset3D(0, 0, 0);
+                blit.srcOffsets[1] = vk::Offset3D(
+                    std::max(static_cast<int32_t>(image_create_info.extent.width >> (level - 1)), 1),
+                    std::max(static_cast<int32_t>(image_create_info.extent.height >> (level - 1)), 1),
+                    1);
+                blit.dstSubresource = blit.srcSubresource;
+                blit.dstSubresource.mipLevel = level;
+                blit.dstOffsets[0] = vk::Offset3D(0, 0, 0);
+                blit.dstOffsets[1] = vk::Offset3D(
+                    std::max(static_cast<int32_t>(image_create_info.extent.width >> level), 1),
+                    std::max(static_cast<int32_t>(image_create_info.extent.height >> level), 1),
+                    1);
+                copy_command_buffer.blitImage(
+                    optimized_texture.image, vk::ImageLayout::eTransferSrcOptimal,
+                    optimized_texture.image, vk::ImageLayout::eTransferDstOptimal,
+                    1, &blit, vk::Filter::eLinear, m_dispatch);
+            }
+
+            // Every level but the last was a blit source.
+            vk::ImageMemoryBarrier& source_levels_barrier(end_barriers[end_barrier_count++]);
+            source_levels_barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+            source_levels_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+            source_levels_barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+            source_levels_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            source_levels_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            source_levels_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            source_levels_barrier.image = optimized_texture.image;
+            source_levels_barrier.subresourceRange = subresource_range;
+            source_levels_barrier.subresourceRange.levelCount = levels - 1;
+        }
+
+        vk::ImageMemoryBarrier& end_barrier(end_barriers[end_barrier_count++]);
+        end_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        end_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        end_barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        end_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        end_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        end_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        end_barrier.image = optimized_texture.image;
+        end_barrier.subresourceRange = subresource_range;
+        if (generate_mips) {
+            end_barrier.subresourceRange.baseMipLevel = levels - 1;
+            end_barrier.subresourceRange.levelCount = 1;
+        }
+        copy_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr, 0, nullptr, end_barrier_count, end_barriers, m_dispatch);
+
+        // TODO: Rather than finish here, we could wait at the end of the application constructor; will need to
+        // remember staging details to be freed there.
+        finish_one_time_command_buffer(copy_command_buffer);
+
+        // Cleanup.
+        cleanup_one_time_command_buffer(copy_command_buffer);
+        cleanup_device_buffer(staged.buffer);
+        staged.buffer = device_buffer();
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Texture " << file_name << ": " << image_create_info.extent.width << "x" << image_create_info.extent.height
+            << " from level " << first_level << ", " << levels << " mip levels (" << (levels - loaded_levels) << " generated), "
+            << image_mem_reqs.size << " bytes" << std::endl;
+
+        return (optimized_texture);
+    }
+
+    std::shared_ptr<application::device_image> application::create_owned_texture(const std::string& name, const gli::texture& gli_texture)
+    {
+        std::shared_ptr<device_image> texture(new device_image(upload_texture(name, gli_texture, 0)), [this](device_image* t) {
+            release_device_image(*t);
+            delete t;
+        });
+        return (texture);
+    }
+
+    void application::pack_textures(const std::string& scene_name, texture_pack_map& packs, std::map<int, material_image>& images)
+    {
+        uint32_t max_layers = m_physical_device.getProperties(m_dispatch).limits.maxImageArrayLayers;
+        uint32_t array_count = 0;
+        for (texture_pack_map::value_type& pack : packs) {
+            const std::vector<int>& pack_images(pack.second);
+            if (pack_images.size() == 1) {
+                // Nothing to share an array with.
+                material_image& image(images.at(pack_images[0]));
+                if (image.file) {
+                    image.texture = cache_texture(image.name, image.write_time, image.texels);
+                    image.cached = true;
+                }
+                else {
+                    image.texture = create_owned_texture(image.name, image.texels);
+                }
+                image.texels = gli::texture();
+                continue;
+            }
+
+            gli::format format(static_cast<gli::format>(std::get<0>(pack.first)));
+            gli::extent2d extent(std::get<1>(pack.first), std::get<2>(pack.first));
+            size_t levels = std::get<3>(pack.first);
+            for (size_t first = 0; first < pack_images.size(); first += max_layers) {
+                size_t layers = std::min(pack_images.size() - first, static_cast<size_t>(max_layers));
+                gli::texture2d_array array(format, extent, layers, levels);
+                for (size_t layer = 0; layer < layers; ++layer) {
+                    const gli::texture& texels(images.at(pack_images[first + layer]).texels);
+                    for (size_t level = 0; level < levels; ++level) {
+                        memcpy(array.data(layer, 0, level), texels.data(0, 0, level), texels.size(level));
+                    }
+                }
+
+                std::shared_ptr<device_image> texture(create_owned_texture(scene_name + " texture array " + std::to_string(array_count++), array));
+                for (size_t layer = 0; layer < layers; ++layer) {
+                    material_image& image(images.at(pack_images[first + layer]));
+                    image.texture = texture;
+                    image.layer = static_cast<uint32_t>(layer);
+                    image.texels = gli::texture();
+                }
+            }
+        }
+    }
+
+    std::shared_ptr<application::device_image> application::create_decoded_texture(const std::string& name, image_decode& decode)
+    {
+        wait_for_decode(name, decode);
+        m_device.unmapMemory(decode.staged.buffer.device_memory, m_dispatch);
+        decode.mapped = nullptr;
+
+        std::shared_ptr<device_image> texture(new device_image(upload_staged_texture(name, decode.staged, 0)), [this](device_image* t) {
+            release_device_image(*t);
+            delete t;
+        });
+        return (texture);
+    }
+
+    void application::wait_for_decode(const std::string& name, image_decode& decode)
+    {
+        decode.wait();
+        if (!decode.decoded) {
+            BOOST_THROW_EXCEPTION(error::file_exception()
+                << error::errinfo_file_exception_file(name.c_str()));
+        }
+    }
+
+    void application::cleanup_image_decode(image_decode& decode)
+    {
+        // Only images that were never uploaded still hold their staging buffer.
+        if (!decode.staged.buffer.buffer) {
+            return;
+        }
+
+        if (decode.mapped) {
+            m_device.unmapMemory(decode.staged.buffer.device_memory, m_dispatch);
+        }
+        cleanup_device_buffer(decode.staged.buffer);
+    }
+
+    gli::texture application::load_texture_file(const std::string& file_name, std::time_t write_time)
+    {
+        gli::texture gli_texture(gli::load(file_name));
+        if (gli_texture.empty()) {
+            BOOST_THROW_EXCEPTION(error::file_exception()
+                << error::errinfo_file_exception_file(file_name.c_str()));
+        }
+
+        encode_texture(file_name, write_time, gli_texture);
+        return (gli_texture);
+    }
+
+    void application::encode_texture(const std::string& file_name, std::time_t write_time, gli::texture& gli_texture)
+    {
+        // Pointless when the device cannot sample the result.
+        if (!m_options.encode_textures || !m_texture_compression_bc_supported || m_options.decode_bc ||
+            (gli_texture.target() != gli::TARGET_2D)) {
+            return;
+        }
+
+        uint32_t texel_size;
+        bool bgra;
+        bool srgb;
+        if (!rgba8_source_format(gli_texture.format(), texel_size, bgra, srgb)) {
+            return;
+        }
+
+        // Encoded once per version of the file.
+        boost::filesystem::path cache_file_path(texture_cache_file(file_name, write_time));
+        boost::system::error_code error;
+        if (boost::filesystem::exists(cache_file_path, error)) {
+            gli::texture cached(gli::load(cache_file_path.string()));
+            if (!cached.empty()) {
+                gli_texture = cached;
+                return;
+            }
+        }
+
+        std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+
+        // RGBA8 levels. Compressed levels cannot be blitted on the GPU, so files without mips get a box
+        // filtered chain here.
+        gli::extent3d extent(gli_texture.extent());
+        uint32_t level_count = static_cast<uint32_t>(gli_texture.levels());
+        if (level_count == 1) {
+            uint32_t largest_extent = static_cast<uint32_t>(std::max(extent.x, extent.y));
+            while ((largest_extent >> level_count) > 0) {
+                ++level_count;
+            }
+        }
+
+        std::vector<std::vector<uint8_t>> levels;
+        bool opaque = rgba8_levels(gli_texture, texel_size, bgra, srgb, level_count, levels);
+
+        // BC1 for opaque textures, BC7 for the rest.
+        bcn::format encoder = opaque ? bcn::format::bc1_rgb : bcn::format::bc7;
+        gli::format encoded_format = opaque ?
+            (srgb ? gli::FORMAT_RGB_DXT1_SRGB_BLOCK8 : gli::FORMAT_RGB_DXT1_UNORM_BLOCK8) :
+            (srgb ? gli::FORMAT_RGBA_BP_SRGB_BLOCK16 : gli::FORMAT_RGBA_BP_UNORM_BLOCK16);
+        gli::texture encoded(gli::TARGET_2D, encoded_format, extent, 1, 1, level_count);
+
+        // Bands of block rows over every level, encoded across the pool.
+        struct encode_band {
+            const uint8_t* rgba;
+            uint8_t* blocks;
+            uint32_t width;
+            uint32_t height;
+            uint32_t first_row;
+            uint32_t end_row;
+        };
+        std::vector<encode_band> bands;
+        size_t source_size = 0;
+        for (uint32_t level = 0; level < level_count; ++level) {
+            encode_band band;
+            band.rgba = levels[level].data();
+            band.blocks = static_cast<uint8_t*>(encoded.data(0, 0, level));
+            band.width = std::max(static_cast<uint32_t>(extent.x) >> level, 1u);
+            band.height = std::max(static_cast<uint32_t>(extent.y) >> level, 1u);
+
+            uint32_t block_rows = (band.height + 3) / 4;
+            for (uint32_t row = 0; row < block_rows; row += bcn_encode_band_rows) {
+                band.first_row = row;
+                band.end_row = std::min(row + bcn_encode_band_rows, block_rows);
+                bands.push_back(band);
+            }
+            source_size += levels[level].size();
+        }
+
+        m_thread_pool.parallel_for(bands.size(), [&](size_t i) {
+            const encode_band& band(bands[i]);
+            bcn::encode_rows(encoder, band.rgba, band.width, band.height, band.first_row, band.end_row, band.blocks);
+        });
+
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+        // A cache that cannot be written only costs the next load another encode.
+        boost::filesystem::create_directories(cache_file_path.parent_path(), error);
+        bool cached = gli::save_dds(encoded, cache_file_path.string());
+
+        {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream
+                << "Texture " << file_name << ": encoded " << source_size << " bytes of RGBA8 to " << encoded.size() << " bytes of "
+                << bcn::name(encoder) << " in " << (seconds * 1000.0f) << " ms ("
+                << ((seconds > 0.0f) ? (source_size / (seconds * 1024.0f * 1024.0f)) : 0.0f) << " MB/s)"
+                << (cached ? "" : ", not cached") << std::endl;
+        }
+
+        gli_texture = encoded;
+    }
+
+    void application::decode_texture(const std::string& file_name, gli::texture& gli_texture, uint32_t first_level)
+    {
+        bcn::format decoder;
+        gli::format decoded_format;
+        if (!bcn_decoder_format(gli_texture.format(), decoder, decoded_format)) {
+            return;
+        }
+
+        vk::FormatProperties format_properties(m_physical_device.getFormatProperties(static_cast<vk::Format>(gli_texture.format()), m_dispatch));
+        bool sampled = m_texture_compression_bc_supported &&
+            (format_properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
+        if (sampled && !m_options.decode_bc) {
+            return;
+        }
+
+        decode_bcn_texture(file_name, gli_texture, first_level);
+    }
+
+    void application::decode_bcn_texture(const std::string& file_name, gli::texture& gli_texture, uint32_t first_level)
+    {
+        bcn::format decoder;
+        gli::format decoded_format;
+        if (!bcn_decoder_format(gli_texture.format(), decoder, decoded_format)) {
+            return;
+        }
+
+        std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+
+        // Levels before first_level are not uploaded, so they stay undecoded.
+        gli::texture decoded(gli_texture.target(), decoded_format, gli_texture.extent(), gli_texture.layers(), gli_texture.faces(), gli_texture.levels());
+
+        // Bands of block rows over every level, layer and face, decoded across the pool.
+        struct decode_band {
+            const uint8_t* blocks;
+            uint8_t* rgba;
+            uint32_t width;
+            uint32_t height;
+            uint32_t first_row;
+            uint32_t end_row;
+        };
+        std::vector<decode_band> bands;
+        size_t decoded_size = 0;
+        for (size_t layer = 0; layer < gli_texture.layers(); ++layer) {
+            for (size_t face = 0; face < gli_texture.faces(); ++face) {
+                for (size_t level = first_level; level < gli_texture.levels(); ++level) {
+                    gli::extent3d extent(gli_texture.extent(level));
+                    decode_band band;
+                    band.blocks = static_cast<const uint8_t*>(gli_texture.data(layer, face, level));
+                    band.rgba = static_cast<uint8_t*>(decoded.data(layer, face, level));
+                    band.width = static_cast<uint32_t>(extent.x);
+                    band.height = static_cast<uint32_t>(extent.y);
+
+                    uint32_t block_rows = (band.height + 3) / 4;
+                    for (uint32_t row = 0; row < block_rows; row += bcn_decode_band_rows) {
+                        band.first_row = row;
+                        band.end_row = std::min(row + bcn_decode_band_rows, block_rows);
+                        bands.push_back(band);
+                    }
+                    decoded_size += decoded.size(level);
+                }
+            }
+        }
+
+        m_thread_pool.parallel_for(bands.size(), [&](size_t i) {
+            const decode_band& band(bands[i]);
+            bcn::decode_rows(decoder, band.blocks, band.width, band.height, band.first_row, band.end_row, band.rgba);
+        });
+
+        gli_texture = decoded;
+
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Texture " << file_name << ": decoded " << bcn::name(decoder) << " to " << decoded_size << " bytes of RGBA8 in "
+            << (seconds * 1000.0f) << " ms (" << ((seconds > 0.0f) ? (decoded_size / (seconds * 1024.0f * 1024.0f)) : 0.0f) << " MB/s)" << std::endl;
+    }
+
+    void application::textures_cleanup()
+    {
+        // The images themselves went with the scenes that used them.
+        std::lock_guard<std::mutex> texture_lock(m_texture_mutex);
+        m_textures.clear();
+    }
+
+    void application::stream_textures()
+    {
+        // Screen size of each draw's bounds, as for levels of detail. Texture coordinates are assumed
+        // to span the bounds once, so a texture is needed at the coarsest level still covering as many
+        // texels as the largest of its draws covers pixels.
+        glm::vec3 clip_y_row(m_camera_transform[0][1], m_camera_transform[1][1], m_camera_transform[2][1]);
+        glm::vec3 clip_w_row(m_camera_transform[0][3], m_camera_transform[1][3], m_camera_transform[2][3]);
+        float pixels_per_unit = glm::length(clip_y_row) * 0.5f * static_cast<float>(m_swap_chain_extent.height);
+        bool perspective = (glm::dot(clip_w_row, clip_w_row) > 0.0f);
+        uint64_t frame = m_submitted_frame_serial;
+
+        std::vector<residency_request> requests;
+        {
+            std::lock_guard<std::mutex> texture_lock(m_texture_mutex);
+            for (const scene_pointer& scene : m_scenes) {
+                m_texture_footprints.assign(scene->textures.size(), 0.0f);
+                for (const draw_record& d : scene->draws) {
+                    const glm::mat4& transform(scene->transforms.world(d.transform_index));
+                    float scale = std::sqrt(std::max(glm::dot(transform[0], transform[0]),
+                        std::max(glm::dot(transform[1], transform[1]), glm::dot(transform[2], transform[2]))));
+                    float radius = d.geometry.bounds_radius * scale;
+
+                    // Anything touching the camera needs full detail; anything behind it nothing.
+                    float footprint = pixels_per_unit * 2.0f * radius;
+                    if (perspective) {
+                        glm::vec4 clip_center(m_camera_transform * (transform * glm::vec4(d.geometry.bounds_center, 1.0f)));
+                        if ((clip_center.w + radius) <= 0.0f) {
+                            continue;
+                        }
+
+                        float distance = clip_center.w - radius;
+                        footprint = (distance > 0.0f) ? (footprint / distance) : std::numeric_limits<float>::max();
+                    }
+
+                    float& texture_footprint(m_texture_footprints[d.texture_index]);
+                    texture_footprint = std::max(texture_footprint, footprint);
+                }
+
+                for (size_t t = 0; t < scene->textures.size(); ++t) {
+                    // Cache entries replaced by a reload belong to another image.
+                    texture_cache::iterator cached(m_textures.find(scene->texture_files[t]));
+                    if ((m_texture_footprints[t] <= 0.0f) || (cached == m_textures.end()) ||
+                        (cached->second.texture.lock() != scene->textures[t])) {
+                        continue;
+                    }
+
+                    cached_texture& residency(cached->second);
+                    uint32_t texels = std::max(residency.width, residency.height);
+                    uint32_t level = 0;
+                    while ((level < residency.tail_level) && (static_cast<float>(texels >> (level + 1)) >= m_texture_footprints[t])) {
+                        ++level;
+                    }
+
+                    // Several scenes may draw the same texture this frame.
+                    residency.wanted_level = (residency.last_used_frame == frame) ? std::min(residency.wanted_level, level) : level;
+                    residency.last_used_frame = frame;
+                }
+            }
+
+            // Most recently used textures claim the budget first; cold textures fall back to their tail
+            // and whatever no longer fits gives up levels, so eviction goes least recently used first.
+            std::vector<texture_cache::value_type*> streamed;
+            for (texture_cache::value_type& cached : m_textures) {
+                if ((cached.second.tail_level > 0) && !cached.second.texture.expired()) {
+                    streamed.push_back(&cached);
+                }
+            }
+            std::sort(streamed.begin(), streamed.end(), [](const texture_cache::value_type* a, const texture_cache::value_type* b) {
+                return (a->second.last_used_frame > b->second.last_used_frame);
+            });
+
+            vk::DeviceSize budget_used = 0;
+            for (texture_cache::value_type* cached : streamed) {
+                cached_texture& residency(cached->second);
+                auto resident_size = [&residency](uint32_t first_level) {
+                    return (std::accumulate(residency.level_sizes.begin() + first_level, residency.level_sizes.end(), vk::DeviceSize(0)));
+                };
+
+                // Hot textures keep levels they no longer need until the budget runs out, so they do
+                // not reload back and forth as the view moves.
+                bool hot = ((frame - residency.last_used_frame) < texture_cold_frames);
+                uint32_t level = hot ? std::min(residency.wanted_level, residency.resident_level) : residency.tail_level;
+                while ((level < residency.tail_level) && ((budget_used + resident_size(level)) > m_options.texture_budget)) {
+                    ++level;
+                }
+                budget_used += resident_size(level);
+
+                // One change at a time per texture.
+                if ((level != residency.resident_level) && (residency.requested_level == residency.resident_level)) {
+                    residency.requested_level = level;
+
+                    residency_request request;
+                    request.file_name = cached->first;
+                    request.texture = residency.texture;
+                    request.level = level;
+                    requests.push_back(request);
+                }
+            }
+        }
+
+        if (requests.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+        m_residency_requests.insert(m_residency_requests.end(), requests.begin(), requests.end());
+        m_load_requested.notify_one();
+    }
+
+    application::residency_change application::load_residency(const residency_request& request)
+    {
+        residency_change change;
+        change.file_name = request.file_name;
+        change.texture = request.texture;
+        change.level = request.level;
+
+        // The file is read whole again, but only the requested levels are uploaded.
+        try {
+            gli::texture gli_texture(load_texture_file(request.file_name, file_write_time(request.file_name)));
+            if (request.level >= gli_texture.levels()) {
+                BOOST_THROW_EXCEPTION(error::file_exception()
+                    << error::errinfo_file_exception_file(request.file_name.c_str()));
+            }
+
+            decode_texture(request.file_name, gli_texture, request.level);
+            change.image = upload_texture(request.file_name, gli_texture, request.level);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream
+                << "Texture " << request.file_name << " failed to stream: "
+                << boost::current_exception_diagnostic_information() << std::endl;
+        }
+
+        return (change);
+    }
+
+    void application::apply_residency_change(residency_change& change)
+    {
+        std::shared_ptr<device_image> texture(change.texture.lock());
+
+        // The texture may have been released, or reloaded from a changed file, in the meantime.
+        std::lock_guard<std::mutex> texture_lock(m_texture_mutex);
+        texture_cache::iterator cached(m_textures.find(change.file_name));
+        bool current = texture && (cached != m_textures.end()) && (cached->second.texture.lock() == texture);
+        if (!current || !change.image.image) {
+            if (change.image.image) {
+                release_device_image(change.image);
+            }
+            if (current) {
+                cached->second.requested_level = cached->second.resident_level;
+            }
+            return;
+        }
+
+        // Frames in flight still sample the old image; scenes get sets for the new view before the
+        // next frame is recorded.
+        release_device_image(*texture);
+        *texture = change.image;
+        cached->second.resident_level = change.level;
+        cached->second.requested_level = change.level;
+    }
+
+    void application::virtual_textures_init()
+    {
+        if (m_options.virtual_texture_budget == 0) {
+            return;
+        }
+
+        // A square atlas of page slots within the budget and the device's image size; slot coordinates
+        // get 12 bits in page table entries.
+        uint32_t max_slots_per_side = std::min(m_physical_device.getProperties(m_dispatch).limits.maxImageDimension2D / vt::slot_size, 4096u);
+        uint32_t budget_slots_per_side = static_cast<uint32_t>(std::sqrt(static_cast<double>(m_options.virtual_texture_budget) / vt::tile_bytes));
+        m_atlas_slots_per_side = std::max(std::min(budget_slots_per_side, max_slots_per_side), 2u);
+        uint32_t atlas_size = m_atlas_slots_per_side * vt::slot_size;
+
+        vk::ImageCreateInfo image_create_info;
+        image_create_info.imageType = vk::ImageType::e2D;
+        image_create_info.extent = vk::Extent3D(atlas_size, atlas_size, 1);
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.format = vk::Format::eR8G8B8A8Unorm;
+        image_create_info.tiling = vk::ImageTiling::eOptimal;
+        image_create_info.initialLayout = vk::ImageLayout::eUndefined;
+        image_create_info.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+        image_create_info.sharingMode = vk::SharingMode::eExclusive;
+        image_create_info.samples = vk::SampleCountFlagBits::e1;
+
+        m_atlas.image = m_device.createImage(image_create_info, nullptr, m_dispatch);
+
+        vk::MemoryRequirements image_mem_reqs = m_device.getImageMemoryRequirements(m_atlas.image, m_dispatch);
+
+        vk::MemoryAllocateInfo image_alloc_info;
+        image_alloc_info.allocationSize = image_mem_reqs.size;
+        image_alloc_info.memoryTypeIndex = get_memory_type(image_mem_reqs.memoryTypeBits, optimized_memory_properties);
+        m_atlas.device_memory = m_device.allocateMemory(image_alloc_info, nullptr, m_dispatch);
+        m_device.bindImageMemory(m_atlas.image, m_atlas.device_memory, 0, m_dispatch);
+
+        vk::ImageSubresourceRange subresource_range;
+        subresource_range.aspectMask = vk::ImageAspectFlagBits::eColor;
+        subresource_range.baseMipLevel = 0;
+        subresource_range.levelCount = 1;
+        subresource_range.baseArrayLayer = 0;
+        subresource_range.layerCount = 1;
+
+        // Materials sample every texture as an array.
+        vk::ImageViewCreateInfo image_view_create_info;
+        image_view_create_info.image = m_atlas.image;
+        image_view_create_info.viewType = vk::ImageViewType::e2DArray;
+        image_view_create_info.format = image_create_info.format;
+        image_view_create_info.subresourceRange = subresource_range;
+
+        m_atlas.view = m_device.createImageView(image_view_create_info, nullptr, m_dispatch);
+
+        // Slots are only sampled once a page has been copied in, so the atlas starts out undefined.
+        vk::CommandBuffer layout_command_buffer = create_one_time_command_buffer();
+
+        vk::ImageMemoryBarrier layout_barrier;
+        layout_barrier.srcAccessMask = vk::AccessFlags();
+        layout_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        layout_barrier.oldLayout = vk::ImageLayout::eUndefined;
+        layout_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        layout_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        layout_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        layout_barrier.image = m_atlas.image;
+        layout_barrier.subresourceRange = subresource_range;
+        layout_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &layout_barrier, m_dispatch);
+
+        finish_one_time_command_buffer(layout_command_buffer);
+        cleanup_one_time_command_buffer(layout_command_buffer);
+
+        // Scenes hold the atlas in place of their virtual textures; it outlives every scene.
+        m_atlas_texture.reset(&m_atlas, [](device_image*) {});
+        m_page_cache = vt::page_cache(m_atlas_slots_per_side * m_atlas_slots_per_side);
+
+        m_virtual_texture_states.resize(vt::max_textures);
+        m_virtual_texture_infos.assign(vt::max_textures, virtual_texture_info());
+        for (uint32_t id = vt::max_textures; id-- > 0;) {
+            m_free_virtual_texture_ids.push_back(id);
+        }
+
+        // Per frame in flight: the page table, the requests its pixels write, and staging for the pages
+        // uploaded when it is recorded. Buffers stay mapped for their lifetime.
+        uint32_t frames_in_flight = static_cast<uint32_t>(m_swap_chain_color_images.size());
+        m_feedback_cells_x = (m_swap_chain_extent.width + feedback_cell_size - 1) / feedback_cell_size;
+        m_feedback_cell_count = m_feedback_cells_x * ((m_swap_chain_extent.height + feedback_cell_size - 1) / feedback_cell_size);
+        size_t page_table_size = (vt::max_textures * sizeof(virtual_texture_info)) + (virtual_page_table_initial_entries * sizeof(uint32_t));
+        size_t feedback_size = m_feedback_cell_count * sizeof(uint32_t);
+        size_t staging_size = virtual_page_uploads_per_frame * vt::tile_bytes;
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            device_buffer& page_table_buffer = *m_page_table_buffers.emplace(m_page_table_buffers.end(),
+                create_device_buffer(vk::BufferUsageFlagBits::eStorageBuffer, page_table_size, ubo_memory_properties));
+            m_frame_page_tables.push_back(reinterpret_cast<uint32_t*>(
+                m_device.mapMemory(page_table_buffer.device_memory, 0, page_table_size, vk::MemoryMapFlags(), m_dispatch)));
+            std::memset(m_frame_page_tables.back(), 0, page_table_size);
+            m_page_table_capacities.push_back(virtual_page_table_initial_entries);
+
+            // Nothing was requested before the first frame.
+            device_buffer& feedback_buffer = *m_feedback_buffers.emplace(m_feedback_buffers.end(),
+                create_device_buffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, feedback_size, ubo_memory_properties));
+            uint32_t* feedback = reinterpret_cast<uint32_t*>(
+                m_device.mapMemory(feedback_buffer.device_memory, 0, feedback_size, vk::MemoryMapFlags(), m_dispatch));
+            std::fill(feedback, feedback + m_feedback_cell_count, vt::no_request);
+            m_frame_feedback.push_back(feedback);
+
+            device_buffer& staging_buffer = *m_virtual_staging_buffers.emplace(m_virtual_staging_buffers.end(),
+                create_device_buffer(vk::BufferUsageFlagBits::eTransferSrc, staging_size, staging_memory_properties));
+            m_frame_virtual_staging.push_back(reinterpret_cast<uint8_t*>(
+                m_device.mapMemory(staging_buffer.device_memory, 0, staging_size, vk::MemoryMapFlags(), m_dispatch)));
+        }
+        m_page_table_dirty.resize(frames_in_flight);
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Virtual textures: " << m_atlas_slots_per_side << "x" << m_atlas_slots_per_side << " page atlas of "
+            << image_mem_reqs.size << " bytes" << std::endl;
+    }
+
+    void application::virtual_textures_cleanup()
+    {
+        if (!m_atlas.image) {
+            return;
+        }
+
+        for (device_buffer_vector* buffers : { &m_page_table_buffers, &m_feedback_buffers, &m_virtual_staging_buffers }) {
+            for (device_buffer& b : *buffers) {
+                m_device.unmapMemory(b.device_memory, m_dispatch);
+                cleanup_device_buffer(b);
+            }
+            buffers->clear();
+        }
+        m_frame_page_tables.clear();
+        m_frame_feedback.clear();
+        m_frame_virtual_staging.clear();
+
+        m_uploading_virtual_tiles.clear();
+        m_read_virtual_tiles.clear();
+        m_atlas_texture.reset();
+        cleanup_device_image(m_atlas);
+        m_atlas = device_image();
+    }
+
+    application::virtual_texture_pointer application::create_virtual_texture(const std::string& file_name, std::time_t write_time, gli::texture& gli_texture)
+    {
+        // Each version of a file is tiled once, next to its encoded texture, and shared by every scene
+        // loading it.
+        boost::filesystem::path tile_file_path(texture_cache_file(file_name, write_time));
+        std::string tile_file(tile_file_path.replace_extension(".vt").string());
+        {
+            std::lock_guard<std::mutex> virtual_texture_lock(m_virtual_texture_mutex);
+            std::map<std::string, std::weak_ptr<virtual_texture>>::iterator shared(m_virtual_textures.find(tile_file));
+            if (shared != m_virtual_textures.end()) {
+                virtual_texture_pointer texture(shared->second.lock());
+                if (texture) {
+                    return (texture);
+                }
+            }
+        }
+
+        // Tile files are complete once their size matches their header.
+        vt::file_header header;
+        bool tiled = false;
+        {
+            std::ifstream tile_stream(tile_file, std::ios::binary | std::ios::ate);
+            if (tile_stream.is_open()) {
+                uint64_t file_size = static_cast<uint64_t>(tile_stream.tellg());
+                tile_stream.seekg(0);
+                tiled = tile_stream.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+                    (std::memcmp(header.magic, "GTBV", sizeof(header.magic)) == 0) && (header.version == vt::file_version) &&
+                    texture_pageable(header.width, header.height) &&
+                    (file_size == vt::tile_offset(vt::layout(header.width, header.height).page_count()));
+            }
+        }
+
+        if (!tiled) {
+            gli_texture = gli::load(file_name);
+            if (gli_texture.empty() || (gli_texture.target() != gli::TARGET_2D) ||
+                !texture_pageable(static_cast<uint32_t>(gli_texture.extent().x), static_cast<uint32_t>(gli_texture.extent().y)) ||
+                !build_tile_file(file_name, tile_file, gli_texture, header)) {
+                return (nullptr);
+            }
+        }
+
+        // The main thread sets up an id's page table before the first frame that can draw with it, and
+        // tears it down once every scene using it is gone.
+        virtual_texture_pointer texture;
+        {
+            std::lock_guard<std::mutex> virtual_texture_lock(m_virtual_texture_mutex);
+            if (!m_free_virtual_texture_ids.empty()) {
+                texture.reset(new virtual_texture, [this](virtual_texture* t) {
+                    {
+                        std::lock_guard<std::mutex> virtual_texture_lock(m_virtual_texture_mutex);
+                        std::map<std::string, std::weak_ptr<virtual_texture>>::iterator shared(m_virtual_textures.find(t->tile_file));
+                        if ((shared != m_virtual_textures.end()) && shared->second.expired()) {
+                            m_virtual_textures.erase(shared);
+                        }
+                        m_released_virtual_textures.push_back(t->id);
+                    }
+                    delete t;
+                });
+                texture->id = m_free_virtual_texture_ids.back();
+                m_free_virtual_texture_ids.pop_back();
+                texture->tile_file = tile_file;
+                texture->layout = vt::layout(header.width, header.height);
+                texture->srgb = (header.srgb != 0);
+
+                m_virtual_textures[tile_file] = texture;
+                m_added_virtual_textures.push_back(*texture);
+            }
+        }
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        if (texture) {
+            m_log_stream
+                << "Texture " << file_name << ": virtual, " << header.width << "x" << header.height << " in "
+                << texture->layout.page_count() << " pages" << std::endl;
+        }
+        else {
+            m_log_stream << "Texture " << file_name << ": not virtual, every virtual texture id is in use" << std::endl;
+        }
+
+        return (texture);
     }
 
-    application::device_image_vector::iterator application::create_texture(const std::string& file_name)
+    bool application::build_tile_file(const std::string& file_name, const std::string& tile_file, const gli::texture& gli_texture, vt::file_header& header)
     {
-        gli::texture gli_texture(gli::load(file_name));
-        if (gli_texture.empty()) {
-            BOOST_THROW_EXCEPTION(error::file_exception()
-                << error::errinfo_file_exception_file(file_name.c_str()));
+        // Block compressed files are decoded whether or not the device samples them; tiles are RGBA8.
+        gli::texture texels(gli_texture);
+        decode_bcn_texture(file_name, texels, 0);
+
+        uint32_t texel_size;
+        bool bgra;
+        bool srgb;
+        if (!rgba8_source_format(texels.format(), texel_size, bgra, srgb)) {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream << "Texture " << file_name << ": not virtual, its format cannot be tiled" << std::endl;
+            return (false);
+        }
+
+        std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+
+        uint32_t width = static_cast<uint32_t>(texels.extent().x);
+        uint32_t height = static_cast<uint32_t>(texels.extent().y);
+        vt::layout pages(width, height);
+        std::vector<std::vector<uint8_t>> levels;
+        rgba8_levels(texels, texel_size, bgra, srgb, pages.levels(), levels);
+
+        std::memcpy(header.magic, "GTBV", sizeof(header.magic));
+        header.version = vt::file_version;
+        header.width = width;
+        header.height = height;
+        header.srgb = srgb ? 1 : 0;
+
+        boost::system::error_code error;
+        boost::filesystem::create_directories(boost::filesystem::path(tile_file).parent_path(), error);
+        std::ofstream tile_stream(tile_file, std::ios::binary | std::ios::trunc);
+        tile_stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        // Each level's tiles are cut across the pool, then appended in page order.
+        std::vector<uint8_t> tiles;
+        for (uint32_t level = 0; level < pages.levels(); ++level) {
+            uint32_t pages_x = pages.pages_x(level);
+            uint32_t level_pages = pages_x * pages.pages_y(level);
+            tiles.resize(level_pages * vt::tile_bytes);
+            m_thread_pool.parallel_for(level_pages, [&](size_t i) {
+                vt::extract_tile(levels[level].data(), pages.width(level), pages.height(level),
+                    static_cast<uint32_t>(i % pages_x), static_cast<uint32_t>(i / pages_x), tiles.data() + (i * vt::tile_bytes));
+            });
+            tile_stream.write(reinterpret_cast<const char*>(tiles.data()), tiles.size());
+        }
+
+        tile_stream.close();
+        if (!tile_stream) {
+            boost::filesystem::remove(tile_file, error);
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream << "Texture " << file_name << ": not virtual, " << tile_file << " could not be written" << std::endl;
+            return (false);
+        }
+
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Texture " << file_name << ": tiled " << pages.page_count() << " pages of " << pages.levels() << " levels in "
+            << (seconds * 1000.0f) << " ms" << std::endl;
+        return (true);
+    }
+
+    void application::apply_virtual_texture_changes()
+    {
+        std::vector<virtual_texture> added;
+        std::vector<uint32_t> released;
+        {
+            std::lock_guard<std::mutex> virtual_texture_lock(m_virtual_texture_mutex);
+            added.swap(m_added_virtual_textures);
+            released.swap(m_released_virtual_textures);
+        }
+
+        for (const virtual_texture& texture : added) {
+            virtual_texture_state& state(m_virtual_texture_states[texture.id]);
+            state.live = true;
+            ++state.generation;
+            state.tile_file = texture.tile_file;
+            state.table = vt::page_table(texture.layout);
+            state.page_table_offset = allocate_page_table_range(texture.layout.page_count());
+
+            virtual_texture_info& info(m_virtual_texture_infos[texture.id]);
+            info.page_table_offset = state.page_table_offset;
+            info.width = texture.layout.width(0);
+            info.height = texture.layout.height(0);
+            info.levels = texture.layout.levels() | (texture.srgb ? 0x100 : 0);
+
+            // The range may still hold a released texture's entries.
+            m_page_table_changes.resize(texture.layout.page_count());
+            std::iota(m_page_table_changes.begin(), m_page_table_changes.end(), 0u);
+            publish_page_table_changes(state);
+
+            // The coarsest page is loaded up front and never evicted, so every lookup finds something
+            // once it is in.
+            read_virtual_page(texture.id, texture.layout.page_count() - 1);
+        }
+
+        if (released.empty()) {
+            return;
+        }
+
+        for (uint32_t id : released) {
+            virtual_texture_state& state(m_virtual_texture_states[id]);
+            m_page_cache.release_texture(id);
+            free_page_table_range(state.page_table_offset, state.table.pages().page_count());
+            state.live = false;
+            state.table = vt::page_table();
+            m_virtual_texture_infos[id] = virtual_texture_info();
+        }
+
+        std::lock_guard<std::mutex> virtual_texture_lock(m_virtual_texture_mutex);
+        m_free_virtual_texture_ids.insert(m_free_virtual_texture_ids.end(), released.begin(), released.end());
+    }
+
+    void application::update_virtual_textures(vk::CommandBuffer command_buffer, uint32_t frame)
+    {
+        // Pages drawn by this frame count as used as of its serial.
+        uint64_t frame_serial = m_submitted_frame_serial + 1;
+
+        // What this frame's pixels asked for the last time it was drawn; that has completed.
+        m_feedback_requests.assign(m_frame_feedback[frame], m_frame_feedback[frame] + m_feedback_cell_count);
+        std::sort(m_feedback_requests.begin(), m_feedback_requests.end());
+        m_feedback_requests.erase(std::unique(m_feedback_requests.begin(), m_feedback_requests.end()), m_feedback_requests.end());
+
+        // Resident pages a request falls back on count as used too, so they are not evicted from under
+        // it; missing ones are read coarsest first.
+        m_virtual_page_reads.clear();
+        for (uint32_t request : m_feedback_requests) {
+            // No request decodes as texture 255, which is never handed out.
+            uint32_t texture = vt::request_texture(request);
+            if ((texture >= vt::max_textures) || !m_virtual_texture_states[texture].live) {
+                continue;
+            }
+
+            // Requests from a released texture whose id was reused may not fit.
+            const virtual_texture_state& state(m_virtual_texture_states[texture]);
+            const vt::layout& pages(state.table.pages());
+            uint32_t level = vt::request_level(request);
+            uint32_t x = vt::request_page_x(request);
+            uint32_t y = vt::request_page_y(request);
+            if ((level >= pages.levels()) || (x >= pages.pages_x(level)) || (y >= pages.pages_y(level))) {
+                continue;
+            }
+
+            for (uint32_t page = pages.page(level, x, y);;) {
+                uint32_t slot = state.table.slot(page);
+                if (slot != vt::unmapped) {
+                    m_page_cache.touch(slot, frame_serial);
+                }
+                else {
+                    m_virtual_page_reads.emplace_back(level, texture, page);
+                }
+
+                if ((level + 1) == pages.levels()) {
+                    break;
+                }
+                page = pages.parent(level, x, y);
+                pages.coordinates(page, level, x, y);
+            }
+        }
+
+        std::sort(m_virtual_page_reads.begin(), m_virtual_page_reads.end(), std::greater<std::tuple<uint32_t, uint32_t, uint32_t>>());
+        m_virtual_page_reads.erase(std::unique(m_virtual_page_reads.begin(), m_virtual_page_reads.end()), m_virtual_page_reads.end());
+        uint32_t reads = 0;
+        for (const std::tuple<uint32_t, uint32_t, uint32_t>& read : m_virtual_page_reads) {
+            if ((reads == virtual_page_reads_per_frame) || (m_pending_virtual_pages.size() >= virtual_page_reads_in_flight)) {
+                break;
+            }
+            if (read_virtual_page(std::get<1>(read), std::get<2>(read))) {
+                ++reads;
+            }
+        }
+
+        // Tiles read since the last frame join those still waiting for a slot.
+        {
+            std::lock_guard<std::mutex> virtual_texture_lock(m_virtual_texture_mutex);
+            for (virtual_tile& tile : m_read_virtual_tiles) {
+                m_uploading_virtual_tiles.push_back(std::move(tile));
+            }
+            m_read_virtual_tiles.clear();
+        }
+
+        uint8_t* staging = m_frame_virtual_staging[frame];
+        m_virtual_page_copies.clear();
+        size_t waiting = 0;
+        for (size_t i = 0; i < m_uploading_virtual_tiles.size(); ++i) {
+            virtual_tile& tile(m_uploading_virtual_tiles[i]);
+            uint64_t pending_key = (static_cast<uint64_t>(tile.texture) << 32) | tile.page;
+
+            // Tiles of released textures, failed reads and pages that made it in meanwhile are dropped.
+            virtual_texture_state& state(m_virtual_texture_states[tile.texture]);
+            if (!state.live || (state.generation != tile.generation) || tile.texels.empty() || (state.table.slot(tile.page) != vt::unmapped)) {
+                m_pending_virtual_pages.erase(pending_key);
+                continue;
+            }
+
+            // Tiles wait when this frame's staging is full or every slot is in use by this frame.
+            uint32_t slot;
+            bool evicted;
+            uint32_t evicted_texture;
+            uint32_t evicted_page;
+            if ((m_virtual_page_copies.size() == virtual_page_uploads_per_frame) ||
+                !m_page_cache.allocate(frame_serial, slot, evicted, evicted_texture, evicted_page)) {
+                if (waiting != i) {
+                    m_uploading_virtual_tiles[waiting] = std::move(tile);
+                }
+                ++waiting;
+                continue;
+            }
+
+            uint32_t level, x, y;
+            if (evicted) {
+                virtual_texture_state& owner(m_virtual_texture_states[evicted_texture]);
+                owner.table.pages().coordinates(evicted_page, level, x, y);
+                owner.table.unmap(level, x, y, m_page_table_changes);
+                publish_page_table_changes(owner);
+            }
+
+            uint32_t slot_x = slot % m_atlas_slots_per_side;
+            uint32_t slot_y = slot / m_atlas_slots_per_side;
+
+            vk::BufferImageCopy copy;
+            copy.bufferOffset = m_virtual_page_copies.size() * vt::tile_bytes;
+            copy.bufferRowLength = 0;
+            copy.bufferImageHeight = 0;
+            copy.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            copy.imageSubresource.mipLevel = 0;
+            copy.imageSubresource.baseArrayLayer = 0;
+            copy.imageSubresource.layerCount = 1;
+            copy.imageOffset = vk::Offset3D(static_cast<int32_t>(slot_x * vt::slot_size), static_cast<int32_t>(slot_y * vt::slot_size), 0);
+            copy.imageExtent = vk::Extent3D(vt::slot_size, vt::slot_size, 1);
+            std::memcpy(staging + copy.bufferOffset, tile.texels.data(), vt::tile_bytes);
+            m_virtual_page_copies.push_back(copy);
+
+            const vt::layout& pages(state.table.pages());
+            pages.coordinates(tile.page, level, x, y);
+            m_page_cache.assign(slot, tile.texture, tile.page, frame_serial, (level + 1) == pages.levels());
+            state.table.map(level, x, y, slot, vt::entry(slot_x, slot_y, level), m_page_table_changes);
+            publish_page_table_changes(state);
+            m_pending_virtual_pages.erase(pending_key);
+        }
+        m_uploading_virtual_tiles.resize(waiting);
+
+        if (!m_virtual_page_copies.empty()) {
+            vk::ImageSubresourceRange subresource_range;
+            subresource_range.aspectMask = vk::ImageAspectFlagBits::eColor;
+            subresource_range.baseMipLevel = 0;
+            subresource_range.levelCount = 1;
+            subresource_range.baseArrayLayer = 0;
+            subresource_range.layerCount = 1;
+
+            // Earlier frames may still be sampling the slots being replaced.
+            vk::ImageMemoryBarrier copy_barrier;
+            copy_barrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+            copy_barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+            copy_barrier.oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            copy_barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+            copy_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            copy_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            copy_barrier.image = m_atlas.image;
+            copy_barrier.subresourceRange = subresource_range;
+            command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &copy_barrier, m_dispatch);
+
+            command_buffer.copyBufferToImage(m_virtual_staging_buffers[frame].buffer, m_atlas.image, vk::ImageLayout::eTransferDstOptimal,
+                static_cast<uint32_t>(m_virtual_page_copies.size()), m_virtual_page_copies.data(), m_dispatch);
+
+            vk::ImageMemoryBarrier sample_barrier(copy_barrier);
+            sample_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            sample_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+            sample_barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+            sample_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &sample_barrier, m_dispatch);
+        }
+
+        // This frame's copy of the page table catches up; the GPU is done with it. One that the table
+        // outgrew is replaced by a larger buffer, which only this frame's descriptor set points at.
+        const size_t header_entries = (vt::max_textures * sizeof(virtual_texture_info)) / sizeof(uint32_t);
+        std::vector<uint32_t>& dirty(m_page_table_dirty[frame]);
+        if (m_page_table_capacities[frame] < m_page_table.size()) {
+            device_buffer& page_table_buffer(m_page_table_buffers[frame]);
+            m_device.unmapMemory(page_table_buffer.device_memory, m_dispatch);
+            release_device_buffer(page_table_buffer);
+
+            size_t capacity = std::max(m_page_table.size(), m_page_table_capacities[frame] * 2);
+            size_t page_table_size = (header_entries + capacity) * sizeof(uint32_t);
+            page_table_buffer = create_device_buffer(vk::BufferUsageFlagBits::eStorageBuffer, page_table_size, ubo_memory_properties);
+            m_frame_page_tables[frame] = reinterpret_cast<uint32_t*>(
+                m_device.mapMemory(page_table_buffer.device_memory, 0, page_table_size, vk::MemoryMapFlags(), m_dispatch));
+            m_page_table_capacities[frame] = capacity;
+            std::copy(m_page_table.begin(), m_page_table.end(), m_frame_page_tables[frame] + header_entries);
+
+            vk::DescriptorBufferInfo descriptor_buffer_info;
+            descriptor_buffer_info.buffer = page_table_buffer.buffer;
+            descriptor_buffer_info.offset = 0;
+            descriptor_buffer_info.range = VK_WHOLE_SIZE;
+
+            vk::WriteDescriptorSet write_descriptor_set;
+            write_descriptor_set.dstSet = m_simple_mutable_sets[frame];
+            write_descriptor_set.dstBinding = 1;
+            write_descriptor_set.descriptorType = vk::DescriptorType::eStorageBuffer;
+            write_descriptor_set.descriptorCount = 1;
+            write_descriptor_set.pBufferInfo = &descriptor_buffer_info;
+            m_device.updateDescriptorSets(1, &write_descriptor_set, 0, nullptr, m_dispatch);
+        }
+        else {
+            uint32_t* entries = m_frame_page_tables[frame] + header_entries;
+            for (uint32_t index : dirty) {
+                entries[index] = m_page_table[index];
+            }
+        }
+        dirty.clear();
+        std::memcpy(m_frame_page_tables[frame], m_virtual_texture_infos.data(), vt::max_textures * sizeof(virtual_texture_info));
+
+        // Pixels write this frame's requests over cleared ones.
+        command_buffer.fillBuffer(m_feedback_buffers[frame].buffer, 0, VK_WHOLE_SIZE, vt::no_request, m_dispatch);
+
+        vk::BufferMemoryBarrier feedback_barrier;
+        feedback_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        feedback_barrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+        feedback_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        feedback_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        feedback_barrier.buffer = m_feedback_buffers[frame].buffer;
+        feedback_barrier.offset = 0;
+        feedback_barrier.size = VK_WHOLE_SIZE;
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr, 1, &feedback_barrier, 0, nullptr, m_dispatch);
+    }
+
+    bool application::read_virtual_page(uint32_t texture, uint32_t page)
+    {
+        if (!m_pending_virtual_pages.insert((static_cast<uint64_t>(texture) << 32) | page).second) {
+            return (false);
+        }
+
+        const virtual_texture_state& state(m_virtual_texture_states[texture]);
+        virtual_tile tile;
+        tile.texture = texture;
+        tile.generation = state.generation;
+        tile.page = page;
+        std::string tile_file(state.tile_file);
+        m_thread_pool.push([this, tile_file, tile]() mutable {
+            // Reads are small and independent, so each opens the file.
+            std::ifstream tile_stream(tile_file, std::ios::binary);
+            tile.texels.resize(vt::tile_bytes);
+            tile_stream.seekg(static_cast<std::streamoff>(vt::tile_offset(tile.page)));
+            if (!tile_stream.read(reinterpret_cast<char*>(tile.texels.data()), vt::tile_bytes)) {
+                tile.texels.clear();
+            }
+
+            std::lock_guard<std::mutex> virtual_texture_lock(m_virtual_texture_mutex);
+            m_read_virtual_tiles.push_back(std::move(tile));
+        });
+        return (true);
+    }
+
+    void application::publish_page_table_changes(const virtual_texture_state& state)
+    {
+        // Each frame's copy catches up when it is next recorded.
+        const std::vector<uint32_t>& entries(state.table.entries());
+        for (uint32_t page : m_page_table_changes) {
+            uint32_t index = state.page_table_offset + page;
+            m_page_table[index] = entries[page];
+            for (std::vector<uint32_t>& dirty : m_page_table_dirty) {
+                dirty.push_back(index);
+            }
+        }
+        m_page_table_changes.clear();
+    }
+
+    uint32_t application::allocate_page_table_range(uint32_t entry_count)
+    {
+        // First fit among released ranges, else the end of the table.
+        for (size_t i = 0; i < m_free_page_table_ranges.size(); ++i) {
+            std::pair<uint32_t, uint32_t>& range(m_free_page_table_ranges[i]);
+            if (range.second >= entry_count) {
+                uint32_t offset = range.first;
+                range.first += entry_count;
+                range.second -= entry_count;
+                if (range.second == 0) {
+                    m_free_page_table_ranges.erase(m_free_page_table_ranges.begin() + i);
+                }
+                return (offset);
+            }
+        }
+
+        uint32_t offset = static_cast<uint32_t>(m_page_table.size());
+        m_page_table.resize(m_page_table.size() + entry_count, vt::unmapped);
+        return (offset);
+    }
+
+    void application::free_page_table_range(uint32_t offset, uint32_t entry_count)
+    {
+        // Kept sorted by offset and merged with neighbouring ranges.
+        std::vector<std::pair<uint32_t, uint32_t>>::iterator range(std::lower_bound(
+            m_free_page_table_ranges.begin(), m_free_page_table_ranges.end(), std::make_pair(offset, 0u)));
+        range = m_free_page_table_ranges.insert(range, std::make_pair(offset, entry_count));
+        if (((range + 1) != m_free_page_table_ranges.end()) && ((range->first + range->second) == (range + 1)->first)) {
+            range->second += (range + 1)->second;
+            m_free_page_table_ranges.erase(range + 1);
+        }
+        if ((range != m_free_page_table_ranges.begin()) && (((range - 1)->first + (range - 1)->second) == range->first)) {
+            (range - 1)->second += range->second;
+            m_free_page_table_ranges.erase(range);
+        }
+    }
+
+    void application::cleanup_device_image(device_image& t)
+    {
+        m_device.destroyImageView(t.view, nullptr, m_dispatch);
+        m_device.destroyImage(t.image, nullptr, m_dispatch);
+        m_device.freeMemory(t.device_memory, nullptr, m_dispatch);
+    }
+
+    void application::release_device_buffer(device_buffer& b)
+    {
+        deferred_release release;
+        release.buffer = b.buffer;
+        release.device_memory = b.device_memory;
+        push_release(release);
+    }
+
+    void application::release_device_image(device_image& t)
+    {
+        deferred_release release;
+        release.view = t.view;
+        release.image = t.image;
+        release.device_memory = t.device_memory;
+        push_release(release);
+    }
+
+    void application::release_descriptor_pool(vk::DescriptorPool pool)
+    {
+        if (!pool) {
+            return;
+        }
+
+        deferred_release release;
+        release.descriptor_pool = pool;
+        push_release(release);
+    }
+
+    void application::push_release(deferred_release& release)
+    {
+        // Any frame submitted so far may reference the object. Releases come from the main thread
+        // between frames, or from the loader thread for objects no frame has seen.
+        std::lock_guard<std::mutex> release_lock(m_release_mutex);
+        release.frame_serial = m_submitted_frame_serial;
+        m_deferred_releases.push_back(release);
+    }
+
+    void application::retire_frames()
+    {
+        // The queue runs frames in order, so any signaled fence retires its frame and all before it.
+        for (size_t i = 0; i < m_command_fences.size(); ++i) {
+            if ((m_frame_serials[i] > m_completed_frame_serial) &&
+                (m_device.getFenceStatus(m_command_fences[i], m_dispatch) == vk::Result::eSuccess)) {
+                m_completed_frame_serial = m_frame_serials[i];
+            }
+        }
+
+        // Serials only grow along the queue, so retired releases are all at the front.
+        std::lock_guard<std::mutex> release_lock(m_release_mutex);
+        while (!m_deferred_releases.empty() && (m_deferred_releases.front().frame_serial <= m_completed_frame_serial)) {
+            deferred_release& release(m_deferred_releases.front());
+            if (release.descriptor_pool) {
+                m_device.destroyDescriptorPool(release.descriptor_pool, nullptr, m_dispatch);
+            }
+            if (release.view) {
+                m_device.destroyImageView(release.view, nullptr, m_dispatch);
+            }
+            if (release.image) {
+                m_device.destroyImage(release.image, nullptr, m_dispatch);
+            }
+            if (release.buffer) {
+                m_device.destroyBuffer(release.buffer, nullptr, m_dispatch);
+            }
+            if (release.device_memory) {
+                m_device.freeMemory(release.device_memory, nullptr, m_dispatch);
+            }
+            m_deferred_releases.pop_front();
+        }
+    }
+
+    void application::releases_cleanup()
+    {
+        // Only called once the device is idle; every submitted frame has completed.
+        m_completed_frame_serial = m_submitted_frame_serial;
+        retire_frames();
+    }
+
+    uint32_t application::get_memory_type(uint32_t allowed_types, vk::MemoryPropertyFlags desired_memory_properties)
+    {
+        uint32_t memory_type = 0;
+        if (!find_memory_type(allowed_types, desired_memory_properties, memory_type)) {
+            BOOST_THROW_EXCEPTION(error::capability_exception()
+                << error::errinfo_capability_description("Could not find needed memory type."));
+        }
+
+        return (memory_type);
+    }
+
+    bool application::find_memory_type(uint32_t allowed_types, vk::MemoryPropertyFlags desired_memory_properties, uint32_t& memory_type)
+    {
+        unsigned long mem_type = 0;
+
+        while (_BitScanForward(&mem_type, allowed_types)) {
+            if ((m_memory_properties.memoryTypes[mem_type].propertyFlags & desired_memory_properties) == desired_memory_properties) {
+                memory_type = mem_type;
+                return (true);
+            }
+            else {
+                allowed_types &= ~(1 << mem_type);
+            }
+        }
+
+        return (false);
+    }
+
+    uint32_t application::load_scene(const std::string& file_name)
+    {
+        std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+
+        scene_load_request request;
+        request.id = m_next_scene_id++;
+        request.file_name = file_name;
+        m_load_requests.push_back(request);
+        m_load_requested.notify_one();
+
+        return (request.id);
+    }
+
+    void application::unload_scene(uint32_t id)
+    {
+        // Published scenes are only touched by the main thread. Dropping one queues its objects for
+        // deferred destruction, so frames in flight can still draw it.
+        scene_vector::iterator published(std::find_if(m_scenes.begin(), m_scenes.end(),
+            [id](const scene_pointer& s) { return (s->id == id); }));
+        if (published != m_scenes.end()) {
+            m_scenes.erase(published);
+        }
+
+        // A published scene may also have reloads pending under the same id.
+        std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+
+        m_loaded_scenes.erase(std::remove_if(m_loaded_scenes.begin(), m_loaded_scenes.end(),
+            [id](const scene_pointer& s) { return (s->id == id); }), m_loaded_scenes.end());
+
+        m_load_requests.erase(std::remove_if(m_load_requests.begin(), m_load_requests.end(),
+            [id](const scene_load_request& r) { return (r.id == id); }), m_load_requests.end());
+
+        if (m_loading_scene_id == id) {
+            m_loading_scene_cancelled = true;
+        }
+    }
+
+    void application::loader_init()
+    {
+        m_loader_thread = std::thread(&application::loader_main, this);
+    }
+
+    void application::loader_cleanup()
+    {
+        if (!m_loader_thread.joinable()) {
+            return;
+        }
+
+        // A load in progress finishes first; queued ones are dropped.
+        {
+            std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+            m_loader_stopping = true;
+            m_load_requests.clear();
+            m_residency_requests.clear();
+        }
+        m_load_requested.notify_one();
+        m_loader_thread.join();
+
+        // Images loaded for residency changes that were never applied.
+        for (residency_change& change : m_residency_changes) {
+            if (change.image.image) {
+                release_device_image(change.image);
+            }
+        }
+        m_residency_changes.clear();
+    }
+
+    void application::loader_main()
+    {
+        for (;;) {
+            scene_load_request request;
+            residency_request residency;
+            bool residency_requested = false;
+            {
+                std::unique_lock<std::mutex> loader_lock(m_loader_mutex);
+                m_load_requested.wait(loader_lock, [this]() {
+                    return (m_loader_stopping || !m_load_requests.empty() || !m_residency_requests.empty());
+                });
+                if (m_loader_stopping) {
+                    return;
+                }
+
+                // Residency changes are small and affect what is on screen now, so they go first.
+                if (!m_residency_requests.empty()) {
+                    residency = m_residency_requests.front();
+                    m_residency_requests.pop_front();
+                    residency_requested = true;
+                }
+                else {
+                    request = m_load_requests.front();
+                    m_load_requests.pop_front();
+                    m_loading_scene_id = request.id;
+                    m_loading_scene_cancelled = false;
+                }
+            }
+
+            if (residency_requested) {
+                residency_change change(load_residency(residency));
+                std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+                m_residency_changes.push_back(change);
+                continue;
+            }
+
+            // Parsing, processing and uploads all happen here; the GPU copies wait on their own fences.
+            scene_pointer scene;
+            material_reload reload;
+            try {
+                if (request.textures_of) {
+                    reload = reload_textures(request.textures_of);
+                }
+                else {
+                    scene = gltf_load(request.file_name);
+                    scene->id = request.id;
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> log_lock(m_log_mutex);
+                m_log_stream
+                    << "Scene " << request.id << " (" << request.file_name << ") failed to load: "
+                    << boost::current_exception_diagnostic_information() << std::endl;
+            }
+
+            std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+            if (scene && !m_loading_scene_cancelled) {
+                m_loaded_scenes.push_back(scene);
+            }
+            if (reload.immutable_descriptor_pool) {
+                if (!m_loading_scene_cancelled) {
+                    m_material_reloads.push_back(reload);
+                }
+                else {
+                    release_descriptor_pool(reload.immutable_descriptor_pool);
+                }
+            }
+            m_loading_scene_id = 0;
+        }
+    }
+
+    void application::publish_scene(const scene_pointer& scene)
+    {
+        // The most recent file with a camera decides the view.
+        if (scene->has_camera) {
+            m_camera_transform = scene->camera_transform;
+            m_camera_position = scene->camera_position;
+        }
+
+        scene->animation_start = std::chrono::steady_clock::now();
+
+        // A reloaded scene takes the place of the one it replaces.
+        scene_vector::iterator reloaded(std::find_if(m_scenes.begin(), m_scenes.end(),
+            [&scene](const scene_pointer& s) { return (s->id == scene->id); }));
+        bool reloading = (reloaded != m_scenes.end());
+        if (reloading) {
+            *reloaded = scene;
+        }
+        else {
+            m_scenes.push_back(scene);
+        }
+
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Scene " << scene->id << " (" << scene->file_name << ") " << (reloading ? "reloaded: " : "loaded: ")
+            << scene->draws.size() << " draws" << std::endl;
+    }
+
+    void application::scene_release(loaded_scene& scene)
+    {
+        // Frames already submitted may still draw the scene, so everything waits for them.
+        release_descriptor_pool(scene.skin_descriptor_pool);
+
+        for (size_t i = 0; i < scene.joint_buffers.size(); ++i) {
+            if (i < scene.frame_joint_matrices.size()) {
+                m_device.unmapMemory(scene.joint_buffers[i].device_memory, m_dispatch);
+            }
+            release_device_buffer(scene.joint_buffers[i]);
+        }
+
+        for (device_buffer& b : scene.skinned_vertex_buffers) {
+            release_device_buffer(b);
+        }
+
+        for (device_buffer& b : scene.skinned_attribute_buffers) {
+            release_device_buffer(b);
+        }
+
+        release_descriptor_pool(scene.cull_descriptor_pool);
+
+        for (device_buffer& b : scene.cull_lod_buffers) {
+            m_device.unmapMemory(b.device_memory, m_dispatch);
+            release_device_buffer(b);
+        }
+
+        for (device_buffer& b : scene.cull_draw_command_buffers) {
+            release_device_buffer(b);
+        }
+
+        for (device_buffer& b : scene.cull_index_buffers) {
+            release_device_buffer(b);
+        }
+
+        release_descriptor_pool(scene.scene_descriptor_pool);
+        release_descriptor_pool(scene.immutable_descriptor_pool);
+
+        for (size_t i = 0; i < scene.draw_data_buffers.size(); ++i) {
+            if (i < scene.frame_draw_data.size()) {
+                m_device.unmapMemory(scene.draw_data_buffers[i].device_memory, m_dispatch);
+            }
+            release_device_buffer(scene.draw_data_buffers[i]);
+        }
+
+        for (device_buffer& b : scene.buffers) {
+            release_device_buffer(b);
+        }
+
+        // Textures other scenes still use stay loaded.
+        scene.textures.clear();
+        scene.virtual_textures.clear();
+    }
+
+    void application::tick()
+    {
+        // Scenes the loader finished since the last frame join the frame about to be recorded.
+        scene_vector loaded_scenes;
+        material_reload_vector material_reloads;
+        std::vector<residency_change> residency_changes;
+        {
+            std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+            loaded_scenes.swap(m_loaded_scenes);
+            material_reloads.swap(m_material_reloads);
+            residency_changes.swap(m_residency_changes);
+        }
+
+        // Virtual textures of the scenes about to be published were queued before them.
+        if (m_atlas.image) {
+            apply_virtual_texture_changes();
+        }
+
+        for (const scene_pointer& scene : loaded_scenes) {
+            publish_scene(scene);
+        }
+
+        for (material_reload& reload : material_reloads) {
+            apply_material_reload(reload);
+        }
+
+        for (residency_change& change : residency_changes) {
+            apply_residency_change(change);
         }
 
-        // Need a staging buffer to upload the data from.
-        device_buffer staging_buffer = create_device_buffer(vk::BufferUsageFlagBits::eTransferSrc, gli_texture.size(), staging_memory_properties);
+        // Sets written on the loader thread may predate views swapped since.
+        if (!loaded_scenes.empty() || !material_reloads.empty() || !residency_changes.empty()) {
+            for (const scene_pointer& scene : m_scenes) {
+                refresh_material_sets(*scene);
+            }
+        }
 
-        // Write the data to the staging buffer.
-        void* mapped_staging_memory = m_device.mapMemory(staging_buffer.device_memory, 0, gli_texture.size(), vk::MemoryMapFlags(), m_dispatch);
-        memcpy(mapped_staging_memory, gli_texture.data(), gli_texture.size());
-        m_device.unmapMemory(staging_buffer.device_memory, m_dispatch);
+        animate_scenes();
 
-        // Create a backing image.
-        device_image optimized_texture;
-        gli::extent3d gli_texture_extent(gli_texture.extent());
+        // Only changed transforms and their descendants are recomputed.
+        for (const scene_pointer& scene : m_scenes) {
+            scene->transforms.update();
+        }
 
-        vk::ImageCreateInfo image_create_info;
-        switch (gli_texture.target()) {
-        case gli::TARGET_1D:
-        case gli::TARGET_1D_ARRAY:
-            break;
+        if (m_options.texture_budget > 0) {
+            stream_textures();
+        }
 
-        case gli::TARGET_2D:
-            image_create_info.imageType = vk::ImageType::e2D;
-            image_create_info.extent.width = gli_texture_extent.x;
-            image_create_info.extent.height = gli_texture_extent.y;
-            image_create_info.extent.depth = 1;
-            image_create_info.mipLevels = static_cast<uint32_t>(gli_texture.levels());
-            image_create_info.arrayLayers = 1;
-            break;
+        if (m_options.hot_reload) {
+            std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+            if (now >= m_next_watch_poll) {
+                m_next_watch_poll = now + std::chrono::milliseconds(500);
+                watch_scenes();
+            }
+        }
+    }
 
-        case gli::TARGET_2D_ARRAY:
-        case gli::TARGET_3D:
-        case gli::TARGET_RECT:
-        case gli::TARGET_RECT_ARRAY:
-        case gli::TARGET_CUBE:
-        case gli::TARGET_CUBE_ARRAY:
-            break;
+    void application::animate_scenes()
+    {
+        std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+
+        m_animation_jobs.clear();
+        for (const scene_pointer& scene : m_scenes) {
+            float time = std::chrono::duration<float>(now - scene->animation_start).count();
+            for (animation::clip& clip : scene->animations) {
+                m_animation_jobs.emplace_back(&clip, time);
+            }
         }
 
-        image_create_info.format = static_cast<vk::Format>(gli_texture.format());
-        image_create_info.tiling = vk::ImageTiling::eOptimal;
-        image_create_info.initialLayout = vk::ImageLayout::eUndefined;
-        image_create_info.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
-        image_create_info.sharingMode = vk::SharingMode::eExclusive;
-        image_create_info.samples = vk::SampleCountFlagBits::e1;
+        if (m_animation_jobs.empty()) {
+            return;
+        }
 
-        optimized_texture.image = m_device.createImage(image_create_info, nullptr, m_dispatch);
+        // Clips sample independently on the pool; writing into the hierarchies stays on this thread
+        // since clips may share nodes.
+        m_thread_pool.parallel_for(m_animation_jobs.size(), [this](size_t i) {
+            m_animation_jobs[i].first->sample(m_animation_jobs[i].second);
+        });
 
-        // Allocate memory for the image object.
-        vk::MemoryRequirements image_mem_reqs = m_device.getImageMemoryRequirements(optimized_texture.image, m_dispatch);
+        for (const scene_pointer& scene : m_scenes) {
+            for (const animation::clip& clip : scene->animations) {
+                clip.apply(scene->transforms);
+            }
+        }
+    }
 
-        vk::MemoryAllocateInfo image_alloc_info;
-        image_alloc_info.allocationSize = image_mem_reqs.size;
-        image_alloc_info.memoryTypeIndex = get_memory_type(image_mem_reqs.memoryTypeBits, optimized_memory_properties);
-        optimized_texture.device_memory = m_device.allocateMemory(image_alloc_info, nullptr, m_dispatch);
-        m_device.bindImageMemory(optimized_texture.image, optimized_texture.device_memory, 0, m_dispatch);
+    void application::watch_scenes()
+    {
+        for (const scene_pointer& scene : m_scenes) {
+            bool geometry_changed = false;
+            bool textures_changed = false;
+            for (watched_file& f : scene->watched_files) {
+                // Files missing part way through a save are checked again on the next poll.
+                std::time_t write_time = file_write_time(f.file_name);
+                if ((write_time == 0) || (write_time == f.write_time)) {
+                    continue;
+                }
 
-        // Create a image view to access the image through.
-        vk::ImageSubresourceRange subresource_range;
-        subresource_range.aspectMask = vk::ImageAspectFlagBits::eColor;
-        subresource_range.baseMipLevel = 0;
-        subresource_range.levelCount = static_cast<uint32_t>(gli_texture.levels());
-        subresource_range.baseArrayLayer = 0;
-        subresource_range.layerCount = static_cast<uint32_t>(gli_texture.layers());
+                f.write_time = write_time;
+                (f.texture ? textures_changed : geometry_changed) = true;
+            }
 
-        vk::ImageViewCreateInfo image_view_create_info;
-        image_view_create_info.image = optimized_texture.image;
-        image_view_create_info.viewType = vk::ImageViewType::e2D;
-        image_view_create_info.format = image_create_info.format;
-        image_view_create_info.subresourceRange = subresource_range;
+            if (!geometry_changed && !textures_changed) {
+                continue;
+            }
 
-        optimized_texture.view = m_device.createImageView(image_view_create_info, nullptr, m_dispatch);
+            // Geometry is merged, batched and clustered across the whole file, so any change to it
+            // reloads the file; unchanged textures come from the cache. Texture changes alone only
+            // upload the changed images and rebuild the material sets.
+            scene_load_request request;
+            request.id = scene->id;
+            request.file_name = scene->file_name;
+            if (!geometry_changed) {
+                request.textures_of = scene;
+            }
 
-        // Record a command buffer to copy the staging buffer to the optimized image.
-        vk::CommandBuffer copy_command_buffer = create_one_time_command_buffer();
+            {
+                std::lock_guard<std::mutex> log_lock(m_log_mutex);
+                m_log_stream
+                    << "Scene " << scene->id << " (" << scene->file_name << ") changed on disk; reloading "
+                    << (geometry_changed ? "the file" : "textures") << std::endl;
+            }
 
-        vk::ImageMemoryBarrier start_barrier;
-        start_barrier.srcAccessMask = vk::AccessFlags();
-        start_barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-        start_barrier.oldLayout = vk::ImageLayout::eUndefined;
-        start_barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
-        start_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        start_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        start_barrier.image = optimized_texture.image;
-        start_barrier.subresourceRange = subresource_range;
-        copy_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &start_barrier, m_dispatch);
+            std::lock_guard<std::mutex> loader_lock(m_loader_mutex);
+            m_load_requests.push_back(request);
+            m_load_requested.notify_one();
+        }
+    }
 
-        vk::BufferImageCopy copy_image_region;
-        copy_image_region.bufferOffset = 0;
-        copy_image_region.bufferRowLength = 0;
-        copy_image_region.bufferImageHeight = 0;
-        copy_image_region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        copy_image_region.imageSubresource.mipLevel = 0;
-        copy_image_region.imageSubresource.baseArrayLayer = 0;
-        copy_image_region.imageSubresource.layerCount = static_cast<uint32_t>(gli_texture.layers());
-        copy_image_region.imageOffset = { 0, 0, 0 };
-        copy_image_region.imageExtent = image_create_info.extent;
-        copy_command_buffer.copyBufferToImage(staging_buffer.buffer, optimized_texture.image, vk::ImageLayout::eTransferDstOptimal, copy_image_region, m_dispatch);
+    application::material_reload application::reload_textures(const scene_pointer& scene)
+    {
+        // Texture files are only written at load, so the loader can read them while the scene is drawn.
+        material_reload reload;
+        reload.scene = scene;
+        reload.textures.reserve(scene->texture_files.size());
+        for (size_t i = 0; i < scene->texture_files.size(); ++i) {
+            reload.textures.push_back(scene->owned_textures[i] ? scene->owned_textures[i] : create_texture(scene->texture_files[i]));
+        }
 
-        vk::ImageMemoryBarrier end_barrier;
-        end_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        end_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-        end_barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-        end_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        end_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        end_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        end_barrier.image = optimized_texture.image;
-        end_barrier.subresourceRange = subresource_range;
-        copy_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &end_barrier, m_dispatch);
+        // Sets in use by frames in flight cannot be rewritten, so the scene gets new ones.
+        reload.immutable_descriptor_pool = material_sets_init(reload.textures, reload.material_sets, reload.material_views);
+        return (reload);
+    }
 
-        // TODO: Rather than finish here, we could wait at the end of the application constructor; will need to
-        // remember staging details to be freed there.
-        finish_one_time_command_buffer(copy_command_buffer);
+    void application::apply_material_reload(material_reload& reload)
+    {
+        // The scene may have been unloaded or reloaded as a whole in the meantime.
+        if (std::find(m_scenes.begin(), m_scenes.end(), reload.scene) == m_scenes.end()) {
+            release_descriptor_pool(reload.immutable_descriptor_pool);
+            return;
+        }
 
-        // Cleanup.
-        cleanup_one_time_command_buffer(copy_command_buffer);
-        cleanup_device_buffer(staging_buffer);
+        // Replaced images wait for the frames still using them.
+        loaded_scene& scene(*reload.scene);
+        replace_material_sets(scene, reload.immutable_descriptor_pool, reload.material_sets, reload.material_views);
+        scene.textures.swap(reload.textures);
 
-        return (m_textures.emplace(m_textures.end(), optimized_texture));
+        std::lock_guard<std::mutex> log_lock(m_log_mutex);
+        m_log_stream
+            << "Scene " << scene.id << " (" << scene.file_name << ") textures reloaded" << std::endl;
     }
 
-    void application::textures_cleanup()
+    void application::replace_material_sets(loaded_scene& scene, vk::DescriptorPool pool, std::vector<vk::DescriptorSet>& sets, std::vector<vk::ImageView>& views)
     {
-        // TODO: Immutable state is currently textures, cleanup should probably be elsewhere.
-        if (m_immutable_descriptor_pool) {
-            m_device.destroyDescriptorPool(m_immutable_descriptor_pool, nullptr, m_dispatch);
+        std::map<vk::DescriptorSet, vk::DescriptorSet> replaced_sets;
+        for (size_t i = 0; i < scene.material_sets.size(); ++i) {
+            replaced_sets[scene.material_sets[i]] = sets[i];
         }
 
-        for (device_image& t : m_textures) {
-            cleanup_device_image(t);
+        for (draw_record& d : scene.draws) {
+            d.immutable_state = replaced_sets.at(d.immutable_state);
         }
-    }
 
-    void application::cleanup_device_image(device_image& t)
-    {
-        m_device.destroyImageView(t.view, nullptr, m_dispatch);
-        m_device.destroyImage(t.image, nullptr, m_dispatch);
-        m_device.freeMemory(t.device_memory, nullptr, m_dispatch);
+        // The old sets wait for the frames still using them.
+        release_descriptor_pool(scene.immutable_descriptor_pool);
+        scene.immutable_descriptor_pool = pool;
+        scene.material_sets.swap(sets);
+        scene.material_views.swap(views);
     }
 
-    uint32_t application::get_memory_type(uint32_t allowed_types, vk::MemoryPropertyFlags desired_memory_properties)
+    void application::refresh_material_sets(loaded_scene& scene)
     {
-        unsigned long mem_type = 0;
-
-        while (_BitScanForward(&mem_type, allowed_types)) {
-            if ((m_memory_properties.memoryTypes[mem_type].propertyFlags & desired_memory_properties) == desired_memory_properties) {
-                return (mem_type);
-            }
-            else {
-                allowed_types &= ~(1 << mem_type);
+        // Sets written before a texture's view was swapped would sample a released image; views
+        // only change on this thread.
+        bool stale = false;
+        for (size_t i = 0; i < scene.textures.size(); ++i) {
+            if (scene.textures[i]->view != scene.material_views[i]) {
+                stale = true;
+                break;
             }
         }
 
-        BOOST_THROW_EXCEPTION(error::capability_exception()
-            << error::errinfo_capability_description("Could not find needed memory type."));
+        if (!stale) {
+            return;
+        }
+
+        std::vector<vk::DescriptorSet> sets;
+        std::vector<vk::ImageView> views;
+        vk::DescriptorPool pool = material_sets_init(scene.textures, sets, views);
+        replace_material_sets(scene, pool, sets, views);
     }
 
-    void application::tick()
+    // static
+    std::time_t application::file_write_time(const std::string& file_name)
     {
-
+        boost::system::error_code error;
+        std::time_t write_time = boost::filesystem::last_write_time(file_name, error);
+        return (error ? 0 : write_time);
     }
 
     void application::draw()
@@ -2164,13 +6964,20 @@ namespace gtb {
         // Get command buffers objects associated with this image.
         vk::CommandBuffer& command_buffer(m_command_buffers[acquired_image]);
         vk::Fence& command_fence(m_command_fences[acquired_image]);
-        device_buffer& uniform_buffer(m_uniform_buffers[acquired_image]);
+        per_frame_uniforms* uniforms(m_per_frame_uniforms[acquired_image]);
         vk::DescriptorSet& descriptor_set(m_simple_mutable_sets[acquired_image]);
 
         // Wait for the commands complete fence in order to record.
         m_device.waitForFences(command_fence, VK_FALSE, infinite_wait, m_dispatch);
         m_device.resetFences(command_fence, m_dispatch);
 
+        // The last use of this frame's query has completed along with its commands.
+        read_statistics(acquired_image);
+
+        // This frame's fence was signaled before the reset; other frames may have completed too.
+        m_completed_frame_serial = std::max(m_completed_frame_serial, m_frame_serials[acquired_image]);
+        retire_frames();
+
         // Now we can reset and record a new command buffer for this frame.
         command_buffer.reset(vk::CommandBufferResetFlags(), m_dispatch);
 
@@ -2178,6 +6985,68 @@ namespace gtb {
         begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
         command_buffer.begin(begin_info, m_dispatch);
 
+        // The camera is the only thing written to the uniform buffer each frame; per-draw
+        // transforms were uploaded once at load.
+        uniforms->world_to_clip_transform = m_camera_transform;
+        uniforms->camera_position = glm::vec4(m_camera_position, 1.0f);
+
+        // Frustum planes are the rows of the clip transform combined for a 0 to 1 depth range.
+        glm::mat4 clip_rows(glm::transpose(m_camera_transform));
+        glm::vec4 frustum_planes[] = {
+            clip_rows[3] + clip_rows[0], clip_rows[3] - clip_rows[0],
+            clip_rows[3] + clip_rows[1], clip_rows[3] - clip_rows[1],
+            clip_rows[2], clip_rows[3] - clip_rows[2]
+        };
+        for (uint32_t i = 0; i < _countof(frustum_planes); ++i) {
+            // An infinite far plane has no normal and culls nothing.
+            float normal_length = glm::length(glm::vec3(frustum_planes[i]));
+            uniforms->frustum_planes[i] = (normal_length > 0.0f) ? (frustum_planes[i] / normal_length) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+
+        // Every pixel of a cell gets its turn at reporting over as many frames as the cell has pixels.
+        uint64_t feedback_turn = m_submitted_frame_serial;
+        uniforms->feedback_cell = glm::uvec4(
+            feedback_turn % feedback_cell_size, (feedback_turn / feedback_cell_size) % feedback_cell_size, m_feedback_cells_x, 0);
+
+        if (m_atlas.image) {
+            update_virtual_textures(command_buffer, acquired_image);
+        }
+
+        // This frame's draw data is no longer read by the GPU, so it catches up with the transforms.
+        for (const scene_pointer& scene : m_scenes) {
+            if (scene_drawable(*scene)) {
+                write_draw_data(*scene, acquired_image);
+            }
+        }
+
+        if (m_options.lod) {
+            select_lods();
+        }
+
+        for (const scene_pointer& scene : m_scenes) {
+            if (scene_drawable(*scene) && !scene->skin_jobs.empty()) {
+                skin_scene(command_buffer, *scene, acquired_image);
+            }
+        }
+
+        if (m_options.cluster_culling) {
+            for (const scene_pointer& scene : m_scenes) {
+                if (!scene_drawable(*scene)) {
+                    continue;
+                }
+
+                if (m_options.lod) {
+                    std::copy(scene->draw_lods.begin(), scene->draw_lods.end(), scene->cull_lod_selections[acquired_image]);
+                }
+                cull_clusters(command_buffer, *scene, acquired_image);
+            }
+        }
+
+        if (m_statistics_query_pool) {
+            command_buffer.resetQueryPool(m_statistics_query_pool, acquired_image, 1, m_dispatch);
+            command_buffer.beginQuery(m_statistics_query_pool, acquired_image, vk::QueryControlFlags(), m_dispatch);
+        }
+
         vk::ClearValue clear_values[2];
         clear_values[0].color.setFloat32( {{0.0f, 0.0f, 0.0f, 1.0f}} );
         clear_values[1].depthStencil.setDepth(1.0f);
@@ -2193,52 +7062,60 @@ namespace gtb {
         command_buffer.beginRenderPass(pass_begin_info, vk::SubpassContents::eInline, m_dispatch);
 
         // Generate commands for per-frame but not per-draw work.
-        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_simple_pipeline, m_dispatch);
-
-        // Setup to write the uniform buffer.
-        // TODO: Keep the memory mapped all of the time.
-        uint8_t* ubo_data = reinterpret_cast<uint8_t*>(m_device.mapMemory(uniform_buffer.device_memory, 0, per_frame_ubo_size, vk::MemoryMapFlags(), m_dispatch));
-        uint32_t ubo_offset = 0;
-
-        // Do all of the per-draw work.
-        for (draw_record& d : m_draws) {
-            // Bind geometry
-            vk::DeviceSize zero_offset = 0;
-            command_buffer.bindVertexBuffers(0, m_static_buffers[d.vbo].buffer, zero_offset, m_dispatch);
-            command_buffer.bindIndexBuffer(m_static_buffers[d.ibo].buffer, zero_offset, vk::IndexType::eUint16, m_dispatch);
-
-            // Fill out and bind dynamic state uniform buffer.
-            uint32_t dynamic_ubo_offsets[1];
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_options.depth_prepass ? m_simple_depth_pipeline : m_simple_pipeline, m_dispatch);
 
-            // Update transform UBO field.
-            *reinterpret_cast<glm::mat4*>(ubo_data + ubo_offset) = m_camera_transform * d.transform;
-            dynamic_ubo_offsets[0] = ubo_offset;
-            ubo_offset = align_up(ubo_offset + sizeof(glm::mat4), m_ubo_min_field_align);
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_simple_pipeline_layout, 0, 1, &descriptor_set, 0, nullptr, m_dispatch);
 
-            // TODO: Collapse this into a single bind call.
-            command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_simple_pipeline_layout, 0, 1, &descriptor_set, _countof(dynamic_ubo_offsets), dynamic_ubo_offsets, m_dispatch);
+        if (m_options.depth_prepass) {
+            for (const scene_pointer& scene : m_scenes) {
+                if (scene_drawable(*scene)) {
+                    draw_scene_depth(command_buffer, *scene, acquired_image);
+                }
+            }
 
-            // Bind the immutable state.
-            command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_simple_pipeline_layout, 1, 1, &d.immutable_state, 0, nullptr, m_dispatch);
+            command_buffer.nextSubpass(vk::SubpassContents::eInline, m_dispatch);
+            command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_simple_pipeline, m_dispatch);
+        }
 
-            // Draw
-            command_buffer.drawIndexed(d.index_count, 1, d.first_index, d.vertex_offset, 0, m_dispatch);
+        for (const scene_pointer& scene : m_scenes) {
+            if (scene_drawable(*scene)) {
+                draw_scene(command_buffer, *scene, acquired_image);
+            }
         }
 
         // Finish command buffer recording.
-        m_device.unmapMemory(uniform_buffer.device_memory, m_dispatch);
-
         command_buffer.endRenderPass(m_dispatch);
+
+        // Page requests are read on the CPU once the frame's fence has been waited for.
+        if (m_atlas.image) {
+            vk::BufferMemoryBarrier feedback_barrier;
+            feedback_barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            feedback_barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+            feedback_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            feedback_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            feedback_barrier.buffer = m_feedback_buffers[acquired_image].buffer;
+            feedback_barrier.offset = 0;
+            feedback_barrier.size = VK_WHOLE_SIZE;
+            command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), 0, nullptr, 1, &feedback_barrier, 0, nullptr, m_dispatch);
+        }
+        if (m_statistics_query_pool) {
+            command_buffer.endQuery(m_statistics_query_pool, acquired_image, m_dispatch);
+            m_statistics_query_pending[acquired_image] = true;
+        }
         command_buffer.end(m_dispatch);
 
         // Now we need our aquired image to actually be ready.
         m_device.waitForFences(m_next_image_ready, VK_FALSE, infinite_wait, m_dispatch);
 
+        // The loader thread may be submitting uploads.
+        std::lock_guard<std::mutex> queue_lock(m_queue_mutex);
+
         // Submit work.
         vk::SubmitInfo submit_info;
         submit_info.commandBufferCount = 1;
         submit_info.pCommandBuffers = &command_buffer;
         m_queue.submit(submit_info, command_fence, m_dispatch);
+        m_frame_serials[acquired_image] = ++m_submitted_frame_serial;
 
         // Present the texture.
         vk::PresentInfoKHR present_info;
@@ -2248,12 +7125,284 @@ namespace gtb {
         m_queue.presentKHR(present_info, m_dispatch);
     }
 
+    void application::draw_scene_depth(vk::CommandBuffer command_buffer, const loaded_scene& scene, uint32_t frame)
+    {
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_simple_pipeline_layout, 2, 1, &scene.scene_sets[frame], 0, nullptr, m_dispatch);
+
+        // Sort front to back by the clip space depth of each draw's bounds so the pre-pass
+        // rejects as much as possible early.
+        m_depth_sorted_draws.clear();
+        m_depth_sorted_draws.reserve(scene.draws.size());
+        for (uint32_t i = 0; i < scene.draws.size(); ++i) {
+            const draw_record& d = scene.draws[i];
+            const glm::mat4& transform(scene.transforms.world(d.transform_index));
+            glm::vec4 clip_center(m_camera_transform * (transform * glm::vec4(d.geometry.bounds_center, 1.0f)));
+            m_depth_sorted_draws.emplace_back(clip_center.z, i);
+        }
+        std::sort(m_depth_sorted_draws.begin(), m_depth_sorted_draws.end());
+
+        const geometry_record* bound_depth_geometry = nullptr;
+        for (const std::pair<float, uint32_t>& sorted_draw : m_depth_sorted_draws) {
+            const draw_record& d = scene.draws[sorted_draw.second];
+
+            // Vertex layout is baked into the pipeline; vertex and index buffers only change with the
+            // layout, index type or skinning.
+            if (!bound_depth_geometry || (d.geometry.format != bound_depth_geometry->format)) {
+                command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                    (d.geometry.format == vertex_format::compact) ? m_compact_depth_pipeline : m_simple_depth_pipeline, m_dispatch);
+            }
+            if (!bound_depth_geometry ||
+                (d.geometry.format != bound_depth_geometry->format) ||
+                (d.geometry.index_type != bound_depth_geometry->index_type) ||
+                (d.geometry.skinned != bound_depth_geometry->skinned)) {
+                bind_geometry(command_buffer, scene, d.geometry, true, frame);
+                bound_depth_geometry = &d.geometry;
+            }
+
+            draw_geometry(command_buffer, scene, d.geometry, sorted_draw.second, frame);
+        }
+    }
+
+    void application::draw_scene(vk::CommandBuffer command_buffer, const loaded_scene& scene, uint32_t frame)
+    {
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_simple_pipeline_layout, 2, 1, &scene.scene_sets[frame], 0, nullptr, m_dispatch);
+
+        // Do all of the per-draw work. Draws are grouped by vertex format and index type at load.
+        uint32_t draw_index = 0;
+        const geometry_record* bound_geometry = nullptr;
+        vk::DescriptorSet bound_immutable_state;
+        for (const draw_record& d : scene.draws) {
+            // Vertex layout is baked into the pipeline; vertex and index buffers only change with the
+            // layout, index type or skinning.
+            if (!bound_geometry || (d.geometry.format != bound_geometry->format)) {
+                command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                    (d.geometry.format == vertex_format::compact) ? m_compact_pipeline : m_simple_pipeline, m_dispatch);
+            }
+            if (!bound_geometry ||
+                (d.geometry.format != bound_geometry->format) ||
+                (d.geometry.index_type != bound_geometry->index_type) ||
+                (d.geometry.skinned != bound_geometry->skinned)) {
+                bind_geometry(command_buffer, scene, d.geometry, false, frame);
+                bound_geometry = &d.geometry;
+            }
+
+            // Bind the immutable state; draws sharing a material or a texture array share the set.
+            if (d.immutable_state != bound_immutable_state) {
+                command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_simple_pipeline_layout, 1, 1, &d.immutable_state, 0, nullptr, m_dispatch);
+                bound_immutable_state = d.immutable_state;
+            }
+
+            draw_geometry(command_buffer, scene, d.geometry, draw_index++, frame);
+        }
+    }
+
+    bool application::scene_drawable(const loaded_scene& scene) const
+    {
+        // Empty scenes have no draw data; with cluster culling, nothing without clusters is visible.
+        return (!scene.scene_sets.empty() && (!m_options.cluster_culling || (scene.cluster_count > 0)));
+    }
+
+    void application::select_lods()
+    {
+        // Pixels covered by one world unit at unit distance; the clip transform's y row carries the
+        // projection's vertical scale.
+        glm::vec3 clip_y_row(m_camera_transform[0][1], m_camera_transform[1][1], m_camera_transform[2][1]);
+        glm::vec3 clip_w_row(m_camera_transform[0][3], m_camera_transform[1][3], m_camera_transform[2][3]);
+        float pixels_per_unit = glm::length(clip_y_row) * 0.5f * static_cast<float>(m_swap_chain_extent.height);
+        bool perspective = (glm::dot(clip_w_row, clip_w_row) > 0.0f);
+
+        for (const scene_pointer& scene : m_scenes) {
+            scene->draw_lods.resize(scene->draws.size());
+            for (uint32_t i = 0; i < scene->draws.size(); ++i) {
+                const draw_record& d = scene->draws[i];
+                const geometry_record& geometry = d.geometry;
+
+                uint32_t lod = 0;
+                if (geometry.lod_count > 1) {
+                    const glm::mat4& transform(scene->transforms.world(d.transform_index));
+                    float scale = std::sqrt(std::max(glm::dot(transform[0], transform[0]),
+                        std::max(glm::dot(transform[1], transform[1]), glm::dot(transform[2], transform[2]))));
+
+                    // Distance to the nearest point of the bounds; anything touching the camera is full detail.
+                    float distance = 1.0f;
+                    if (perspective) {
+                        glm::vec4 clip_center(m_camera_transform * (transform * glm::vec4(geometry.bounds_center, 1.0f)));
+                        distance = clip_center.w - (geometry.bounds_radius * scale);
+                    }
+
+                    if (distance > 0.0f) {
+                        float pixels_per_error = (pixels_per_unit * scale) / distance;
+                        while (((lod + 1) < geometry.lod_count) && ((geometry.lods[lod + 1].error * pixels_per_error) <= lod_max_screen_error)) {
+                            ++lod;
+                        }
+                    }
+                }
+
+                scene->draw_lods[i] = lod;
+                m_lod_triangles += geometry.lods[lod].index_count / 3;
+                m_full_detail_triangles += geometry.index_count / 3;
+            }
+        }
+
+        if (++m_lod_frames == statistics_report_frames) {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream
+                << "Triangles per frame: " << (m_lod_triangles / m_lod_frames)
+                << " of " << (m_full_detail_triangles / m_lod_frames) << " at full detail" << std::endl;
+
+            m_lod_triangles = 0;
+            m_full_detail_triangles = 0;
+            m_lod_frames = 0;
+        }
+    }
+
+    void application::skin_scene(vk::CommandBuffer command_buffer, loaded_scene& scene, uint32_t frame)
+    {
+        // This frame's joint matrices are no longer read by the GPU, so they catch up with the transforms.
+        uint64_t& written_serial(scene.joint_serials[frame]);
+        if (written_serial != scene.transforms.serial()) {
+            glm::mat4* joint_matrices = scene.frame_joint_matrices[frame];
+            for (const skin_record& skin : scene.skins) {
+                for (size_t j = 0; j < skin.joints.size(); ++j) {
+                    joint_matrices[skin.first_joint + j] = scene.transforms.world(skin.joints[j]) * skin.inverse_bind_matrices[j];
+                }
+            }
+            written_serial = scene.transforms.serial();
+        }
+
+        // Skin every skinned draw into its range of this frame's vertices.
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_skin_pipeline, m_dispatch);
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_skin_pipeline_layout, 0, 1, &scene.skin_sets[frame], 0, nullptr, m_dispatch);
+        for (const skin_job& job : scene.skin_jobs) {
+            command_buffer.pushConstants(m_skin_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(skin_job), &job, m_dispatch);
+            command_buffer.dispatch((job.vertex_count + 63) / 64, 1, 1, m_dispatch); // 64 == skin.comp local size
+        }
+
+        vk::MemoryBarrier skin_barrier;
+        skin_barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        skin_barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexInput, vk::DependencyFlags(), 1, &skin_barrier, 0, nullptr, 0, nullptr, m_dispatch);
+    }
+
+    void application::cull_clusters(vk::CommandBuffer command_buffer, const loaded_scene& scene, uint32_t frame)
+    {
+        // Reset this frame's draw commands to zero indices.
+        vk::BufferCopy copy_region;
+        copy_region.size = scene.draws.size() * sizeof(vk::DrawIndexedIndirectCommand);
+        command_buffer.copyBuffer(scene.cull_draw_command_template, scene.cull_draw_command_buffers[frame].buffer, copy_region, m_dispatch);
+
+        vk::MemoryBarrier reset_barrier;
+        reset_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        reset_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), 1, &reset_barrier, 0, nullptr, 0, nullptr, m_dispatch);
+
+        // Append the indices of every visible cluster to its draw.
+        vk::DescriptorSet cull_sets[] = {
+            m_simple_mutable_sets[frame], scene.cull_sets[frame]
+        };
+
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_cull_pipeline, m_dispatch);
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_cull_pipeline_layout, 0, _countof(cull_sets), cull_sets, 0, nullptr, m_dispatch);
+        command_buffer.dispatch((scene.cluster_count + 63) / 64, 1, 1, m_dispatch); // 64 == cull.comp local size
+
+        vk::MemoryBarrier cull_barrier;
+        cull_barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        cull_barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eIndexRead;
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput, vk::DependencyFlags(), 1, &cull_barrier, 0, nullptr, 0, nullptr, m_dispatch);
+    }
+
+    void application::bind_geometry(vk::CommandBuffer command_buffer, const loaded_scene& scene, const geometry_record& geometry, bool position_only, uint32_t frame)
+    {
+        size_t f = static_cast<size_t>(geometry.format);
+
+        // Skinned geometry reads this frame's skinning output instead of the merged streams.
+        vk::DeviceSize zero_offset = 0;
+        if (geometry.skinned) {
+            command_buffer.bindVertexBuffers(0, scene.skinned_vertex_buffers[frame].buffer, zero_offset, m_dispatch);
+            if (m_options.split_vertex_streams && !position_only) {
+                command_buffer.bindVertexBuffers(1, scene.skinned_attribute_buffers[frame].buffer, zero_offset, m_dispatch);
+            }
+        }
+        else {
+            command_buffer.bindVertexBuffers(0, scene.vertex_buffers[f], zero_offset, m_dispatch);
+            if (m_options.split_vertex_streams && !position_only) {
+                command_buffer.bindVertexBuffers(1, scene.attribute_buffers[f], zero_offset, m_dispatch);
+            }
+        }
+
+        // With cluster culling every draw reads this frame's visible indices instead.
+        if (m_options.cluster_culling) {
+            command_buffer.bindIndexBuffer(scene.cull_index_buffers[frame].buffer, zero_offset, vk::IndexType::eUint32, m_dispatch);
+        }
+        else {
+            bool index32 = (geometry.index_type == vk::IndexType::eUint32);
+            command_buffer.bindIndexBuffer(scene.index_buffers[index32 ? 1 : 0], zero_offset, geometry.index_type, m_dispatch);
+        }
+    }
+
+    void application::draw_geometry(vk::CommandBuffer command_buffer, const loaded_scene& scene, const geometry_record& geometry, uint32_t draw_index, uint32_t frame)
+    {
+        // The instance index selects this draw's entry in the draw data storage buffer.
+        if (m_options.cluster_culling) {
+            command_buffer.drawIndexedIndirect(scene.cull_draw_command_buffers[frame].buffer,
+                draw_index * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand), m_dispatch);
+        }
+        else {
+            const lod_record& lod(geometry.lods[m_options.lod ? scene.draw_lods[draw_index] : 0]);
+            command_buffer.drawIndexed(lod.index_count, 1, lod.first_index, geometry.vertex_offset, draw_index, m_dispatch);
+        }
+    }
+
+    void application::read_statistics(uint32_t frame)
+    {
+        if (!m_statistics_query_pool || !m_statistics_query_pending[frame]) {
+            return;
+        }
+
+        uint64_t fragment_invocations = 0;
+        vk::Result result = m_device.getQueryPoolResults(m_statistics_query_pool, frame, 1,
+            sizeof(fragment_invocations), &fragment_invocations, sizeof(fragment_invocations), vk::QueryResultFlagBits::e64, m_dispatch);
+        m_statistics_query_pending[frame] = false;
+        if (result != vk::Result::eSuccess) {
+            return;
+        }
+
+        m_fragment_invocations += fragment_invocations;
+        if (++m_statistics_frames == statistics_report_frames) {
+            std::lock_guard<std::mutex> log_lock(m_log_mutex);
+            m_log_stream
+                << "Fragment shader invocations per frame: " << (m_fragment_invocations / m_statistics_frames)
+                << " (depth pre-pass " << (m_options.depth_prepass ? "on" : "off") << ")" << std::endl;
+
+            m_fragment_invocations = 0;
+            m_statistics_frames = 0;
+        }
+    }
+
     // static
     void application::glfw_key_callback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
     {
         if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
             glfwSetWindowShouldClose(window, GLFW_TRUE);
         }
+
+        // Backspace unloads the most recently added scene.
+        if (key == GLFW_KEY_BACKSPACE && action == GLFW_PRESS) {
+            application* app = static_cast<application*>(glfwGetWindowUserPointer(window));
+            if (!app->m_scenes.empty()) {
+                app->unload_scene(app->m_scenes.back()->id);
+            }
+        }
+    }
+
+    // static
+    void application::glfw_drop_callback(GLFWwindow* window, int count, const char** paths)
+    {
+        // Dropped glTF files are added to the running scene.
+        application* app = static_cast<application*>(glfwGetWindowUserPointer(window));
+        for (int i = 0; i < count; ++i) {
+            app->load_scene(paths[i]);
+        }
     }
 
     // static
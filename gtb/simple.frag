@@ -2,12 +2,14 @@
 #extension GL_ARB_separate_shader_objects : require
 
 layout(location = 0) in vec2 tex_coord;
+layout(location = 1) in mat3 tangent_to_world; // not yet used; available for normal mapping
+layout(location = 4) flat in float texture_layer;
 
 layout(location = 0) out vec4 frag_color;
 
-layout(set = 1, binding = 1) uniform sampler2D tex_sampler;
+layout(set = 1, binding = 1) uniform sampler2DArray tex_sampler; // single textures are one layer
 
 void main()
 {
-    frag_color = texture(tex_sampler, tex_coord);
+    frag_color = texture(tex_sampler, vec3(tex_coord, texture_layer));
 }
@@ -1,18 +1,65 @@
 #version 450 core
 #extension GL_ARB_separate_shader_objects : require
 
-layout(location = 0) in vec3 vertex_position; // model space
-layout(location = 1) in uvec3 vertex_tangent_space_basis;
+layout(location = 0) in vec3 vertex_position; // model space, or quantized to the mesh bounds
+layout(location = 1) in vec4 vertex_tangent_frame; // qtangent; sign of w is the bitangent sign
 layout(location = 2) in vec2 vertex_tex_coord;
 
 layout(location = 0) out vec2 out_tex_coord;
+layout(location = 1) out mat3 out_tangent_to_world; // columns are tangent, bitangent, normal
+layout(location = 4) flat out float out_texture_layer;
+layout(location = 5) flat out float out_virtual_texture; // id + 1; zero for regular textures
+
+// The depth pre-pass and the color pass must produce bit identical depth.
+invariant gl_Position;
 
 layout(set = 0, binding = 0) uniform vert_shader_block {
-    mat4 model_to_clip_transform; // projection transform * view transform * model transform
+    mat4 world_to_clip_transform; // projection transform * view transform
+};
+
+struct draw_data {
+    mat4 model_transform;
+    vec4 position_scale; // dequantization; identity for full vertices; w = virtual texture id + 1
+    vec4 position_bias; // w = texture array layer
 };
 
+layout(set = 2, binding = 0) readonly buffer draw_data_block {
+    draw_data draws[]; // indexed by instance; each draw is submitted with firstInstance = draw index
+};
+
+mat3 qtangent_decode(vec4 q)
+{
+    q = normalize(q);
+
+    vec3 tangent = vec3(
+        1.0f - 2.0f * ((q.y * q.y) + (q.z * q.z)),
+        2.0f * ((q.x * q.y) + (q.w * q.z)),
+        2.0f * ((q.x * q.z) - (q.w * q.y)));
+    vec3 normal = vec3(
+        2.0f * ((q.x * q.z) + (q.w * q.y)),
+        2.0f * ((q.y * q.z) - (q.w * q.x)),
+        1.0f - 2.0f * ((q.x * q.x) + (q.y * q.y)));
+    vec3 bitangent = cross(normal, tangent) * ((q.w < 0.0f) ? -1.0f : 1.0f);
+
+    return mat3(tangent, bitangent, normal);
+}
+
 void main()
 {
-    gl_Position = model_to_clip_transform * vec4(vertex_position, 1.0f);
+    draw_data d = draws[gl_InstanceIndex];
+    vec3 model_position = (vertex_position * d.position_scale.xyz) + d.position_bias.xyz;
+
+    gl_Position = world_to_clip_transform * (d.model_transform * vec4(model_position, 1.0f));
     out_tex_coord = vertex_tex_coord;
+
+    // Tangents follow the model transform; normals need its inverse transpose to stay perpendicular
+    // to the surface under non-uniform scale.
+    mat3 model_rotation = mat3(d.model_transform);
+    mat3 frame = qtangent_decode(vertex_tangent_frame);
+    out_tangent_to_world = mat3(
+        normalize(model_rotation * frame[0]),
+        normalize(model_rotation * frame[1]),
+        normalize(transpose(inverse(model_rotation)) * frame[2]));
+    out_texture_layer = d.position_bias.w;
+    out_virtual_texture = d.position_scale.w;
 }
@@ -0,0 +1,274 @@
+//  gtb: Graphics Test Bench
+//  Copyright 2018 Joshua Buckman
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#pragma once
+
+namespace gtb {
+    namespace simplify {
+        // Sum of squared distances to a set of planes (Garland & Heckbert), weighted by triangle area.
+        struct quadric {
+            quadric()
+                : a00(0.0), a01(0.0), a02(0.0), a11(0.0), a12(0.0), a22(0.0)
+                , b0(0.0), b1(0.0), b2(0.0)
+                , c(0.0)
+                , w(0.0)
+            {}
+
+            void add_plane(const glm::vec3& n, float d, float weight)
+            {
+                a00 += weight * n.x * n.x; a01 += weight * n.x * n.y; a02 += weight * n.x * n.z;
+                a11 += weight * n.y * n.y; a12 += weight * n.y * n.z;
+                a22 += weight * n.z * n.z;
+                b0 += weight * n.x * d; b1 += weight * n.y * d; b2 += weight * n.z * d;
+                c += weight * d * d;
+                w += weight;
+            }
+
+            void add(const quadric& q)
+            {
+                a00 += q.a00; a01 += q.a01; a02 += q.a02;
+                a11 += q.a11; a12 += q.a12;
+                a22 += q.a22;
+                b0 += q.b0; b1 += q.b1; b2 += q.b2;
+                c += q.c;
+                w += q.w;
+            }
+
+            // Weighted mean squared distance of p to the planes.
+            double error(const glm::vec3& p) const
+            {
+                double x = p.x, y = p.y, z = p.z;
+                double e =
+                    (a00 * x * x) + (2.0 * a01 * x * y) + (2.0 * a02 * x * z) +
+                    (a11 * y * y) + (2.0 * a12 * y * z) +
+                    (a22 * z * z) +
+                    (2.0 * ((b0 * x) + (b1 * y) + (b2 * z))) +
+                    c;
+                return ((w > 0.0) ? std::max(e / w, 0.0) : 0.0);
+            }
+
+            double a00, a01, a02, a11, a12, a22;
+            double b0, b1, b2;
+            double c;
+            double w;
+        };
+
+        struct collapse {
+            double cost;
+            uint32_t from;
+            uint32_t to;
+
+            bool operator<(const collapse& other) const
+            {
+                return (cost < other.cost);
+            }
+        };
+
+        // Simplifies an indexed triangle list towards target_index_count by collapsing edges onto one of
+        // their vertices, so the result indexes the same vertex buffer. Vertices on open edges (mesh
+        // borders and attribute seams, where vertices are split) never move. Returns an upper bound on
+        // the distance the surface moved, in the units of the positions.
+        inline float simplify(
+            const std::vector<glm::vec3>& positions,
+            const std::vector<uint32_t>& indices,
+            size_t target_index_count,
+            std::vector<uint32_t>& result)
+        {
+            size_t vertex_count = positions.size();
+            float total_error = 0.0f;
+
+            result = indices;
+
+            std::vector<quadric> quadrics;
+            std::vector<bool> locked;
+            std::vector<bool> touched;
+            std::vector<uint32_t> remap;
+            std::vector<uint32_t> adjacency_offsets;
+            std::vector<uint32_t> adjacency;
+            std::vector<collapse> collapses;
+            std::unordered_map<uint64_t, uint32_t> edge_use;
+            std::vector<uint32_t> simplified;
+
+            // Each pass collapses a set of edges whose neighborhoods do not overlap, then rebuilds.
+            while (result.size() > target_index_count) {
+                size_t triangle_count = result.size() / 3;
+
+                quadrics.assign(vertex_count, quadric());
+                for (size_t t = 0; t < triangle_count; ++t) {
+                    const glm::vec3& p0(positions[result[(t * 3) + 0]]);
+                    const glm::vec3& p1(positions[result[(t * 3) + 1]]);
+                    const glm::vec3& p2(positions[result[(t * 3) + 2]]);
+
+                    glm::vec3 n(glm::cross(p1 - p0, p2 - p0));
+                    float double_area = glm::length(n);
+                    if (double_area <= 0.0f) {
+                        continue;
+                    }
+                    n /= double_area;
+
+                    float d = -glm::dot(n, p0);
+                    for (size_t k = 0; k < 3; ++k) {
+                        quadrics[result[(t * 3) + k]].add_plane(n, d, double_area * 0.5f);
+                    }
+                }
+
+                // Edges used by a single triangle are open.
+                edge_use.clear();
+                for (size_t t = 0; t < triangle_count; ++t) {
+                    for (size_t k = 0; k < 3; ++k) {
+                        uint32_t a = result[(t * 3) + k];
+                        uint32_t b = result[(t * 3) + ((k + 1) % 3)];
+                        uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+                        edge_use[key]++;
+                    }
+                }
+
+                locked.assign(vertex_count, false);
+                for (const std::pair<const uint64_t, uint32_t>& edge : edge_use) {
+                    if (edge.second == 1) {
+                        locked[static_cast<uint32_t>(edge.first >> 32)] = true;
+                        locked[static_cast<uint32_t>(edge.first)] = true;
+                    }
+                }
+
+                // Triangles around each vertex.
+                adjacency_offsets.assign(vertex_count + 1, 0);
+                for (uint32_t index : result) {
+                    adjacency_offsets[index + 1]++;
+                }
+                for (size_t v = 0; v < vertex_count; ++v) {
+                    adjacency_offsets[v + 1] += adjacency_offsets[v];
+                }
+                adjacency.resize(result.size());
+                {
+                    std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+                    for (size_t i = 0; i < result.size(); ++i) {
+                        adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+                    }
+                }
+
+                // Cheapest direction of every edge that can move.
+                collapses.clear();
+                for (const std::pair<const uint64_t, uint32_t>& edge : edge_use) {
+                    uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+                    uint32_t b = static_cast<uint32_t>(edge.first);
+                    if (locked[a] && locked[b]) {
+                        continue;
+                    }
+
+                    quadric q(quadrics[a]);
+                    q.add(quadrics[b]);
+
+                    collapse c;
+                    if (locked[a]) {
+                        c.cost = q.error(positions[a]);
+                        c.from = b;
+                        c.to = a;
+                    }
+                    else if (locked[b]) {
+                        c.cost = q.error(positions[b]);
+                        c.from = a;
+                        c.to = b;
+                    }
+                    else {
+                        double cost_to_a = q.error(positions[a]);
+                        double cost_to_b = q.error(positions[b]);
+                        c.cost = std::min(cost_to_a, cost_to_b);
+                        c.from = (cost_to_a < cost_to_b) ? b : a;
+                        c.to = (cost_to_a < cost_to_b) ? a : b;
+                    }
+                    collapses.push_back(c);
+                }
+                std::sort(collapses.begin(), collapses.end());
+
+                // Each interior collapse removes two triangles.
+                size_t triangles_to_remove = (result.size() - target_index_count + 2) / 3;
+                size_t triangles_removed = 0;
+                double pass_error = 0.0;
+
+                remap.resize(vertex_count);
+                for (uint32_t v = 0; v < vertex_count; ++v) {
+                    remap[v] = v;
+                }
+                touched.assign(vertex_count, false);
+
+                for (const collapse& c : collapses) {
+                    if (triangles_removed >= triangles_to_remove) {
+                        break;
+                    }
+                    if (touched[c.from] || touched[c.to]) {
+                        continue;
+                    }
+
+                    // Reject collapses that would flip a surviving triangle.
+                    bool flips = false;
+                    for (uint32_t a = adjacency_offsets[c.from]; (a < adjacency_offsets[c.from + 1]) && !flips; ++a) {
+                        const uint32_t* triangle = &result[adjacency[a] * 3];
+                        if ((triangle[0] == c.to) || (triangle[1] == c.to) || (triangle[2] == c.to)) {
+                            continue; // Removed by the collapse.
+                        }
+
+                        glm::vec3 before[3];
+                        glm::vec3 after[3];
+                        for (size_t k = 0; k < 3; ++k) {
+                            before[k] = positions[triangle[k]];
+                            after[k] = positions[(triangle[k] == c.from) ? c.to : triangle[k]];
+                        }
+
+                        glm::vec3 n_before(glm::cross(before[1] - before[0], before[2] - before[0]));
+                        glm::vec3 n_after(glm::cross(after[1] - after[0], after[2] - after[0]));
+                        flips = (glm::dot(n_before, n_after) <= 0.0f);
+                    }
+                    if (flips) {
+                        continue;
+                    }
+
+                    remap[c.from] = c.to;
+                    touched[c.to] = true;
+                    for (uint32_t a = adjacency_offsets[c.from]; a < adjacency_offsets[c.from + 1]; ++a) {
+                        const uint32_t* triangle = &result[adjacency[a] * 3];
+                        touched[triangle[0]] = true;
+                        touched[triangle[1]] = true;
+                        touched[triangle[2]] = true;
+                    }
+
+                    pass_error = std::max(pass_error, c.cost);
+                    triangles_removed += 2;
+                }
+
+                simplified.clear();
+                for (size_t t = 0; t < triangle_count; ++t) {
+                    uint32_t a = remap[result[(t * 3) + 0]];
+                    uint32_t b = remap[result[(t * 3) + 1]];
+                    uint32_t c = remap[result[(t * 3) + 2]];
+                    if ((a != b) && (b != c) && (a != c)) {
+                        simplified.push_back(a);
+                        simplified.push_back(b);
+                        simplified.push_back(c);
+                    }
+                }
+
+                if (simplified.size() == result.size()) {
+                    break; // Nothing left that can collapse.
+                }
+
+                // Quadrics restart from the simplified surface, so pass errors accumulate.
+                total_error += static_cast<float>(std::sqrt(pass_error));
+                result.swap(simplified);
+            }
+
+            return (total_error);
+        }
+    }
+}
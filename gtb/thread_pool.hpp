@@ -0,0 +1,163 @@
+//  gtb: Graphics Test Bench
+//  Copyright 2018 Joshua Buckman
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#pragma once
+
+namespace gtb {
+    // Fixed set of worker threads pulling jobs from a shared queue.
+    class thread_pool {
+    public:
+        thread_pool()
+            : m_stopping(false)
+        {}
+
+        ~thread_pool()
+        {
+            stop();
+        }
+
+        void start(uint32_t thread_count)
+        {
+            for (uint32_t i = 0; i < thread_count; ++i) {
+                m_threads.emplace_back(&thread_pool::worker, this);
+            }
+        }
+
+        // Finishes queued jobs, then joins the workers.
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_job_ready.notify_all();
+
+            for (std::thread& t : m_threads) {
+                t.join();
+            }
+            m_threads.clear();
+            m_stopping = false;
+        }
+
+        size_t thread_count() const
+        {
+            return (m_threads.size());
+        }
+
+        void push(std::function<void()> job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_jobs.emplace_back(std::move(job));
+            }
+            m_job_ready.notify_one();
+        }
+
+        // Runs job(i) for every i in [0, count) on the workers and the calling thread, and returns once
+        // all of them finished. The first exception thrown by a job is rethrown here. Must not be
+        // called from inside a job.
+        template <typename function>
+        void parallel_for(size_t count, const function& job)
+        {
+            if (count == 0) {
+                return;
+            }
+
+            // Workers busy with other jobs may only get to a helper after every index is taken; such
+            // helpers return without touching the job, so the caller waits for the work rather than
+            // for the helpers, and the state outlives the call.
+            struct shared_state {
+                std::atomic<size_t> next_index;
+                size_t completed;
+                std::mutex mutex;
+                std::condition_variable done;
+                std::exception_ptr first_exception;
+            };
+            std::shared_ptr<shared_state> state(std::make_shared<shared_state>());
+            state->next_index = 0;
+            state->completed = 0;
+
+            const function* job_pointer = &job;
+            auto run = [state, job_pointer, count]() {
+                size_t finished = 0;
+                for (size_t i = state->next_index++; i < count; i = state->next_index++) {
+                    try {
+                        (*job_pointer)(i);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        if (!state->first_exception) {
+                            state->first_exception = std::current_exception();
+                        }
+                    }
+                    ++finished;
+                }
+
+                if (finished > 0) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->completed += finished;
+                    if (state->completed == count) {
+                        state->done.notify_one();
+                    }
+                }
+            };
+
+            size_t helper_count = std::min(m_threads.size(), count - 1);
+            for (size_t h = 0; h < helper_count; ++h) {
+                push(run);
+            }
+
+            run();
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->done.wait(lock, [&]() { return (state->completed == count); });
+
+            if (state->first_exception) {
+                std::rethrow_exception(state->first_exception);
+            }
+        }
+
+    private:
+        void worker()
+        {
+            for (;;) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_job_ready.wait(lock, [this]() { return (m_stopping || !m_jobs.empty()); });
+                    if (m_jobs.empty()) {
+                        return;
+                    }
+
+                    job = std::move(m_jobs.front());
+                    m_jobs.pop_front();
+                }
+
+                job();
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::deque<std::function<void()>> m_jobs;
+        std::mutex m_mutex;
+        std::condition_variable m_job_ready;
+        bool m_stopping;
+
+        // Disallow some C++ operations.
+        thread_pool(thread_pool&&) = delete;
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(thread_pool&&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+    };
+}
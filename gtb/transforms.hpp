@@ -0,0 +1,207 @@
+//  gtb: Graphics Test Bench
+//  Copyright 2018 Joshua Buckman
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#pragma once
+
+namespace gtb {
+    // Node transforms of one scene as parallel arrays. Nodes are added parents first, so a single
+    // pass in index order composes every world transform after its parent's.
+    class transform_hierarchy {
+    public:
+        static constexpr uint32_t no_parent = std::numeric_limits<uint32_t>::max();
+
+        transform_hierarchy()
+            : m_serial(0)
+            , m_dirty(false)
+        {}
+
+        uint32_t add(uint32_t parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+        {
+            uint32_t index = add(parent);
+            m_translations[index] = translation;
+            m_rotations[index] = rotation;
+            m_scales[index] = scale;
+            m_flags[index] = trs_changed;
+            return (index);
+        }
+
+        // Nodes given as a matrix keep it as their local transform until their TRS is set.
+        uint32_t add(uint32_t parent, const glm::mat4& local)
+        {
+            uint32_t index = add(parent);
+            m_locals[index] = local;
+            return (index);
+        }
+
+        size_t size() const
+        {
+            return (m_parents.size());
+        }
+
+        uint32_t parent(uint32_t index) const
+        {
+            return (m_parents[index]);
+        }
+
+        void set_translation(uint32_t index, const glm::vec3& translation)
+        {
+            m_translations[index] = translation;
+            mark(index, trs_changed);
+        }
+
+        void set_rotation(uint32_t index, const glm::quat& rotation)
+        {
+            m_rotations[index] = rotation;
+            mark(index, trs_changed);
+        }
+
+        void set_scale(uint32_t index, const glm::vec3& scale)
+        {
+            m_scales[index] = scale;
+            mark(index, trs_changed);
+        }
+
+        void set_local(uint32_t index, const glm::mat4& local)
+        {
+            m_locals[index] = local;
+            mark(index, local_changed);
+        }
+
+        const glm::mat4& world(uint32_t index) const
+        {
+            return (m_worlds[index]);
+        }
+
+        // The update a node's world transform last changed in; compare against serial().
+        uint64_t world_serial(uint32_t index) const
+        {
+            return (m_world_serials[index]);
+        }
+
+        uint64_t serial() const
+        {
+            return (m_serial);
+        }
+
+        // Recomputes world transforms of changed nodes and their descendants. Returns false without
+        // touching the arrays when nothing changed.
+        bool update()
+        {
+            if (!m_dirty) {
+                return (false);
+            }
+            m_dirty = false;
+
+            uint64_t serial = ++m_serial;
+            size_t count = m_parents.size();
+            for (size_t i = 0; i < count; ++i) {
+                uint8_t flags = m_flags[i];
+                uint32_t parent = m_parents[i];
+                bool parent_changed = (parent != no_parent) && (m_world_serials[parent] == serial);
+                if ((flags == 0) && !parent_changed) {
+                    continue;
+                }
+
+                if (flags & trs_changed) {
+                    compose_trs(m_translations[i], m_rotations[i], m_scales[i], m_locals[i]);
+                }
+                m_flags[i] = 0;
+
+                if (parent == no_parent) {
+                    m_worlds[i] = m_locals[i];
+                }
+                else {
+                    multiply(m_worlds[parent], m_locals[i], m_worlds[i]);
+                }
+                m_world_serials[i] = serial;
+            }
+
+            return (true);
+        }
+
+    private:
+        enum : uint8_t {
+            trs_changed = 1 << 0, // local transform is rebuilt from TRS
+            local_changed = 1 << 1
+        };
+
+        uint32_t add(uint32_t parent)
+        {
+            // Parents must already have been added.
+            uint32_t index = static_cast<uint32_t>(m_parents.size());
+            m_parents.push_back(parent);
+            m_translations.emplace_back(0.0f);
+            m_rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+            m_scales.emplace_back(1.0f);
+            m_locals.emplace_back(1.0f);
+            m_worlds.emplace_back(1.0f);
+            m_world_serials.push_back(0);
+            m_flags.push_back(local_changed);
+            m_dirty = true;
+            return (index);
+        }
+
+        void mark(uint32_t index, uint8_t flag)
+        {
+            m_flags[index] |= flag;
+            m_dirty = true;
+        }
+
+        // glTF order: scale, then rotate, then translate.
+        static void compose_trs(const glm::vec3& t, const glm::quat& r, const glm::vec3& s, glm::mat4& local)
+        {
+            glm::mat3 rotation(glm::mat3_cast(r));
+            local[0] = glm::vec4(rotation[0] * s.x, 0.0f);
+            local[1] = glm::vec4(rotation[1] * s.y, 0.0f);
+            local[2] = glm::vec4(rotation[2] * s.z, 0.0f);
+            local[3] = glm::vec4(t, 1.0f);
+        }
+
+        // result = a * b, two columns of b per 256 bit register.
+        static void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+        {
+            const float* a_columns = &a[0][0];
+            __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a_columns + 0));
+            __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a_columns + 4));
+            __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a_columns + 8));
+            __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a_columns + 12));
+
+            for (int column = 0; column < 4; column += 2) {
+                __m256 b_columns = _mm256_loadu_ps(&b[column][0]);
+                __m256 x = _mm256_shuffle_ps(b_columns, b_columns, _MM_SHUFFLE(0, 0, 0, 0));
+                __m256 y = _mm256_shuffle_ps(b_columns, b_columns, _MM_SHUFFLE(1, 1, 1, 1));
+                __m256 z = _mm256_shuffle_ps(b_columns, b_columns, _MM_SHUFFLE(2, 2, 2, 2));
+                __m256 w = _mm256_shuffle_ps(b_columns, b_columns, _MM_SHUFFLE(3, 3, 3, 3));
+
+                __m256 sum = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(a0, x), _mm256_mul_ps(a1, y)),
+                    _mm256_add_ps(_mm256_mul_ps(a2, z), _mm256_mul_ps(a3, w)));
+                _mm256_storeu_ps(&result[column][0], sum);
+            }
+        }
+
+        // Structure of arrays, one entry per node.
+        std::vector<uint32_t> m_parents;
+        std::vector<glm::vec3> m_translations;
+        std::vector<glm::quat> m_rotations;
+        std::vector<glm::vec3> m_scales;
+        std::vector<glm::mat4> m_locals;
+        std::vector<glm::mat4> m_worlds;
+        std::vector<uint64_t> m_world_serials;
+        std::vector<uint8_t> m_flags;
+
+        uint64_t m_serial;
+        bool m_dirty; // any flag set since the last update
+    };
+}
@@ -0,0 +1,111 @@
+#version 450 core
+#extension GL_ARB_separate_shader_objects : require
+
+// simple.frag plus virtual textures. Draws with a virtual texture sample the page atlas through the
+// page table, and one pixel of every 8x8 cell writes the page it wanted for the CPU to load.
+
+// Feedback stores would otherwise force late depth testing, losing early rejection (and the depth
+// pre-pass) and letting hidden fragments request pages.
+layout(early_fragment_tests) in;
+
+layout(location = 0) in vec2 tex_coord;
+layout(location = 1) in mat3 tangent_to_world; // not yet used; available for normal mapping
+layout(location = 4) flat in float texture_layer;
+layout(location = 5) flat in float virtual_texture; // id + 1; zero for regular textures
+
+layout(location = 0) out vec4 frag_color;
+
+layout(set = 0, binding = 0) uniform per_frame_block {
+    mat4 world_to_clip_transform; // projection transform * view transform
+    vec4 camera_position; // world space
+    vec4 frustum_planes[6]; // world space; inside when dot(plane.xyz, p) + plane.w >= 0
+    uvec4 feedback_cell; // xy = pixel of each 8x8 cell reporting this frame; z = cells per row
+};
+
+struct virtual_texture_info {
+    uint page_table_offset;
+    uint width; // of level 0
+    uint height;
+    uint levels; // bit 8 set for sRGB texels
+};
+
+// Entries are the atlas slot and level of the page to sample: slot x | slot y << 12 | level << 24.
+layout(set = 0, binding = 1) readonly buffer page_table_block {
+    virtual_texture_info virtual_textures[255];
+    uint page_table[]; // per texture, every level's pages row by row
+};
+
+layout(set = 0, binding = 2) writeonly buffer feedback_block {
+    uint feedback[]; // texture << 24 | level << 20 | page y << 10 | page x
+};
+
+layout(set = 1, binding = 1) uniform sampler2DArray tex_sampler; // single textures are one layer
+
+const uint page_size = 128u;
+const float slot_size = 130.0f; // pages have a one texel border
+const uint unmapped = 0xffffffffu;
+
+vec3 srgb_decode(vec3 c)
+{
+    return mix(c / 12.92f, pow((c + 0.055f) / 1.055f, vec3(2.4f)), greaterThan(c, vec3(0.04045f)));
+}
+
+vec4 sample_virtual(uint id)
+{
+    virtual_texture_info info = virtual_textures[id];
+    uvec2 size = uvec2(info.width, info.height);
+    uint levels = info.levels & 0xffu;
+
+    // The level the hardware would pick for the whole texture, from unwrapped coordinates so
+    // derivatives do not jump where they repeat.
+    vec2 texel_coord = tex_coord * vec2(size);
+    vec2 dx = dFdx(texel_coord);
+    vec2 dy = dFdy(texel_coord);
+    float lod = 0.5f * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0f));
+    uint level = min(uint(lod), levels - 1u);
+
+    vec2 uv = fract(tex_coord);
+    uint offset = info.page_table_offset;
+    uvec2 level_size = size;
+    for (uint l = 0u; l < level; ++l) {
+        uvec2 level_pages = (level_size + page_size - 1u) / page_size;
+        offset += level_pages.x * level_pages.y;
+        level_size = max(level_size >> 1u, uvec2(1u));
+    }
+    uvec2 pages = (level_size + page_size - 1u) / page_size;
+    uvec2 page = min(uvec2(uv * vec2(level_size)) / page_size, pages - 1u);
+
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+    if (all(equal(pixel % 8u, feedback_cell.xy))) {
+        feedback[((pixel.y / 8u) * feedback_cell.z) + (pixel.x / 8u)] = (id << 24) | (level << 20) | (page.y << 10) | page.x;
+    }
+
+    // Nothing is mapped until the coarsest page has loaded.
+    uint entry = page_table[offset + (page.y * pages.x) + page.x];
+    if (entry == unmapped) {
+        return vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    }
+
+    // The entry may be a coarser page covering this one.
+    vec2 resident_size = vec2(max(size >> (entry >> 24), uvec2(1u)));
+    vec2 resident_texel = uv * resident_size;
+    vec2 resident_page = min(floor(resident_texel / float(page_size)), ceil(resident_size / float(page_size)) - 1.0f);
+    vec2 slot = vec2(entry & 0xfffu, (entry >> 12) & 0xfffu);
+    vec2 atlas_texel = (slot * slot_size) + 1.0f + (resident_texel - (resident_page * float(page_size)));
+
+    vec4 color = textureLod(tex_sampler, vec3(atlas_texel / vec2(textureSize(tex_sampler, 0).xy), 0.0f), 0.0f);
+    if ((info.levels & 0x100u) != 0u) {
+        color.rgb = srgb_decode(color.rgb);
+    }
+    return color;
+}
+
+void main()
+{
+    if (virtual_texture > 0.0f) {
+        frag_color = sample_virtual(uint(virtual_texture) - 1u);
+    }
+    else {
+        frag_color = texture(tex_sampler, vec3(tex_coord, texture_layer));
+    }
+}
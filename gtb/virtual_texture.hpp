@@ -0,0 +1,378 @@
+//  gtb: Graphics Test Bench
+//  Copyright 2018 Joshua Buckman
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+#pragma once
+
+namespace gtb {
+    namespace vt {
+        // Pages are square blocks of one level, stored with a border of the neighbouring texels so
+        // bilinear filtering never reads past the page's atlas slot.
+        const uint32_t page_size = 128;
+        const uint32_t page_border = 1;
+        const uint32_t slot_size = page_size + (2 * page_border);
+        const size_t tile_bytes = static_cast<size_t>(slot_size) * slot_size * 4;
+
+        // Feedback words pack the texture, level and page a pixel wants; all bits set means no request,
+        // so texture 255 is never handed out.
+        const uint32_t max_textures = 255;
+        const uint32_t max_levels = 16;
+        const uint32_t max_pages_per_side = 1024;
+        const uint32_t no_request = 0xffffffff;
+
+        inline uint32_t request_texture(uint32_t request)
+        {
+            return (request >> 24);
+        }
+
+        inline uint32_t request_level(uint32_t request)
+        {
+            return ((request >> 20) & 0xf);
+        }
+
+        inline uint32_t request_page_x(uint32_t request)
+        {
+            return (request & 0x3ff);
+        }
+
+        inline uint32_t request_page_y(uint32_t request)
+        {
+            return ((request >> 10) & 0x3ff);
+        }
+
+        // Page table entries hold the atlas slot and level of the page a lookup samples from.
+        const uint32_t unmapped = 0xffffffff;
+
+        inline uint32_t entry(uint32_t slot_x, uint32_t slot_y, uint32_t level)
+        {
+            return (slot_x | (slot_y << 12) | (level << 24));
+        }
+
+        inline uint32_t entry_level(uint32_t e)
+        {
+            return (e >> 24);
+        }
+
+        // Levels and pages of one virtual texture; levels stop at the first that fits one page. Pages
+        // are numbered level by level, row by row, both in tile files and in page tables.
+        class layout {
+        public:
+            layout()
+                : m_page_count(0)
+            {}
+
+            layout(uint32_t width, uint32_t height)
+                : m_page_count(0)
+            {
+                for (;;) {
+                    level l;
+                    l.width = width;
+                    l.height = height;
+                    l.pages_x = (width + page_size - 1) / page_size;
+                    l.pages_y = (height + page_size - 1) / page_size;
+                    l.first_page = m_page_count;
+                    m_levels.push_back(l);
+                    m_page_count += l.pages_x * l.pages_y;
+
+                    if ((l.pages_x == 1) && (l.pages_y == 1)) {
+                        break;
+                    }
+
+                    width = std::max(width >> 1, 1u);
+                    height = std::max(height >> 1, 1u);
+                }
+            }
+
+            uint32_t levels() const
+            {
+                return (static_cast<uint32_t>(m_levels.size()));
+            }
+
+            uint32_t width(uint32_t l) const
+            {
+                return (m_levels[l].width);
+            }
+
+            uint32_t height(uint32_t l) const
+            {
+                return (m_levels[l].height);
+            }
+
+            uint32_t pages_x(uint32_t l) const
+            {
+                return (m_levels[l].pages_x);
+            }
+
+            uint32_t pages_y(uint32_t l) const
+            {
+                return (m_levels[l].pages_y);
+            }
+
+            uint32_t page_count() const
+            {
+                return (m_page_count);
+            }
+
+            uint32_t page(uint32_t l, uint32_t x, uint32_t y) const
+            {
+                return (m_levels[l].first_page + (y * m_levels[l].pages_x) + x);
+            }
+
+            // Inverse of page.
+            void coordinates(uint32_t p, uint32_t& l, uint32_t& x, uint32_t& y) const
+            {
+                for (l = levels() - 1; m_levels[l].first_page > p; --l) {}
+                p -= m_levels[l].first_page;
+                x = p % m_levels[l].pages_x;
+                y = p / m_levels[l].pages_x;
+            }
+
+            // The page one level up covering a page; odd sized levels give their last column or row
+            // of pages to the last one above.
+            uint32_t parent(uint32_t l, uint32_t x, uint32_t y) const
+            {
+                return (page(l + 1, std::min(x >> 1, m_levels[l + 1].pages_x - 1), std::min(y >> 1, m_levels[l + 1].pages_y - 1)));
+            }
+
+            // Pages of level l under page (x, y) of a coarser level, as half open ranges.
+            void descendants(uint32_t coarse_level, uint32_t x, uint32_t y, uint32_t l, uint32_t& x0, uint32_t& x1, uint32_t& y0, uint32_t& y1) const
+            {
+                uint32_t shift = coarse_level - l;
+                x0 = x << shift;
+                y0 = y << shift;
+                x1 = (x + 1 == m_levels[coarse_level].pages_x) ? m_levels[l].pages_x : std::min((x + 1) << shift, m_levels[l].pages_x);
+                y1 = (y + 1 == m_levels[coarse_level].pages_y) ? m_levels[l].pages_y : std::min((y + 1) << shift, m_levels[l].pages_y);
+            }
+
+        private:
+            struct level {
+                uint32_t width;
+                uint32_t height;
+                uint32_t pages_x;
+                uint32_t pages_y;
+                uint32_t first_page;
+            };
+
+            std::vector<level> m_levels;
+            uint32_t m_page_count;
+        };
+
+        // Tile files start with this header, followed by every page's tile as RGBA8 in page order.
+        struct file_header {
+            char magic[4]; // GTBV
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint32_t srgb;
+        };
+
+        const uint32_t file_version = 1;
+
+        inline uint64_t tile_offset(uint32_t page)
+        {
+            return (sizeof(file_header) + (static_cast<uint64_t>(page) * tile_bytes));
+        }
+
+        // Copies page (x, y) of an RGBA8 level and its border into a tile; texels past the level's
+        // edges wrap, as texture coordinates repeat.
+        inline void extract_tile(const uint8_t* texels, uint32_t width, uint32_t height, uint32_t x, uint32_t y, uint8_t* tile)
+        {
+            std::vector<uint32_t> columns(slot_size);
+            for (uint32_t tx = 0; tx < slot_size; ++tx) {
+                int64_t sx = static_cast<int64_t>(x * page_size) + tx - page_border;
+                columns[tx] = static_cast<uint32_t>(((sx % width) + width) % width);
+            }
+
+            for (uint32_t ty = 0; ty < slot_size; ++ty) {
+                int64_t sy = static_cast<int64_t>(y * page_size) + ty - page_border;
+                const uint8_t* row = texels + (static_cast<size_t>(((sy % height) + height) % height) * width * 4);
+                uint8_t* out = tile + (static_cast<size_t>(ty) * slot_size * 4);
+                for (uint32_t tx = 0; tx < slot_size; ++tx) {
+                    std::memcpy(out + (tx * 4), row + (static_cast<size_t>(columns[tx]) * 4), 4);
+                }
+            }
+        }
+
+        // Where each page of one texture is sampled from: its own atlas slot once resident, otherwise
+        // the nearest resident page above it. Nothing is mapped until the coarsest page is.
+        class page_table {
+        public:
+            page_table()
+            {}
+
+            explicit page_table(const layout& l)
+                : m_layout(l),
+                  m_entries(l.page_count(), unmapped),
+                  m_slots(l.page_count(), unmapped)
+            {}
+
+            const layout& pages() const
+            {
+                return (m_layout);
+            }
+
+            const std::vector<uint32_t>& entries() const
+            {
+                return (m_entries);
+            }
+
+            // Atlas slot holding a page, or unmapped.
+            uint32_t slot(uint32_t p) const
+            {
+                return (m_slots[p]);
+            }
+
+            // Points the page, and the pages under it that fell back to coarser ones, at its slot.
+            // Changed entries are appended to changed.
+            void map(uint32_t l, uint32_t x, uint32_t y, uint32_t slot, uint32_t e, std::vector<uint32_t>& changed)
+            {
+                m_slots[m_layout.page(l, x, y)] = slot;
+
+                for (uint32_t fine = l + 1; fine-- > 0;) {
+                    uint32_t x0, x1, y0, y1;
+                    m_layout.descendants(l, x, y, fine, x0, x1, y0, y1);
+                    for (uint32_t py = y0; py < y1; ++py) {
+                        for (uint32_t px = x0; px < x1; ++px) {
+                            uint32_t p = m_layout.page(fine, px, py);
+                            if ((fine == l) || (m_entries[p] == unmapped) || (entry_level(m_entries[p]) > l)) {
+                                m_entries[p] = e;
+                                changed.push_back(p);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Points the pages that sampled from a page back at whatever its parent samples from. The
+            // coarsest page has no parent and is never unmapped.
+            void unmap(uint32_t l, uint32_t x, uint32_t y, std::vector<uint32_t>& changed)
+            {
+                m_slots[m_layout.page(l, x, y)] = unmapped;
+                uint32_t fallback = m_entries[m_layout.parent(l, x, y)];
+
+                for (uint32_t fine = l + 1; fine-- > 0;) {
+                    uint32_t x0, x1, y0, y1;
+                    m_layout.descendants(l, x, y, fine, x0, x1, y0, y1);
+                    for (uint32_t py = y0; py < y1; ++py) {
+                        for (uint32_t px = x0; px < x1; ++px) {
+                            uint32_t p = m_layout.page(fine, px, py);
+                            if ((m_entries[p] != unmapped) && (entry_level(m_entries[p]) == l)) {
+                                m_entries[p] = fallback;
+                                changed.push_back(p);
+                            }
+                        }
+                    }
+                }
+            }
+
+        private:
+            layout m_layout;
+            std::vector<uint32_t> m_entries;
+            std::vector<uint32_t> m_slots;
+        };
+
+        // Atlas slots and the page each holds, replaced least recently used first.
+        class page_cache {
+        public:
+            page_cache()
+            {}
+
+            explicit page_cache(uint32_t slot_count)
+                : m_slots(slot_count)
+            {
+                for (uint32_t s = slot_count; s-- > 0;) {
+                    m_free.push_back(s);
+                }
+            }
+
+            uint32_t slot_count() const
+            {
+                return (static_cast<uint32_t>(m_slots.size()));
+            }
+
+            // Finds a slot for a new page: a free one, else the least recently used page that is
+            // neither pinned nor used this frame, which the caller must unmap. False when there is none.
+            bool allocate(uint64_t frame, uint32_t& slot, bool& evicted, uint32_t& evicted_texture, uint32_t& evicted_page)
+            {
+                evicted = false;
+                if (!m_free.empty()) {
+                    slot = m_free.back();
+                    m_free.pop_back();
+                    return (true);
+                }
+
+                uint64_t oldest = frame;
+                slot = unmapped;
+                for (uint32_t s = 0; s < m_slots.size(); ++s) {
+                    const slot_state& ss = m_slots[s];
+                    if (ss.used && !ss.pinned && (ss.last_used < oldest)) {
+                        oldest = ss.last_used;
+                        slot = s;
+                    }
+                }
+
+                if (slot == unmapped) {
+                    return (false);
+                }
+
+                evicted = true;
+                evicted_texture = m_slots[slot].texture;
+                evicted_page = m_slots[slot].page;
+                m_slots[slot].used = false;
+                return (true);
+            }
+
+            void assign(uint32_t slot, uint32_t texture, uint32_t page, uint64_t frame, bool pinned)
+            {
+                slot_state& ss = m_slots[slot];
+                ss.texture = texture;
+                ss.page = page;
+                ss.last_used = frame;
+                ss.used = true;
+                ss.pinned = pinned;
+            }
+
+            void touch(uint32_t slot, uint64_t frame)
+            {
+                m_slots[slot].last_used = frame;
+            }
+
+            // Frees every slot of a texture.
+            void release_texture(uint32_t texture)
+            {
+                for (uint32_t s = 0; s < m_slots.size(); ++s) {
+                    if (m_slots[s].used && (m_slots[s].texture == texture)) {
+                        m_slots[s].used = false;
+                        m_free.push_back(s);
+                    }
+                }
+            }
+
+        private:
+            struct slot_state {
+                slot_state()
+                    : texture(0), page(0), last_used(0), used(false), pinned(false)
+                {}
+
+                uint32_t texture;
+                uint32_t page;
+                uint64_t last_used;
+                bool used;
+                bool pinned;
+            };
+
+            std::vector<slot_state> m_slots;
+            std::vector<uint32_t> m_free;
+        };
+    }
+}